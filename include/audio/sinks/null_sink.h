@@ -0,0 +1,8 @@
+#ifndef _NULL_SINK_H
+#define _NULL_SINK_H
+
+#include "audio/sink.h"
+
+int null_sink_init(audio_sink *sink);
+
+#endif // _NULL_SINK_H
@@ -3,5 +3,6 @@
 
 void sound_play(int id, float volume, float panning, float pitch);
 void sound_set_volume(float volume);
+void sound_mute(int muted);
 
 #endif // _SOUND_H
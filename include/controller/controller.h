@@ -28,6 +28,10 @@ enum {
     CTRL_TYPE_KEYBOARD,
     CTRL_TYPE_GAMEPAD,
     CTRL_TYPE_NETWORK,
+    CTRL_TYPE_RANDOM,
+    CTRL_TYPE_REPLAY,
+    CTRL_TYPE_ROLLBACK,
+    CTRL_TYPE_SPECTATE,
 };
 
 typedef struct ctrl_event_t ctrl_event;
@@ -23,5 +23,6 @@ struct joystick_t {
 
 void joystick_create(controller *ctrl, int joystick_id);
 void joystick_free(controller *ctrl);
+void joystick_probe();
 
 #endif // _joystick_H
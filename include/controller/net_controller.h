@@ -2,10 +2,26 @@
 #define _NET_CONTROLLER_H
 
 #include "controller/controller.h"
+#include "game/rollback.h"
 #include <SDL2/SDL.h>
 #include <enet/enet.h>
 
+// Connection quality, sampled by the network thread every NET_STATS_INTERVAL ms
+#define NET_STATS_INTERVAL 1000
+
+typedef struct net_stats_t {
+    unsigned int time;      // When the sample was taken
+    unsigned int rtt;       // Round trip time, ms
+    unsigned int jitter;    // Round trip time variance, ms
+    float loss;             // Packets lost, percent
+    unsigned int bytes_in;  // Received per second
+    unsigned int bytes_out; // Sent per second
+    int input_delay;        // Ticks between our own input and the newest peer input
+} net_stats;
+
 void net_controller_create(controller *ctrl, ENetHost *host, ENetPeer *peer);
 void net_controller_free(controller *ctrl);
+void net_controller_get_transport(controller *ctrl, rollback_transport *net);
+int net_controller_get_stats(controller *ctrl, net_stats *stats);
 
 #endif // _NET_CONTROLLER_H
@@ -0,0 +1,18 @@
+#ifndef _RANDOM_CONTROLLER_H
+#define _RANDOM_CONTROLLER_H
+
+#include "controller/controller.h"
+#include "utils/random.h"
+
+typedef struct random_controller_t random_controller;
+
+struct random_controller_t {
+    random rand;
+    int action;
+    int hold;
+};
+
+void random_controller_create(controller *ctrl, uint32_t seed);
+void random_controller_free(controller *ctrl);
+
+#endif // _RANDOM_CONTROLLER_H
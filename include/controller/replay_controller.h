@@ -0,0 +1,21 @@
+#ifndef _REPLAY_CONTROLLER_H
+#define _REPLAY_CONTROLLER_H
+
+#include "controller/controller.h"
+#include "game/replay.h"
+
+typedef struct replay_controller_t replay_controller;
+
+struct replay_controller_t {
+    replay *rep;
+    int player;
+    unsigned int tick;
+    unsigned int pos;
+};
+
+void replay_controller_create(controller *ctrl, replay *rep, int player);
+void replay_controller_free(controller *ctrl);
+int replay_controller_finished(controller *ctrl);
+uint32_t replay_controller_get_seed(controller *ctrl);
+
+#endif // _REPLAY_CONTROLLER_H
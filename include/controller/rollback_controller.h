@@ -0,0 +1,20 @@
+#ifndef _ROLLBACK_CONTROLLER_H
+#define _ROLLBACK_CONTROLLER_H
+
+#include "controller/controller.h"
+#include "game/rollback.h"
+
+typedef struct rollback_controller_t rollback_controller;
+
+struct rollback_controller_t {
+    rollback *rb;
+    int player;
+};
+
+void rollback_controller_create(controller *ctrl, rollback *rb, int player);
+void rollback_controller_free(controller *ctrl);
+rollback_input rollback_controller_buttons(int action);
+rollback_input rollback_controller_pack(ctrl_event *ev);
+void rollback_controller_cmd(controller *ctrl, rollback_input input, ctrl_event **ev);
+
+#endif // _ROLLBACK_CONTROLLER_H
@@ -0,0 +1,17 @@
+#ifndef _SPECTATE_CONTROLLER_H
+#define _SPECTATE_CONTROLLER_H
+
+#include "controller/controller.h"
+#include "game/spectate.h"
+
+typedef struct spectate_controller_t spectate_controller;
+
+struct spectate_controller_t {
+    spectate_viewer *sv;
+    int player;
+};
+
+void spectate_controller_create(controller *ctrl, spectate_viewer *sv, int player);
+void spectate_controller_free(controller *ctrl);
+
+#endif // _SPECTATE_CONTROLLER_H
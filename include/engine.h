@@ -1,8 +1,22 @@
 #ifndef _ENGINE_H
 #define _ENGINE_H
 
-int engine_init(); // Init window, audiodevice, etc.
-void engine_run(); // Run game
+typedef struct engine_init_flags_t {
+    int headless;       // No window, no audio device; tick as fast as possible
+    int arena;          // Arena number (0-4) for headless runs
+    unsigned int ticks; // Amount of ticks to simulate in headless runs
+    const char *record_file;   // If set, arena matches are recorded here
+    const char *playback_file; // If set, this replay is played back instead
+    int loopback;       // Latency in ticks for a headless rollback match over loopback, or -1
+    const char *golden_dir; // If set, scripted scenes are rendered offscreen and checked against golden frames here
+    int golden_write;   // Write the golden frames instead of checking them
+    const char *capture_file;  // If set, gameplay video is recorded here
+    const char *spectate_host; // If set, the network match of this player is watched
+    int result;         // Exit code; set by engine_run
+} engine_init_flags;
+
+int engine_init(engine_init_flags *init_flags); // Init window, audiodevice, etc.
+void engine_run(engine_init_flags *init_flags); // Run game
 void engine_close(); // Kill window, audiodev
 
 #endif // _ENGINE_H
@@ -1,17 +1,32 @@
 #ifndef _GAME_STATE_H
 #define _GAME_STATE_H
 
+#include <stdint.h>
 #include <SDL2/SDL.h>
 #include "utils/vector.h"
 #include "game/protos/scene.h"
 #include "game/protos/object.h"
 #include "game/game_player.h"
+#include "game/scene_loader.h"
+
+// Copies of all visible objects, in render order
+typedef struct render_snapshot_t {
+    object *items;
+    unsigned int count;
+    unsigned int size;
+} render_snapshot;
 
 typedef struct game_state_t {
     unsigned int run;
     unsigned int this_id, next_id;
     scene sc;
+    scene_loader loader;
+    unsigned int next_object_id;
     vector objects;
+    vector dead_objects;
+    render_snapshot snapshots[2];
+    int snapshot_front;
+    int snapshot_ready;
     game_player players[2];
 } game_state;
 
@@ -24,7 +39,14 @@ enum {
 int game_state_create();
 void game_state_free();
 int game_state_handle_event(SDL_Event *event);
-void game_state_render();
+void game_state_render_background();
+void game_state_render(float alpha);
+void game_state_render_overlay();
+void game_state_snapshot();
+void game_state_swap_snapshot();
+void game_state_free_dead();
+int game_state_scene_pending();
+int game_state_switch_scene(int wait);
 void game_state_tick();
 scene* game_state_get_scene();
 int game_state_is_running();
@@ -36,4 +58,9 @@ void game_state_add_object(object *obj, int layer);
 void game_state_del_object(object *obj);
 void game_state_del_animation(int anim_id);
 
+unsigned int game_state_save_size();
+int game_state_save(char *buf, unsigned int size);
+int game_state_load(const char *buf, unsigned int size);
+uint32_t game_state_checksum();
+
 #endif // _GAME_STATE_H
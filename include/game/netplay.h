@@ -0,0 +1,36 @@
+#ifndef _NETPLAY_H
+#define _NETPLAY_H
+
+#include "controller/controller.h"
+#include "controller/net_controller.h"
+#include "game/rollback.h"
+
+// Network matches run under a rollback session. When an arena is loaded with a
+// network controller on one side, the session takes over both players: the local
+// controller is only polled for input, the network controller only carries the
+// session packets, and the game sees what the rollback controllers give it.
+// Sessions are started and stopped along with the arena, while the simulation is idle.
+//
+// Players take spectators on the spectate_port of the network settings. Viewers
+// connect with netplay_watch, and run the match from the confirmed input of both
+// players, through spectate controllers.
+
+// Game callbacks for a rollback session, with local input polled from a controller
+void netplay_sim_create(rollback_sim *sim, controller *input);
+
+// Starts a session if a player has a network controller. Returns 1 on error.
+int netplay_start();
+void netplay_stop();
+rollback* netplay_get_session(); // NULL if there is no network match
+void netplay_serve(); // Sends viewers what they are missing; after every tick of the session
+
+// Connects to a player as a viewer, and waits for the match to come in. The match
+// arena is loaded when it does, so the simulation must be idle. Returns 1 on error.
+int netplay_watch(const char *addr);
+int netplay_is_watching();
+int netplay_watch_tick(); // Instead of ticking the game. Returns -1 once the match is gone.
+
+// Connection stats of the match. Returns 1 if there are none yet.
+int netplay_get_stats(net_stats *stats);
+
+#endif // _NETPLAY_H
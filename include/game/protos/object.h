@@ -6,7 +6,7 @@
 #include "game/protos/player.h"
 #include "utils/vec.h"
 #include "utils/hashmap.h"
-#include "video/texture.h"
+#include "video/tcache.h"
 
 #define OBJECT_DEFAULT_LAYER 0x01
 #define OBJECT_NO_GROUP -1
@@ -31,6 +31,20 @@ enum {
     PLAY_FORWARDS
 };
 
+// What an object is. Saved states keep no callbacks, so objects that are
+// created from a saved state get the callbacks of their type.
+enum {
+    OBJECT_TYPE_PLAIN = 0, // No callbacks
+    OBJECT_TYPE_SCENE,     // Spawns more animations of the scene
+    OBJECT_TYPE_HAR,
+    OBJECT_TYPE_PROJECTILE,
+    OBJECT_TYPE_SCRAP,
+    OBJECT_TYPE_READY,     // Arena announcements
+    OBJECT_TYPE_FIGHT,
+    OBJECT_TYPE_YOUWIN,
+    OBJECT_TYPE_YOULOSE
+};
+
 typedef struct object_t object;
 
 typedef void (*object_free_cb)(object *obj);
@@ -40,9 +54,14 @@ typedef void (*object_move_cb)(object *obj);
 typedef void (*object_collide_cb)(object *a, object *b);
 typedef void (*object_finish_cb)(object *obj);
 typedef void (*object_debug_cb)(object *obj);
+typedef unsigned int (*object_serialize_cb)(object *obj, char *buf);
+typedef int (*object_unserialize_cb)(object *obj, const char *buf);
 
 struct object_t {
+    unsigned int id;
+    int type;
     vec2f pos;
+    vec2f prev_pos;
     vec2f vel;
     int vstate;
     int hstate;
@@ -59,12 +78,12 @@ struct object_t {
     sprite *cur_sprite;
     char *sound_translation_table;
 
-    int texture_refresh;
+    unsigned int texture_rev; // Bumped whenever the texture needs to be made again
     palette *cur_palette;
     int cur_remap;
     int halt;
     int stride;
-    texture *cur_texture;
+    tcache_ref *cur_texture;
 
     player_sprite_state sprite_state;
     player_animation_state animation_state;
@@ -78,10 +97,18 @@ struct object_t {
     object_finish_cb finish;
     object_move_cb move;
     object_debug_cb debug;
+
+    // If set, object owns its userdata, and these save and restore it.
+    // Serialized userdata must not contain pointers. Otherwise userdata
+    // is given by the type of the object.
+    object_serialize_cb serialize;
+    object_unserialize_cb unserialize;
 };
 
 void object_create(object *obj, vec2i pos, vec2f vel);
 void object_render(object *obj);
+void object_render_interpolated(object *obj, float alpha);
+void object_store_pos(object *obj);
 void object_render_neutral(object *obj);
 void object_debug(object *obj);
 void object_tick(object *obj);
@@ -93,6 +120,11 @@ void object_act(object *obj, int action);
 int object_finished(object *obj);
 void object_free(object *obj);
 
+unsigned int object_save_size(object *obj);
+unsigned int object_save(object *obj, char *buf);
+int object_load(object *obj, const char *buf, unsigned int size);
+void object_set_refs(object *obj, animation *ani, sprite *spr, palette *pal, char *stl);
+
 void object_set_stride(object *obj, int stride);
 void object_set_playback_direction(object *obj, int dir);
 
@@ -116,6 +148,8 @@ void object_set_group(object *obj, int group);
 void object_set_gravity(object *obj, float gravity);
 void object_set_static(object *obj, int is_static);
 
+void object_set_type(object *obj, int type);
+int object_get_type(object *obj);
 void object_set_userdata(object *obj, void *ptr);
 void *object_get_userdata(object *obj);
 void object_set_free_cb(object *obj, object_free_cb cbfunc);
@@ -125,6 +159,8 @@ void object_set_collide_cb(object *obj, object_collide_cb cbfunc);
 void object_set_finish_cb(object *obj, object_finish_cb cbfunc);
 void object_set_move_cb(object *obj, object_move_cb cbfunc);
 void object_set_debug_cb(object *obj, object_debug_cb cbfunc);
+void object_set_serialize_cb(object *obj, object_serialize_cb cbfunc);
+void object_set_unserialize_cb(object *obj, object_unserialize_cb cbfunc);
 
 void object_set_repeat(object *obj, int repeat);
 int object_get_repeat(object *obj);
@@ -2,6 +2,7 @@
 #define _PLAYER_H
 
 #include "utils/vec.h"
+#include "utils/string.h"
 
 typedef struct object_t object;
 typedef struct sd_stringparser_t sd_stringparser;
@@ -40,6 +41,7 @@ typedef struct player_animation_state_t {
     unsigned int end_frame;
     int previous;
     sd_stringparser *parser;
+    str string; // Copy of the string loaded into the parser
     int enemy_x, enemy_y;
 
     void *spawn_userdata;
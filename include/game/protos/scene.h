@@ -17,6 +17,8 @@ typedef void (*scene_render_overlay_cb)(scene *scene);
 typedef void (*scene_tick_cb)(scene *scene);
 typedef void (*scene_input_tick_cb)(scene *scene);
 typedef int (*scene_startup_cb)(scene *scene, int anim_id);
+typedef unsigned int (*scene_serialize_cb)(scene *scene, char *buf);
+typedef int (*scene_unserialize_cb)(scene *scene, const char *buf);
 
 struct scene_t {
     int id;
@@ -30,9 +32,15 @@ struct scene_t {
     scene_tick_cb tick;
     scene_input_tick_cb input_tick;
     scene_startup_cb startup;
+
+    // Save and restore the simulation state the scene keeps outside of its objects.
+    // With a NULL buffer, serialize only returns the size.
+    scene_serialize_cb serialize;
+    scene_unserialize_cb unserialize;
 };
 
 int scene_create(scene *scene, int scene_id);
+void scene_create_from_bk(scene *scene, int scene_id, bk *bk_data);
 void scene_init(scene *scene);
 void scene_free(scene *scene);
 int scene_event(scene *scene, SDL_Event *event);
@@ -41,6 +49,12 @@ void scene_render(scene *scene);
 void scene_tick(scene *scene);
 void scene_input_tick(scene *scene);
 int scene_startup(scene *scene, int id);
+unsigned int scene_serialize(scene *scene, char *buf);
+int scene_unserialize(scene *scene, const char *buf, unsigned int size);
+
+// Spawn and destroy callbacks of scene objects. Userdata is the scene.
+void cb_scene_spawn_object(object *parent, int id, vec2i pos, int g, void *userdata);
+void cb_scene_destroy_object(object *parent, int id, void *userdata);
 
 void scene_set_userdata(scene *scene, void *userdata);
 void* scene_get_userdata(scene *scene);
@@ -52,5 +66,7 @@ void scene_set_render_overlay_cb(scene *scene, scene_render_overlay_cb cbfunc);
 void scene_set_tick_cb(scene *scene, scene_tick_cb cbfunc);
 void scene_set_input_tick_cb(scene *scene, scene_input_tick_cb cbfunc);
 void scene_set_startup_cb(scene *scene, scene_startup_cb cbfunc);
+void scene_set_serialize_cb(scene *scene, scene_serialize_cb cbfunc);
+void scene_set_unserialize_cb(scene *scene, scene_unserialize_cb cbfunc);
 
 #endif // _SCENE_H
@@ -0,0 +1,43 @@
+#ifndef _REPLAY_H
+#define _REPLAY_H
+
+#include <stdint.h>
+#include "utils/vector.h"
+
+typedef struct replay_event_t {
+    uint32_t tick;
+    uint8_t player;
+    uint8_t action;
+} replay_event;
+
+typedef struct replay_player_t {
+    int har_id;
+    int pilot_id;
+    char colors[3];
+} replay_player;
+
+// Everything needed to play a match again: the initial rng seed,
+// the arena, the players, and every controller action of every tick.
+typedef struct replay_t {
+    uint32_t seed;
+    int arena_id;
+    replay_player players[2];
+    uint32_t ticks;
+    vector events;
+} replay;
+
+void replay_create(replay *rep);
+void replay_free(replay *rep);
+void replay_add(replay *rep, uint32_t tick, int player, int action);
+int replay_save(replay *rep, const char *filename);
+int replay_load(replay *rep, const char *filename);
+
+// Recording. When enabled, every arena match is written to the given file as it ends.
+void replay_record_start(const char *filename);
+void replay_record_stop();
+void replay_record_match_start(int arena_id);
+void replay_record_action(int player, int action);
+void replay_record_tick();
+void replay_record_match_end();
+
+#endif // _REPLAY_H
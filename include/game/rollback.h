@@ -0,0 +1,160 @@
+#ifndef _ROLLBACK_H
+#define _ROLLBACK_H
+
+#include <stdint.h>
+
+// Window and delay limits. Frame ring must hold everything from the oldest
+// unconfirmed tick up to the newest input the peer can have sent us.
+#define ROLLBACK_MAX_WINDOW 32
+#define ROLLBACK_MAX_DELAY 16
+#define ROLLBACK_RING 128
+
+// Buttons held by one player during one tick
+typedef uint8_t rollback_input;
+
+enum {
+    ROLLBACK_UP    = 0x01,
+    ROLLBACK_DOWN  = 0x02,
+    ROLLBACK_LEFT  = 0x04,
+    ROLLBACK_RIGHT = 0x08,
+    ROLLBACK_PUNCH = 0x10,
+    ROLLBACK_KICK  = 0x20
+};
+
+// Input packet: the sender's ack (u32), the tick of the first input (u32),
+// a checksum tick (u32) and checksum (u32), input count (u8), and one byte per input.
+// Every packet repeats all the inputs the peer has not acknowledged yet, up to
+// ROLLBACK_MAX_INPUTS, so packets may be lost.
+#define ROLLBACK_MAX_INPUTS 32
+#define ROLLBACK_PACKET_HEADER 17
+#define ROLLBACK_PACKET_MAX (ROLLBACK_PACKET_HEADER + ROLLBACK_MAX_INPUTS)
+
+// Checksum tick when the packet has no checksum
+#define ROLLBACK_NO_TICK 0xFFFFFFFF
+
+typedef struct rollback_packet_info_t {
+    uint32_t ack;
+    uint32_t first;
+    uint32_t check_tick;
+    uint32_t checksum;
+} rollback_packet_info;
+
+int rollback_packet_write(char *buf, const rollback_packet_info *info, const rollback_input *inputs, int count);
+int rollback_packet_read(const char *buf, int len, rollback_packet_info *info, rollback_input *inputs);
+
+// The game being simulated. Advance runs exactly one tick, and reads
+// the inputs of both players with rollback_get_input. Checksum is optional.
+typedef struct rollback_sim_t {
+    void *userdata;
+    unsigned int (*save_size)(void *userdata);
+    int (*save)(void *userdata, char *buf, unsigned int size);
+    int (*load)(void *userdata, const char *buf, unsigned int size);
+    void (*advance)(void *userdata, int resimulating);
+    rollback_input (*poll)(void *userdata);
+    uint32_t (*checksum)(void *userdata);
+} rollback_sim;
+
+// Packet channel to the remote peer. Packets may be lost or reordered.
+// Recv returns the packet length, 0 if nothing is waiting, or -1 if the peer is gone.
+typedef struct rollback_transport_t {
+    void *userdata;
+    int (*send)(void *userdata, const char *buf, unsigned int len);
+    int (*recv)(void *userdata, char *buf, unsigned int size);
+} rollback_transport;
+
+typedef struct rollback_frame_t {
+    uint32_t tick;
+    rollback_input input[2];
+    rollback_input predicted; // Remote input used when this tick was last simulated
+    char known[2];
+    char saved;
+    char *state;              // Game state at the start of this tick
+    uint32_t checksum;        // Checksum of that state
+    unsigned int state_size;
+    unsigned int state_alloc;
+} rollback_frame;
+
+typedef struct rollback_stats_t {
+    unsigned int rollbacks;   // Amount of mispredictions corrected
+    unsigned int resimulated; // Ticks simulated again because of them
+    unsigned int max_depth;   // Longest single rollback, in ticks
+    unsigned int stalls;      // Ticks skipped waiting for the peer
+    unsigned int packets;     // Packets sent
+    unsigned int bytes;       // Bytes sent
+    unsigned int checks;      // Checksums compared with the peer
+} rollback_stats;
+
+// Checksums from the peer, waiting for our own state of the same tick to be final
+#define ROLLBACK_CHECKS 16
+
+typedef struct rollback_check_t {
+    uint32_t tick;
+    uint32_t checksum;
+} rollback_check;
+
+typedef struct rollback_t {
+    rollback_sim sim;
+    rollback_transport net;
+    int local;                // Local player, 0 or 1
+    int delay;                // Local input is applied this many ticks after it is read
+    int window;               // How many ticks we may run ahead of confirmed remote input
+    uint32_t tick;            // Next tick to simulate
+    uint32_t current;         // Tick being simulated right now
+    uint32_t confirmed;       // Remote input is known for every tick before this
+    uint32_t acked;           // Peer has our input for every tick before this
+    uint32_t rewind;          // Earliest simulated tick whose prediction was wrong
+    int disconnected;
+    uint32_t desync;          // First tick found to differ from the peer, or ROLLBACK_NO_TICK
+    rollback_check checks[ROLLBACK_CHECKS];
+    rollback_stats stats;
+    rollback_frame frames[ROLLBACK_RING];
+} rollback;
+
+int rollback_create(rollback *rb, const rollback_sim *sim, const rollback_transport *net, int local, int delay, int window);
+void rollback_free(rollback *rb);
+int rollback_tick(rollback *rb);
+rollback_input rollback_get_input(rollback *rb, int player);
+uint32_t rollback_get_tick(rollback *rb);
+rollback_frame* rollback_get_final(rollback *rb);
+
+// Session that the game simulation currently runs under, or NULL
+void rollback_set_active(rollback *rb);
+rollback* rollback_get_active();
+
+// Loopback transport pair with a fixed latency, for testing without a network.
+// Packets are delivered in order, but a percentage of them can be dropped.
+#define ROLLBACK_LOOPBACK_QUEUE 256
+
+typedef struct rollback_packet_t {
+    uint32_t deliver;
+    unsigned int len;
+    char data[ROLLBACK_PACKET_MAX];
+} rollback_packet;
+
+typedef struct rollback_loopback_queue_t {
+    rollback_packet packets[ROLLBACK_LOOPBACK_QUEUE];
+    unsigned int head;
+    unsigned int count;
+} rollback_loopback_queue;
+
+typedef struct rollback_loopback_t rollback_loopback;
+
+typedef struct rollback_loopback_end_t {
+    rollback_loopback *lb;
+    int side;
+} rollback_loopback_end;
+
+struct rollback_loopback_t {
+    uint32_t now;
+    int latency;
+    int loss;
+    uint32_t seed;
+    rollback_loopback_queue queues[2]; // Packets waiting to be received by side 0 and 1
+    rollback_loopback_end ends[2];
+};
+
+void rollback_loopback_create(rollback_loopback *lb, int latency, int loss);
+void rollback_loopback_transport(rollback_loopback *lb, int side, rollback_transport *net);
+void rollback_loopback_tick(rollback_loopback *lb);
+
+#endif // _ROLLBACK_H
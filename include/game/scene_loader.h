@@ -0,0 +1,23 @@
+#ifndef _SCENE_LOADER_H
+#define _SCENE_LOADER_H
+
+#include <SDL2/SDL.h>
+#include "resources/bk.h"
+
+// Loads and converts a BK file on a background thread.
+typedef struct scene_loader_t {
+    SDL_Thread *thread;
+    SDL_atomic_t done;
+    int scene_id;
+    int failed;
+    bk bk_data;
+} scene_loader;
+
+void scene_loader_create(scene_loader *loader);
+int scene_loader_start(scene_loader *loader, int scene_id);
+int scene_loader_is_loading(scene_loader *loader, int scene_id);
+int scene_loader_ready(scene_loader *loader);
+int scene_loader_finish(scene_loader *loader, bk *bk_data);
+void scene_loader_cancel(scene_loader *loader);
+
+#endif // _SCENE_LOADER_H
@@ -12,6 +12,13 @@ enum {
 int arena_create(scene *scene);
 int arena_get_state(scene *scene);
 void arena_set_state(scene *scene, int state);
+int arena_is_menu_visible(scene *scene); // Local UI only; the match goes on under it
 palette* arena_get_player_palette(scene *scene, int player);
 
+// Finish callbacks of the announcements
+void scene_ready_anim_done(object *parent);
+void scene_fight_anim_done(object *parent);
+void scene_youwin_anim_done(object *parent);
+void scene_youlose_anim_done(object *parent);
+
 #endif // _ARENA_H
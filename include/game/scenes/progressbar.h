@@ -15,6 +15,7 @@ struct progress_bar_t {
     unsigned int w,h,x,y;
     int orientation;
     unsigned int percentage;
+    unsigned int block_w;
     color int_topleft_color;
     color int_bottomright_color;
     color int_bg_color;
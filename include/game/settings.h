@@ -39,6 +39,8 @@ typedef struct settings_video_t {
     int fullscreen;
     int scaling;
     int instant_console;
+    int fps_limit;
+    int software;
 } settings_video;
 
 typedef struct settings_gameplay_t {
@@ -51,6 +53,12 @@ typedef struct settings_gameplay_t {
     int rounds;
 } settings_gameplay;
 
+typedef struct settings_network_t {
+    int input_delay;
+    int rollback_window;
+    int spectate_port;
+} settings_network;
+
 typedef struct settings_keyboard_t {
     // Player one
     char *key1_up;
@@ -74,6 +82,7 @@ typedef struct settings_t {
     settings_sound sound;
     settings_gameplay gameplay;
     settings_keyboard keys;
+    settings_network net;
 } settings;
 
 int settings_write_defaults(const char *path);
@@ -0,0 +1,84 @@
+#ifndef _SPECTATE_H
+#define _SPECTATE_H
+
+#include <stdint.h>
+#include "game/rollback.h"
+
+// Spectators get the match setup, a state snapshot to start from, and then the
+// confirmed input of both players for every tick. They run the match themselves,
+// so watching costs a couple of bytes per tick instead of video.
+//
+// Spectator transports must be reliable and ordered, like an ENet reliable channel.
+// Packets are a type byte followed by:
+//   SETUP:    the setup blob given by the host
+//   SNAPSHOT: tick (u32), state size (u32), offset (u32), and a chunk of the state
+//   INPUTS:   first tick (u32), tick count (u8), and two inputs per tick
+#define SPECTATE_SETUP 'M'
+#define SPECTATE_SNAPSHOT 'S'
+#define SPECTATE_INPUTS 'I'
+
+#define SPECTATE_MAX_VIEWERS 16
+#define SPECTATE_SETUP_MAX 64
+#define SPECTATE_CHUNK 1024
+#define SPECTATE_BATCH 6     // Inputs are sent once this many ticks are waiting
+#define SPECTATE_MAX_INPUTS 32
+#define SPECTATE_PACKET_MAX (13 + SPECTATE_CHUNK)
+#define SPECTATE_STATE_MAX (1024 * 1024) // Snapshots any bigger are refused
+
+// Viewers keep this many ticks of received input, and run ahead
+// up to SPECTATE_CATCHUP ticks at a time if they fall behind
+#define SPECTATE_RING 1024
+#define SPECTATE_CATCHUP 4
+
+typedef struct spectate_stats_t {
+    unsigned int packets;
+    unsigned int bytes;
+} spectate_stats;
+
+typedef struct spectate_viewer_conn_t {
+    rollback_transport net;
+    int active;
+    int joined;               // Setup and snapshot have been sent
+    uint32_t next;            // First tick the viewer does not have input for
+} spectate_viewer_conn;
+
+typedef struct spectate_host_t {
+    rollback *rb;             // Session the inputs come from
+    char setup[SPECTATE_SETUP_MAX];
+    unsigned int setup_len;
+    spectate_viewer_conn viewers[SPECTATE_MAX_VIEWERS];
+    spectate_stats stats;
+} spectate_host;
+
+void spectate_host_create(spectate_host *sh, rollback *rb, const char *setup, unsigned int setup_len);
+int spectate_host_add(spectate_host *sh, const rollback_transport *net);
+void spectate_host_remove(spectate_host *sh, int viewer);
+int spectate_host_count(spectate_host *sh);
+void spectate_host_tick(spectate_host *sh);
+
+// Called with the setup blob before the snapshot is loaded
+typedef void (*spectate_setup_cb)(void *userdata, const char *setup, unsigned int len);
+
+typedef struct spectate_viewer_t {
+    rollback_sim sim;         // Only load and advance are used
+    rollback_transport net;
+    spectate_setup_cb setup_cb;
+    char setup[SPECTATE_SETUP_MAX];
+    unsigned int setup_len;
+    char *state;              // Snapshot being received
+    unsigned int state_size;
+    unsigned int state_received;
+    int joined;               // Snapshot has been loaded
+    uint32_t snapshot_tick;
+    uint32_t tick;            // Next tick to simulate
+    uint32_t current;         // Tick being simulated right now
+    uint32_t received;        // Input is known for every tick before this
+    rollback_input inputs[SPECTATE_RING][2];
+} spectate_viewer;
+
+int spectate_viewer_create(spectate_viewer *sv, const rollback_sim *sim, const rollback_transport *net, spectate_setup_cb setup_cb);
+void spectate_viewer_free(spectate_viewer *sv);
+int spectate_viewer_tick(spectate_viewer *sv);
+rollback_input spectate_get_input(spectate_viewer *sv, int player);
+
+#endif // _SPECTATE_H
@@ -0,0 +1,35 @@
+#ifndef _SPECTATE_NET_H
+#define _SPECTATE_NET_H
+
+#include <enet/enet.h>
+#include "game/spectate.h"
+
+// Spectating over ENet. Players take viewers on a port of their own, apart from
+// the connection to the other player. Everything is sent on one reliable channel,
+// so packets arrive in order. Both ends service their ENet host themselves, so
+// the functions must be called from the thread that runs the match.
+
+// How long viewers wait for the player to answer, in ms
+#define SPECTATE_CONNECT_TIMEOUT 5000
+
+typedef struct spectate_server_t {
+    ENetHost *host;
+    ENetPeer *peers[SPECTATE_MAX_VIEWERS];
+    spectate_host sh;
+} spectate_server;
+
+int spectate_server_create(spectate_server *ss, rollback *rb, const char *setup, unsigned int setup_len, int port);
+void spectate_server_free(spectate_server *ss);
+void spectate_server_tick(spectate_server *ss); // After every tick of the session
+
+typedef struct spectate_client_t {
+    ENetHost *host;
+    ENetPeer *peer;
+    int gone;
+} spectate_client;
+
+int spectate_client_connect(spectate_client *sc, const char *addr, int port);
+void spectate_client_free(spectate_client *sc);
+void spectate_client_transport(spectate_client *sc, rollback_transport *net);
+
+#endif // _SPECTATE_NET_H
@@ -0,0 +1,58 @@
+#ifndef _STATE_REFS_H
+#define _STATE_REFS_H
+
+#include "resources/animation.h"
+#include "resources/palette.h"
+#include "game/protos/object.h"
+
+// Saved states hold no pointers. Whatever an object uses from outside of itself
+// is saved as a reference instead: the file it comes from, and its id there.
+// The files are the sources of the scene: the BK file of the scene and the AF
+// files of the HARs of both players. Each source also has the palette and the
+// sound translation table that go with it. Sources are set up from the running
+// scene, so references saved on one machine can be looked up on another.
+
+enum {
+    STATE_SOURCE_SCENE = 0,
+    STATE_SOURCE_PLAYER1,
+    STATE_SOURCE_PLAYER2,
+    STATE_SOURCES
+};
+
+#define STATE_SOURCE_NONE -1 // Nothing to refer to
+#define STATE_SOURCE_OWN -2  // Animation is owned by the object; can only be kept
+
+// Looks up an animation of the file of a source by id
+typedef animation* (*state_animation_cb)(void *file, int id);
+
+typedef struct state_source_t {
+    void *file;
+    state_animation_cb animation;
+    palette *pal;
+    char *stl;
+} state_source;
+
+typedef struct state_refs_t {
+    state_source sources[STATE_SOURCES];
+} state_refs;
+
+typedef struct object_refs_t {
+    int ani_source;
+    int ani_id;
+    int sprite; // Index in the animation, or -1
+    int pal_source;
+    int stl_source;
+} object_refs;
+
+void state_refs_create(state_refs *refs);
+void state_refs_set_source(state_refs *refs, int source, void *file, state_animation_cb animation, palette *pal, char *stl);
+
+// Finds the references of an object. Returns 1 if it uses something that
+// is not in any source.
+int state_refs_find(state_refs *refs, object *obj, object_refs *out);
+
+// Looks references up again. Owned animations are left as NULL for the caller
+// to deal with. Returns 1 if a reference is not in the sources.
+int state_refs_resolve(state_refs *refs, const object_refs *in, animation **ani, sprite **spr, palette **pal, char **stl);
+
+#endif // _STATE_REFS_H
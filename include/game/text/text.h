@@ -1,7 +1,6 @@
 #ifndef _TEXT_H
 #define _TEXT_H
 
-#include "utils/vector.h"
 #include "video/texture.h"
 #include "video/color.h"
 
@@ -13,10 +12,14 @@ enum {
 
 typedef struct font_t font;
 
+// Glyphs are packed into one atlas texture, this many per row
+#define FONT_ATLAS_COLUMNS 16
+
 struct font_t {
     int size;
     int w,h;
-    vector textures;
+    char *glyphs; // Decoded atlas waiting for upload, NULL after that
+    texture atlas;
 };
 
 // globals, yay
@@ -24,6 +27,8 @@ extern font font_small;
 extern font font_large;
 
 int fonts_init();
+int fonts_load();
+int fonts_upload();
 void fonts_close();
 void font_render_char(font *font, char ch, int x, int y, color c);
 void font_render_len(font *font, const char *text, int len, int x, int y, color c);
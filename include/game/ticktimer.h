@@ -3,9 +3,22 @@
 
 typedef void (*ticktimer_cb)(void *userdata);
 
+// Saved timers refer to their callback by id, so that they can be restored on
+// another machine. Every callback a timer in a saved state may have is
+// registered under one of these ids.
+enum {
+    TICKTIMER_FIGHT_START = 0,
+    TICKTIMER_CALLBACKS
+};
+
 void ticktimer_init();
+void ticktimer_register(int id, ticktimer_cb cb);
 void ticktimer_add(int ticks, ticktimer_cb cb, void *userdata);
 void ticktimer_run();
 void ticktimer_close();
 
-#endif // _TICKTIMER_H
\ No newline at end of file
+unsigned int ticktimer_save_size();
+int ticktimer_save(char *buf);
+int ticktimer_load(const char *buf, unsigned int size);
+
+#endif // _TICKTIMER_H
@@ -2,6 +2,7 @@
 #define _AF_H
 
 #include "resources/af_move.h"
+#include "resources/atlas.h"
 #include "utils/hashmap.h"
 
 typedef struct af_t {
@@ -12,6 +13,7 @@ typedef struct af_t {
     int jump_speed;
     int fall_speed;
     hashmap moves;
+    atlas *sprites;
     char sound_translation_table[30];
 } af;
 
@@ -0,0 +1,38 @@
+#ifndef _ATLAS_H
+#define _ATLAS_H
+
+#include "resources/animation.h"
+#include "video/texture.h"
+#include "utils/vector.h"
+
+// All sprite frames of an AF or BK file, packed into a few big indexed textures
+// when the file is loaded. Pages are uploaded the first time something from the
+// file is drawn, so frames never need to be decoded or uploaded during a fight.
+#define ATLAS_SIZE 1024
+#define ATLAS_MAX_PAGES 8
+
+typedef struct atlas_page_t {
+    texture tex;
+    char *data;         // Palette index and alpha per pixel, until uploaded
+    int x, y;           // Where the next frame goes
+    int shelf_h;        // Height of the tallest frame on the current row
+} atlas_page;
+
+typedef struct atlas_t {
+    atlas_page pages[ATLAS_MAX_PAGES];
+    int page_count;
+    int uploaded;
+    vector pending;     // Sprites waiting for atlas_pack
+} atlas;
+
+atlas* atlas_create();
+void atlas_add_animation(atlas *a, animation *ani);
+void atlas_pack(atlas *a);
+int atlas_upload(atlas *a);
+void atlas_free(atlas *a);
+
+// Returns the atlas page the sprite is in and sets pos to its corner,
+// or returns NULL if the sprite has to be drawn some other way.
+texture* atlas_get_sprite(sprite *sp, vec2i *pos);
+
+#endif // _ATLAS_H
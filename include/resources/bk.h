@@ -2,6 +2,7 @@
 #define _BK_H
 
 #include "resources/bk_info.h"
+#include "resources/atlas.h"
 #include "video/texture.h"
 #include "utils/hashmap.h"
 #include "utils/vector.h"
@@ -10,6 +11,7 @@ typedef struct bk_t {
     int file_id;
     sprite background;
     hashmap infos;
+    atlas *sprites;
     vector palettes;
     char sound_translation_table[30];
 } bk;
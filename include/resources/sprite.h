@@ -7,8 +7,12 @@
 
 typedef struct sprite_t {
     int id;
+    unsigned int uid;  // Unique for every decoded image, never reused
     vec2i pos;
     void *raw_sprite;
+    struct atlas_t *atlas; // Atlas the image is packed in, or NULL
+    int atlas_page;
+    vec2i atlas_pos;
 } sprite;
 
 void sprite_create(sprite *sp, void *src, int id);
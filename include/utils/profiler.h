@@ -0,0 +1,37 @@
+#ifndef _PROFILER_H
+#define _PROFILER_H
+
+// How many samples are kept per phase
+#define PROFILER_SAMPLES 512
+
+enum {
+    PROF_EVENTS = 0,
+    PROF_INPUT,
+    PROF_CLEANUP,
+    PROF_MOVE,
+    PROF_COLLIDE,
+    PROF_TICK,
+    PROF_RENDER,
+    PROF_FINISH,
+    PROF_AUDIO,
+    PROF_PHASE_COUNT
+};
+
+typedef struct profiler_stats_t {
+    unsigned int count;
+    float min; // All times are in milliseconds
+    float avg;
+    float max;
+    float p99;
+} profiler_stats;
+
+void profiler_init();
+void profiler_close();
+void profiler_reset();
+void profiler_begin(int phase);
+void profiler_end(int phase);
+const char* profiler_get_name(int phase);
+void profiler_get_stats(int phase, profiler_stats *stats);
+int profiler_dump(const char *filename);
+
+#endif // _PROFILER_H
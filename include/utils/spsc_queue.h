@@ -0,0 +1,22 @@
+#ifndef _SPSC_QUEUE_H
+#define _SPSC_QUEUE_H
+
+#include <SDL2/SDL.h>
+
+// Fixed size queue for passing items from one thread to another without locks.
+// Only one thread may push, and only one thread may pop.
+typedef struct spsc_queue_t {
+    char *data;
+    unsigned int item_size;
+    unsigned int capacity;  // Power of two
+    SDL_atomic_t head;      // Next item to pop; written by the consumer only
+    SDL_atomic_t tail;      // Next free slot; written by the producer only
+} spsc_queue;
+
+int spsc_queue_create(spsc_queue *q, unsigned int capacity, unsigned int item_size);
+void spsc_queue_free(spsc_queue *q);
+int spsc_queue_push(spsc_queue *q, const void *item);
+int spsc_queue_pop(spsc_queue *q, void *item);
+unsigned int spsc_queue_size(spsc_queue *q);
+
+#endif // _SPSC_QUEUE_H
@@ -0,0 +1,47 @@
+#ifndef _TASKGRAPH_H
+#define _TASKGRAPH_H
+
+// Maximum amount of tasks in a single graph; dependencies are kept in a bitmask.
+#define TASKGRAPH_MAX_TASKS 32
+
+// Maximum amount of worker threads
+#define TASKGRAPH_MAX_WORKERS 8
+
+typedef int (*task_run_cb)();
+typedef void (*task_close_cb)();
+
+enum {
+    TASK_PENDING = 0,
+    TASK_RUNNING,
+    TASK_DONE,
+    TASK_FAILED
+};
+
+typedef struct task_t {
+    const char *name;
+    task_run_cb run;
+    task_close_cb close;
+    unsigned int deps; // Bitmask of task indexes that must be done first
+    int main_thread; // Must be run on the thread that calls taskgraph_run (eg. GL uploads)
+
+    // Filled in by taskgraph_run
+    int state;
+    int thread;
+    float start; // Milliseconds since the graph was started
+    float end;
+} task;
+
+typedef struct taskgraph_t {
+    task tasks[TASKGRAPH_MAX_TASKS];
+    int count;
+    int workers;
+    float total; // Wall clock time of the whole run, in milliseconds
+} taskgraph;
+
+void taskgraph_create(taskgraph *graph);
+int taskgraph_add(taskgraph *graph, const char *name, task_run_cb run, task_close_cb close, unsigned int deps, int main_thread);
+int taskgraph_run(taskgraph *graph, int workers);
+void taskgraph_close(taskgraph *graph);
+void taskgraph_report(taskgraph *graph);
+
+#endif // _TASKGRAPH_H
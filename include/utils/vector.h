@@ -19,7 +19,8 @@ void vector_free(vector *vector);
 void* vector_get(vector *vector, unsigned int key);
 void vector_append(vector *vector, const void *value);
 void vector_prepend(vector *vector, const void *value);
-void vector_reserve(vector *vector, unsigned int blocks);
+int vector_reserve(vector *vector, unsigned int blocks);
+void vector_clear(vector *vector);
 void vector_sort(vector *vector, int (*compar)(const void*, const void*));
 unsigned int vector_size(vector *vector);
 void vector_delete(vector *vector, iterator *iterator);
@@ -0,0 +1,34 @@
+#ifndef _BATCH_H
+#define _BATCH_H
+
+#include "video/color.h"
+
+// Quads are collected in a vertex buffer, and drawn with one call for every
+// run of quads that share a texture, palette and rendering mode. Draw order is kept,
+// since alpha testing and the stencil buffer depend on it.
+#define BATCH_MAX_QUADS 1024
+
+typedef struct batch_vertex_t {
+    float x, y;
+    float u, v;
+    unsigned char r, g, b, a;
+} batch_vertex;
+
+typedef struct batch_stats_t {
+    unsigned int quads;
+    unsigned int draws;
+} batch_stats;
+
+int batch_init();
+void batch_close();
+
+// Texture 0 draws untextured quads. Palette is the palette texture for
+// indexed textures, or 0. Vertices are top right, top left, bottom left
+// and bottom right.
+void batch_add(unsigned int tex_id, unsigned int palette_id, int rendering_mode, const batch_vertex *quad);
+void batch_flush();
+
+// Counts since the last call
+void batch_get_stats(batch_stats *stats);
+
+#endif // _BATCH_H
@@ -0,0 +1,28 @@
+#ifndef _CAPTURE_H
+#define _CAPTURE_H
+
+// Screenshots and gameplay recording. Native frames are read back without
+// waiting for the GPU; with pixel buffer objects the pixels arrive a couple
+// of frames later. Encoding and writing files is done on a writer thread.
+// If the writer falls behind, recorded frames are dropped instead of
+// stalling the game. All functions are to be called from the render thread.
+
+// Recordings with a ".y4m" file name are written as YUV4MPEG2 (4:4:4);
+// anything else gets raw NATIVE_W*NATIVE_H RGBA frames.
+
+int capture_init();
+void capture_close(); // Writes out everything still pending
+
+void capture_screenshot(const char *filename); // Next frame, as TGA
+int capture_record_start(const char *filename, int ms_per_tick); // Returns 1 if not recording
+void capture_record_stop();
+int capture_is_recording();
+
+// Frame that is about to be finished covers this many ticks. Recordings
+// have one frame per tick, so the frame is written that many times.
+void capture_set_ticks(int ticks);
+
+// Called by video_render_finish() while the native frame can be read
+void capture_read();
+
+#endif // _CAPTURE_H
@@ -0,0 +1,36 @@
+#ifndef _GLSTATE_H
+#define _GLSTATE_H
+
+// Keeps track of the GL state the renderer changes most, and skips calls
+// that would set something to what it already is. Everything in src/video
+// should change these through here, or the tracked state goes stale.
+#define GLSTATE_TEXTURE_UNITS 2
+
+typedef struct glstate_stats_t {
+    unsigned int calls;   // State changes passed on to GL
+    unsigned int skipped; // State changes that did nothing, and were skipped
+} glstate_stats;
+
+// Forget everything, so that the next calls all go through. Call after
+// creating the context, or after anything else has touched the state.
+void glstate_reset();
+
+// Capability is one of GL_BLEND, GL_ALPHA_TEST, GL_STENCIL_TEST or GL_TEXTURE_2D
+void glstate_enable(unsigned int cap, int enabled);
+void glstate_blend_func(unsigned int src, unsigned int dst);
+void glstate_alpha_func(unsigned int func, float ref);
+void glstate_stencil_func(unsigned int func, int ref, unsigned int mask);
+void glstate_stencil_op(unsigned int sfail, unsigned int dpfail, unsigned int dppass);
+
+// Texture bindings of GL_TEXTURE_2D, per texture unit
+void glstate_active_texture(int unit);
+void glstate_bind_texture(unsigned int id);
+void glstate_forget_texture(unsigned int id);
+
+void glstate_color(float r, float g, float b, float a);
+void glstate_forget_color();
+
+// Counts since the last call
+void glstate_get_stats(glstate_stats *stats);
+
+#endif // _GLSTATE_H
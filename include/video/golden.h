@@ -0,0 +1,24 @@
+#ifndef _GOLDEN_H
+#define _GOLDEN_H
+
+// Golden frames for catching rendering regressions. The native frame of the
+// software renderer is compared against a reference frame stored in a
+// directory, as raw NATIVE_W*NATIVE_H RGBA pixels in "<name>.rgba".
+// When a frame differs, the new one is written next to it as "<name>.new",
+// so it can be inspected, and accepted by renaming it.
+
+typedef struct golden_stats_t {
+    unsigned int frames;   // Frames checked or written
+    unsigned int failed;   // Frames that differed from the reference, or could not be written
+    unsigned int missing;  // Frames with no reference
+} golden_stats;
+
+void golden_init(const char *dir, int write);
+
+// Checks the current frame, or writes it as the reference if write was set.
+// Returns 0 if the frame matched or was written, 1 otherwise.
+int golden_frame(const char *name);
+
+void golden_get_stats(golden_stats *s);
+
+#endif // _GOLDEN_H
@@ -23,6 +23,7 @@ void image_rect_bevel(image *img,
                       color ctop, color cright, 
                       color cbottom, color left);
 void image_filled_rect(image *img, int x, int y, int w, int h, color c);
+void image_blit(image *dst, const image *src, int x, int y);
 void image_write_tga(image *img, const char *filename);
 
 #endif // _IMAGE_H
@@ -0,0 +1,21 @@
+#ifndef _INDEXED_H
+#define _INDEXED_H
+
+// Indexed textures are drawn with a shader that looks their colors up
+// from a 256x1 palette texture. Palette textures are made from a palette
+// and an optional remap table, and cached for as long as they are in use.
+#define INDEXED_PALETTES 16
+
+int indexed_init();
+void indexed_close();
+int indexed_supported();
+
+// Colors are 256 RGB triplets, remap is 256 indexes or NULL.
+// Returns the palette texture id, or 0 if indexed drawing is not supported.
+unsigned int indexed_palette(const unsigned char *colors, const unsigned char *remap);
+
+// Used by the sprite batcher around drawing indexed quads
+void indexed_begin(unsigned int palette_id);
+void indexed_end();
+
+#endif // _INDEXED_H
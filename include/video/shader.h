@@ -13,6 +13,7 @@ enum {
 };
 
 int shader_create(shader *shader, const char *filename, int type);
+int shader_create_from_source(shader *shader, const char *source, int type);
 void shader_free(shader *shader);
 void shader_debug_log(shader *shader);
 
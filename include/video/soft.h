@@ -0,0 +1,31 @@
+#ifndef _SOFT_H
+#define _SOFT_H
+
+#include <stdint.h>
+#include "video/color.h"
+#include "video/texture.h"
+
+// Software renderer. Draws into a native resolution RGBA framebuffer on the CPU,
+// for machines without a working OpenGL. Rendering modes work like in the GL
+// renderer: BLEND_ALPHA draws every pixel that has alpha and marks it in the
+// stencil, and BLEND_ADDITIVE only adds light onto marked pixels.
+// Textures keep their pixels in memory while the software renderer is in use.
+
+int soft_init();
+void soft_close();
+void soft_clear();
+
+// Palette for drawing indexed textures; 256 RGBA colors in memory order
+void soft_make_palette(uint32_t *palette, const unsigned char *colors, const unsigned char *remap);
+
+// Draws a tw*th area of the texture starting from tx,ty, to a w*h area of the
+// framebuffer at x,y. Palette is needed for indexed textures, otherwise NULL.
+void soft_draw(const texture *tex, const uint32_t *palette, int tx, int ty, int tw, int th,
+               int x, int y, int w, int h, int flip_mode, int rendering_mode, color c);
+void soft_fill(int x, int y, int w, int h, color c);
+void soft_background(const texture *tex);
+
+// NATIVE_W*NATIVE_H pixels, four bytes each in RGBA order
+const unsigned char* soft_get_frame();
+
+#endif // _SOFT_H
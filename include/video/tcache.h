@@ -0,0 +1,61 @@
+#ifndef _TCACHE_H
+#define _TCACHE_H
+
+#include <stdint.h>
+#include "video/texture.h"
+
+// Decoded sprite textures, shared between everything that shows the same
+// sprite with the same colors. Entries are reference counted; ones nobody
+// uses any more are kept around and evicted least recently used first.
+// Only call these from the render thread.
+#define TCACHE_ENTRIES 1024
+#define TCACHE_MAX_BYTES (16 * 1024 * 1024)
+
+typedef struct tcache_key_t {
+    unsigned int sprite;  // Sprite uid
+    uint32_t palette;     // Hash of palette colors and remap, or 0 for indexed textures
+    int remap;
+    int indexed;
+} tcache_key;
+
+typedef struct tcache_entry_t {
+    tcache_key key;
+    texture tex;
+    int refs;
+    unsigned int last_used;
+    int next;             // Next entry in the same hash bucket, or -1
+} tcache_entry;
+
+// What an object holds on to. Render snapshots are copies of objects,
+// so the reference is kept behind a pointer they share. Only the render
+// side writes to it.
+typedef struct tcache_ref_t {
+    tcache_entry *entry;
+    unsigned int rev; // Texture revision of the object the entry was made for
+} tcache_ref;
+
+typedef struct tcache_stats_t {
+    unsigned int hits;
+    unsigned int misses;
+    unsigned int evictions;
+    unsigned int entries;
+    unsigned int bytes;
+} tcache_stats;
+
+// Creates the texture for a key on a cache miss. Returns 0 on success.
+typedef int (*tcache_fill)(texture *tex, void *userdata);
+
+int tcache_init();
+void tcache_close();
+
+uint32_t tcache_palette_hash(const unsigned char *colors, const unsigned char *remap);
+
+// Points ref at the texture for key, creating it if needed. Whatever ref
+// held before is released. Returns the texture, or NULL on error.
+texture* tcache_acquire(tcache_ref *ref, const tcache_key *key, tcache_fill fill, void *userdata);
+void tcache_release(tcache_ref *ref);
+
+// Hits, misses and evictions are counted since the last call
+void tcache_get_stats(tcache_stats *stats);
+
+#endif // _TCACHE_H
@@ -6,12 +6,16 @@
 typedef struct texture_t {
     unsigned int id;
     unsigned int w, h;
+    int indexed; // Palette index and alpha per pixel, instead of RGBA
+    char *pixels; // Copy of the contents, only kept for the software renderer
 } texture;
 
 void texture_create(texture *tex);
 int texture_init(texture *tex, const char *data, unsigned int w, unsigned int h);
 int texture_init_from_img(texture *tex, const image *img);
 int texture_upload(texture *tex, const char* data);
+int texture_init_indexed(texture *tex, const char *data, unsigned int w, unsigned int h);
+int texture_upload_indexed(texture *tex, const char *data);
 void texture_free(texture *tex);
 int texture_is_valid(texture *tex);
 void texture_bind(texture *tex);
@@ -17,14 +17,24 @@
 #define FLIP_VERTICAL 2
 
 int video_init(int window_w, int window_h, int fullscreen, int vsync); // Create window etc.
+int video_init_headless(); // No window or GL context, for simulation runs
+int video_is_headless();
+int video_init_software(int window_w, int window_h, int fullscreen); // Draw on the CPU; no window if window_w is 0
+int video_is_software();
 int video_reinit(int window_w, int window_h, int fullscreen, int vsync);
+void video_set_rendering_mode(int mode);
 void video_render_prepare();
 void video_render_sprite(texture *texture, int x, int y, unsigned int render_mode);
 void video_render_sprite_flip_scale(texture *texture, int x, int y, unsigned int render_mode, unsigned int flip_mode, float y_percent);
 #define video_render_sprite_flip(tex, sx, sy, render_mode, flip_mode) video_render_sprite_flip_scale(tex, sx, sy, render_mode, flip_mode, 1.0)
+void video_render_sprite_palette(texture *tex, int x, int y, int tx, int ty, int tw, int th,
+                                 unsigned int render_mode, unsigned int flip_mode, float y_percent,
+                                 const unsigned char *colors, const unsigned char *remap);
+void video_render_sprite_area(texture *tex, int x, int y, int tx, int ty, int tw, int th, unsigned int render_mode);
 void video_render_sprite_flip_alpha(texture *tex, int sx, int sy, unsigned int flip_mode, int alpha);
 void video_render_colored_quad(int x, int y, int w, int h, color c);
 void video_render_char(texture *texture, int x, int y, color c);
+void video_render_glyph(texture *texture, int x, int y, int tx, int ty, int tw, int th, color c);
 void video_render_finish();
 void video_render_background(texture *tex);
 void video_close();
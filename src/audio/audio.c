@@ -2,9 +2,10 @@
 #include "audio/audio.h"
 #include "audio/sink.h"
 #include "audio/sinks/openal_sink.h"
+#include "audio/sinks/null_sink.h"
 #include "utils/log.h"
 
-#define SINK_COUNT 1
+#define SINK_COUNT 2
 
 audio_sink *_global_sink = NULL;
 
@@ -13,6 +14,7 @@ struct sink_info_t {
     const char* name;
 } sinks[] = {
     {openal_sink_init, "openal"},
+    {null_sink_init, "null"},
 };
 
 int audio_get_sink_count() {
@@ -0,0 +1,31 @@
+#include <stdlib.h>
+#include "audio/sinks/null_sink.h"
+#include "audio/stream.h"
+#include "audio/source.h"
+#include "utils/log.h"
+
+// A sink that never outputs anything. Used when running without an audio device,
+// eg. in headless simulation runs. Streams still go through the normal sink
+// bookkeeping, but one-shot sounds finish immediately on the next render.
+
+void null_stream_play(audio_stream *stream) {
+    // Nothing to do here
+}
+
+void null_stream_update(audio_stream *stream) {
+    // Looping streams (music) stay alive until stopped
+    if(!source_get_loop(stream->src)) {
+        stream_set_finished(stream);
+    }
+}
+
+void null_sink_format_stream(audio_sink *sink, audio_stream *stream) {
+    stream_set_play_cb(stream, null_stream_play);
+    stream_set_update_cb(stream, null_stream_update);
+}
+
+int null_sink_init(audio_sink *sink) {
+    sink_set_format_stream_cb(sink, null_sink_format_stream);
+    INFO("Null Audio Sink initialized.");
+    return 0;
+}
@@ -7,8 +7,13 @@
 #include "resources/sounds_loader.h"
 
 float sound_volume = VOLUME_DEFAULT;
+static int sound_muted = 0;
 
 void sound_play(int id, float volume, float panning, float pitch) {
+    if(sound_muted) {
+        return;
+    }
+
     // Get sample data
     char *buf;
     int len;
@@ -27,4 +32,9 @@ void sound_play(int id, float volume, float panning, float pitch) {
 
 void sound_set_volume(float volume) {
     sound_volume = volume;
+}
+
+// While muted, sound_play does nothing. Used when ticks are simulated again.
+void sound_mute(int muted) {
+    sound_muted = muted;
 }
\ No newline at end of file
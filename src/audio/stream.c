@@ -8,6 +8,7 @@ void stream_nullify(audio_stream *stream) {
     stream->play = NULL;
     stream->stop = NULL;
     stream->update = NULL;
+    stream->apply = NULL;
     stream->userdata = NULL;
     stream->src = NULL;
     stream->sink = NULL;
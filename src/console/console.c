@@ -16,6 +16,7 @@
 #include "utils/log.h"
 #include "utils/list.h"
 #include "utils/hashmap.h"
+#include "utils/profiler.h"
 #include "video/video.h"
 
 #define HISTORY_MAX 100
@@ -206,6 +207,27 @@ int console_cmd_stun(scene *scene, void *userdata, int argc, char **argv) {
     return 1;
 }
 
+int console_cmd_prof(scene *scene, void *userdata, int argc, char **argv) {
+    if(argc == 1) {
+        char buf[64];
+        profiler_stats stats;
+        console_output_addline("phase    min   avg   p99 (ms)");
+        for(int i = 0; i < PROF_PHASE_COUNT; i++) {
+            profiler_get_stats(i, &stats);
+            sprintf(buf, "%-7s %5.2f %5.2f %5.2f", 
+                profiler_get_name(i), stats.min, stats.avg, stats.p99);
+            console_output_addline(buf);
+        }
+        return 0;
+    } else if(argc == 2 && strcmp(argv[1], "reset") == 0) {
+        profiler_reset();
+        return 0;
+    } else if(argc == 3 && strcmp(argv[1], "dump") == 0) {
+        return profiler_dump(argv[2]);
+    }
+    return 1;
+}
+
 #ifdef DEBUGMODE
 int console_cd_debug(scene *scene, void *userdata, int argc, char **argv) {
     for(int i = 0; i < 2; i++) {
@@ -552,6 +574,7 @@ int console_init() {
     console_add_cmd("win",   &console_cmd_win,   "Set the other player's health to 0");
     console_add_cmd("lose",   &console_cmd_lose,   "Set your health to 0");
     console_add_cmd("stun",   &console_cmd_stun,   "Stun the other player");
+    console_add_cmd("prof",   &console_cmd_prof,   "frame timings. usage: prof, prof reset, prof dump <file>");
 #ifdef DEBUGMODE
     console_add_cmd("cd-debug", &console_cd_debug, "toggle collision detection debugging");
 #endif
@@ -56,7 +56,9 @@ void controller_cmd(controller* ctrl, int action, ctrl_event **ev) {
         (*ev)->next = NULL;
     } else {
         i = *ev;
-        while (i->next) {}
+        while (i->next) {
+            i = i->next;
+        }
         i->next = malloc(sizeof(ctrl_event));
         i->next->action = action;
         i->next->next = NULL;
@@ -171,3 +171,23 @@ void joystick_create(controller *ctrl, int joystick_id) {
 
     /*controller_add_hook(ctrl, &hook);*/
 }
+
+// Logs information about all attached joysticks
+void joystick_probe() {
+    INFO("Found %d joysticks attached", SDL_NumJoysticks());
+    SDL_Joystick *joy;
+    for(int i = 0; i < SDL_NumJoysticks(); i++) {
+        joy = SDL_JoystickOpen(i);
+        if(joy) {
+            INFO("Opened Joystick %d", i);
+            INFO(" * Name:              %s", SDL_JoystickNameForIndex(i));
+            INFO(" * Number of Axes:    %d", SDL_JoystickNumAxes(joy));
+            INFO(" * Number of Buttons: %d", SDL_JoystickNumButtons(joy));
+            INFO(" * Number of Balls:   %d", SDL_JoystickNumBalls(joy));
+            INFO(" * Number of Hats:    %d", SDL_JoystickNumHats(joy));
+            SDL_JoystickClose(joy);
+        } else {
+            INFO("Joystick %d is unsupported", i);
+        }
+    }
+}
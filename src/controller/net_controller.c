@@ -1,18 +1,160 @@
 #include "controller/net_controller.h"
+#include "controller/rollback_controller.h"
 #include "utils/log.h"
+#include "utils/spsc_queue.h"
 #include <stdio.h>
+#include <string.h>
 
+// Reliable channel for HAR commands, and unreliable channel for input
+#define CHANNEL_RELIABLE 0
+#define CHANNEL_INPUT 1
+
+// Packets waiting to be handled by the game, or sent by the network thread
+#define NET_QUEUE_SIZE 256
+#define NET_PACKET_MAX 256
+
+// How long the network thread waits for packets at a time, in ms
+#define NET_SERVICE_TIMEOUT 1
+
+// Stats samples waiting to be shown
+#define NET_STATS_QUEUE_SIZE 4
+
+typedef struct net_packet_t {
+    unsigned int time;  // When the packet arrived, or was queued for sending
+    int channel;
+    int flags;
+    unsigned int len;
+    char data[NET_PACKET_MAX];
+} net_packet;
+
+// Once the controller is created, the host belongs to the network thread.
+// Everything else is only touched by the game.
 typedef struct wtf_t {
     ENetHost *host;
     ENetPeer *peer;
     int last;
     int disconnected;
+    SDL_Thread *thread;
+    SDL_atomic_t quit;
+    SDL_atomic_t gone;      // Set by the network thread when the peer disconnects
+    spsc_queue incoming;
+    spsc_queue outgoing;
+    spsc_queue samples;     // Network thread to overlay
+    SDL_atomic_t input_delay;
+    net_stats stats;        // Newest sample the overlay has seen
+    unsigned int last_arrival;
+    uint32_t tick;          // Tick of the next local input to send
+    uint32_t acked;         // Peer has our input for every tick before this
+    uint32_t received;      // We have peer input for every tick before this
+    rollback_input held;    // Buttons the local player is holding this tick
+    rollback_input sent[ROLLBACK_MAX_INPUTS]; // Local inputs the peer may not have yet
 } wtf;
 
+static void net_controller_queue_event(wtf *data, ENetEvent *event) {
+    net_packet p;
+    switch(event->type) {
+        case ENET_EVENT_TYPE_RECEIVE:
+            if(event->packet->dataLength <= NET_PACKET_MAX) {
+                p.time = SDL_GetTicks();
+                p.channel = event->channelID;
+                p.flags = 0;
+                p.len = event->packet->dataLength;
+                memcpy(p.data, event->packet->data, p.len);
+                if(spsc_queue_push(&data->incoming, &p)) {
+                    DEBUG("incoming queue is full, dropping packet");
+                }
+            } else {
+                DEBUG("dropping packet of %u bytes", (unsigned int)event->packet->dataLength);
+            }
+            enet_packet_destroy(event->packet);
+            break;
+        case ENET_EVENT_TYPE_DISCONNECT:
+            SDL_AtomicSet(&data->gone, 1);
+            break;
+        default:
+            break;
+    }
+}
+
+// Reads the peer stats ENet keeps, and logs them as one line of the time series.
+// Only the network thread may touch the host, so this is done there.
+static void net_controller_sample(wtf *data, net_stats *last, uint32_t *sent, uint32_t *received) {
+    net_stats s;
+    unsigned int now = SDL_GetTicks();
+    unsigned int elapsed = now - last->time;
+    if(elapsed < NET_STATS_INTERVAL) {
+        return;
+    }
+    s.time = now;
+    s.rtt = data->peer->roundTripTime;
+    s.jitter = data->peer->roundTripTimeVariance;
+    s.loss = data->peer->packetLoss * 100.0f / ENET_PEER_PACKET_LOSS_SCALE;
+    s.bytes_in = (data->host->totalReceivedData - *received) * 1000 / elapsed;
+    s.bytes_out = (data->host->totalSentData - *sent) * 1000 / elapsed;
+    s.input_delay = SDL_AtomicGet(&data->input_delay);
+    *received = data->host->totalReceivedData;
+    *sent = data->host->totalSentData;
+    *last = s;
+
+    INFO("Net: time %u rtt %u jitter %u loss %.1f in %u out %u delay %d",
+        s.time, s.rtt, s.jitter, s.loss, s.bytes_in, s.bytes_out, s.input_delay);
+    spsc_queue_push(&data->samples, &s); // Overlay not reading is fine
+}
+
+// Services the host all the time, so packets are picked up as soon as they
+// arrive instead of once per tick.
+static int net_controller_run(void *userdata) {
+    wtf *data = userdata;
+    ENetEvent event;
+    net_packet p;
+    net_stats last;
+    uint32_t sent = data->host->totalSentData;
+    uint32_t received = data->host->totalReceivedData;
+    memset(&last, 0, sizeof(net_stats));
+    last.time = SDL_GetTicks();
+    while(!SDL_AtomicGet(&data->quit)) {
+        while(spsc_queue_pop(&data->outgoing, &p) == 0) {
+            ENetPacket *packet = enet_packet_create(p.data, p.len, p.flags);
+            enet_peer_send(data->peer, p.channel, packet);
+        }
+
+        // Wait a moment for packets. This also sends the ones queued above.
+        int ret = enet_host_service(data->host, &event, NET_SERVICE_TIMEOUT);
+        while(ret > 0) {
+            net_controller_queue_event(data, &event);
+            ret = enet_host_check_events(data->host, &event);
+        }
+        if(data->peer != NULL) {
+            net_controller_sample(data, &last, &sent, &received);
+        }
+    }
+    return 0;
+}
+
+// Queues a packet for the network thread. Returns 1 if it does not fit.
+static int net_controller_queue_send(wtf *data, int channel, int flags, const char *buf, unsigned int len) {
+    net_packet p;
+    if(len > NET_PACKET_MAX || data->peer == NULL) {
+        return 1;
+    }
+    p.time = SDL_GetTicks();
+    p.channel = channel;
+    p.flags = flags;
+    p.len = len;
+    memcpy(p.data, buf, len);
+    return spsc_queue_push(&data->outgoing, &p);
+}
+
 void net_controller_free(controller *ctrl) {
     wtf *data = ctrl->data;
     ENetEvent event;
-    if (!data->disconnected) {
+
+    // Host is ours again once the thread is done
+    if(data->thread != NULL) {
+        SDL_AtomicSet(&data->quit, 1);
+        SDL_WaitThread(data->thread, NULL);
+    }
+    if (!data->disconnected && !SDL_AtomicGet(&data->gone)) {
         DEBUG("closing connection");
         enet_peer_disconnect(data->peer, 0);
 
@@ -31,37 +173,88 @@ void net_controller_free(controller *ctrl) {
         }
     }
     enet_host_destroy(data->host);
+    spsc_queue_free(&data->incoming);
+    spsc_queue_free(&data->outgoing);
+    spsc_queue_free(&data->samples);
     free(data);
 }
 
+// Applies the peer input of every tick we had not seen yet
+static void net_controller_handle_input(controller *ctrl, const char *buf, int len, ctrl_event **ev) {
+    wtf *data = ctrl->data;
+    rollback_input inputs[ROLLBACK_MAX_INPUTS];
+    rollback_packet_info info;
+    int count = rollback_packet_read(buf, len, &info, inputs);
+    if(count < 0) {
+        DEBUG("ignoring broken input packet");
+        return;
+    }
+    if(info.ack > data->acked && info.ack <= data->tick) {
+        data->acked = info.ack;
+    }
+    if(info.first > data->received) {
+        // Peer gave up on resending these; they are lost
+        DEBUG("lost peer input for ticks %u-%u", data->received, info.first - 1);
+        data->received = info.first;
+    }
+    for(int i = data->received - info.first; i < count; i++) {
+        rollback_controller_cmd(ctrl, inputs[i], ev);
+        data->received++;
+    }
+}
+
+// Sends the local input of this tick, along with everything the peer has not acked yet
+static void net_controller_send_input(wtf *data) {
+    char buf[ROLLBACK_PACKET_MAX];
+    rollback_input inputs[ROLLBACK_MAX_INPUTS];
+    rollback_packet_info info;
+    int count = 0;
+
+    data->sent[data->tick % ROLLBACK_MAX_INPUTS] = data->held;
+    data->held = 0;
+    data->tick++;
+
+    // If the peer has fallen too far behind, the oldest inputs are gone for good
+    if(data->tick - data->acked > ROLLBACK_MAX_INPUTS) {
+        data->acked = data->tick - ROLLBACK_MAX_INPUTS;
+    }
+    for(uint32_t t = data->acked; t < data->tick; t++) {
+        inputs[count++] = data->sent[t % ROLLBACK_MAX_INPUTS];
+    }
+    // Both sides simulate on their own here, so there is no state to compare
+    info.ack = data->received;
+    info.first = data->acked;
+    info.check_tick = ROLLBACK_NO_TICK;
+    info.checksum = 0;
+    int len = rollback_packet_write(buf, &info, inputs, count);
+    if(net_controller_queue_send(data, CHANNEL_INPUT, ENET_PACKET_FLAG_UNSEQUENCED, buf, len)) {
+        DEBUG("unable to queue input packet");
+    }
+}
+
 int net_controller_tick(controller *ctrl, ctrl_event **ev) {
-    ENetEvent event;
     wtf *data = ctrl->data;
-    ENetHost *host = data->host;
-    if (enet_host_service(host, &event, 0) > 0) {
-        switch (event.type) {
-            case ENET_EVENT_TYPE_RECEIVE:
-                DEBUG("got packet %s", event.packet->data);
-                if (event.packet->data[0] == 'k') {
-                    // dispatch keypress to scene
-                    int action = atoi((char*)event.packet->data+1);
-                    DEBUG("sending action %d to controller", action);
-                    controller_cmd(ctrl, action, ev);
-                } else {
-                    // dispatch it to the HAR
-                    /*har_parse_command(ctrl->har, (char*)event.packet->data);*/
-                }
-                enet_packet_destroy(event.packet);
-                break;
-            case ENET_EVENT_TYPE_DISCONNECT:
-                DEBUG("peer disconnected!");
-                data->disconnected = 1;
-                return 1; // bail the fuck out
-                break;
-            default:
-                break;
+    net_packet p;
+
+    // Input hooks have fired by now, so this tick's local input is complete
+    net_controller_send_input(data);
+
+    // Handle everything that has arrived since the last tick
+    while(spsc_queue_pop(&data->incoming, &p) == 0) {
+        data->last_arrival = p.time;
+        if(p.channel == CHANNEL_INPUT) {
+            net_controller_handle_input(ctrl, p.data, p.len, ev);
+            SDL_AtomicSet(&data->input_delay, data->tick - data->received);
+        } else {
+            // dispatch it to the HAR
+            /*har_parse_command(ctrl->har, p.data);*/
         }
     }
+    if(SDL_AtomicGet(&data->gone)) {
+        DEBUG("peer disconnected!");
+        data->disconnected = 1;
+        return 1; // bail the fuck out
+    }
     return 0;
 }
 
@@ -72,39 +265,61 @@ int net_controller_handle(controller *ctrl, SDL_Event *event, ctrl_event **ev) {
 void har_hook(char* buf, void *userdata) {
     controller *ctrl = userdata;
     wtf *data = ctrl->data;
-    ENetPeer *peer = data->peer;
-    ENetHost *host = data->host;
     data->disconnected = 0;
-    ENetPacket * packet;
 
-    packet = enet_packet_create(buf, strlen (buf) + 1, ENET_PACKET_FLAG_RELIABLE);
-    if (peer) {
-        enet_peer_send(peer, 0, packet);
-        enet_host_flush (host);
-    } else {
-        DEBUG("peer is null~");
+    if(net_controller_queue_send(data, CHANNEL_RELIABLE, ENET_PACKET_FLAG_RELIABLE, buf, strlen(buf) + 1)) {
+        DEBUG("unable to queue HAR command");
     }
 }
 
 void controller_hook(controller *ctrl, int action) {
-    char buf[10];
     wtf *data = ctrl->data;
-    ENetPeer *peer = data->peer;
-    ENetHost *host = data->host;
-    ENetPacket *packet;
-    if (action == ACT_STOP) {
-        // not interested
-        return;
+    // Collected here, and sent once per tick
+    data->held |= rollback_controller_buttons(action);
+}
+
+// Rollback session transport over the controller's connection
+static int net_controller_send(void *userdata, const char *buf, unsigned int len) {
+    wtf *data = userdata;
+    if(data->disconnected) {
+        return 1;
+    }
+    // Sessions resend their input until it is acked, so nothing needs to be reliable
+    return net_controller_queue_send(data, CHANNEL_INPUT, ENET_PACKET_FLAG_UNSEQUENCED, buf, len);
+}
+
+static int net_controller_recv(void *userdata, char *buf, unsigned int size) {
+    wtf *data = userdata;
+    net_packet p;
+    while(spsc_queue_pop(&data->incoming, &p) == 0) {
+        data->last_arrival = p.time;
+        if(p.channel == CHANNEL_INPUT && p.len <= size) {
+            memcpy(buf, p.data, p.len);
+            return p.len;
+        }
+    }
+    if(SDL_AtomicGet(&data->gone)) {
+        data->disconnected = 1;
+        return -1;
     }
-    DEBUG("controller hook fired with %d", action);
-    sprintf(buf, "k%d", action);
-    packet = enet_packet_create(buf, strlen (buf) + 1, ENET_PACKET_FLAG_RELIABLE);
-    if (peer) {
-        enet_peer_send(peer, 0, packet);
-        enet_host_flush (host);
-    } else {
-        DEBUG("peer is null~");
+    return 0;
+}
+
+void net_controller_get_transport(controller *ctrl, rollback_transport *net) {
+    net->userdata = ctrl->data;
+    net->send = &net_controller_send;
+    net->recv = &net_controller_recv;
+}
+
+// Returns the newest stats sample, or 1 if there has not been one yet
+int net_controller_get_stats(controller *ctrl, net_stats *stats) {
+    wtf *data = ctrl->data;
+    net_stats s;
+    while(spsc_queue_pop(&data->samples, &s) == 0) {
+        data->stats = s;
     }
+    *stats = data->stats;
+    return data->stats.time == 0;
 }
 
 void net_controller_create(controller *ctrl, ENetHost *host, ENetPeer *peer) {
@@ -112,6 +327,24 @@ void net_controller_create(controller *ctrl, ENetHost *host, ENetPeer *peer) {
     data->host = host;
     data->peer = peer;
     data->last = -1;
+    data->disconnected = 0;
+    data->tick = 0;
+    data->acked = 0;
+    data->received = 0;
+    data->held = 0;
+    data->last_arrival = 0;
+    memset(&data->stats, 0, sizeof(net_stats));
+    SDL_AtomicSet(&data->input_delay, 0);
+    SDL_AtomicSet(&data->quit, 0);
+    SDL_AtomicSet(&data->gone, 0);
+    spsc_queue_create(&data->incoming, NET_QUEUE_SIZE, sizeof(net_packet));
+    spsc_queue_create(&data->outgoing, NET_QUEUE_SIZE, sizeof(net_packet));
+    spsc_queue_create(&data->samples, NET_STATS_QUEUE_SIZE, sizeof(net_stats));
+    data->thread = SDL_CreateThread(net_controller_run, "network", data);
+    if(data->thread == NULL) {
+        PERROR("Could not create network thread: %s", SDL_GetError());
+        data->disconnected = 1;
+    }
     ctrl->data = data;
     ctrl->type = CTRL_TYPE_NETWORK;
     ctrl->tick_fun = &net_controller_tick;
@@ -0,0 +1,36 @@
+#include "controller/random_controller.h"
+#include "utils/log.h"
+#include <stdlib.h>
+
+// Maximum amount of ticks an action is held down
+#define RANDOM_HOLD_MAX 20
+
+void random_controller_free(controller *ctrl) {
+    random_controller *r = ctrl->data;
+    free(r);
+}
+
+int random_controller_tick(controller *ctrl, ctrl_event **ev) {
+    random_controller *r = ctrl->data;
+
+    // Pick a new action every now and then, and keep it held down
+    // for a while; much like a (very bad) human player would.
+    // Uses its own generator so that the game rng sequence stays intact.
+    if(r->hold <= 0) {
+        r->action = random_int(&r->rand, ACT_STOP + 1);
+        r->hold = 1 + random_int(&r->rand, RANDOM_HOLD_MAX);
+    }
+    r->hold--;
+    controller_cmd(ctrl, r->action, ev);
+    return 0;
+}
+
+void random_controller_create(controller *ctrl, uint32_t seed) {
+    random_controller *r = malloc(sizeof(random_controller));
+    random_seed(&r->rand, seed);
+    r->action = ACT_STOP;
+    r->hold = 0;
+    ctrl->data = r;
+    ctrl->type = CTRL_TYPE_RANDOM;
+    ctrl->tick_fun = &random_controller_tick;
+}
@@ -0,0 +1,44 @@
+#include "controller/replay_controller.h"
+#include "utils/log.h"
+#include <stdlib.h>
+
+void replay_controller_free(controller *ctrl) {
+    replay_controller *r = ctrl->data;
+    free(r);
+}
+
+int replay_controller_tick(controller *ctrl, ctrl_event **ev) {
+    replay_controller *r = ctrl->data;
+    replay_event *e;
+
+    // Events are in tick order, so just keep walking forwards
+    while((e = vector_get(&r->rep->events, r->pos)) != NULL && e->tick <= r->tick) {
+        if(e->tick == r->tick && e->player == r->player) {
+            controller_cmd(ctrl, e->action, ev);
+        }
+        r->pos++;
+    }
+    r->tick++;
+    return 0;
+}
+
+int replay_controller_finished(controller *ctrl) {
+    replay_controller *r = ctrl->data;
+    return r->tick >= r->rep->ticks;
+}
+
+uint32_t replay_controller_get_seed(controller *ctrl) {
+    replay_controller *r = ctrl->data;
+    return r->rep->seed;
+}
+
+void replay_controller_create(controller *ctrl, replay *rep, int player) {
+    replay_controller *r = malloc(sizeof(replay_controller));
+    r->rep = rep;
+    r->player = player;
+    r->tick = 0;
+    r->pos = 0;
+    ctrl->data = r;
+    ctrl->type = CTRL_TYPE_REPLAY;
+    ctrl->tick_fun = &replay_controller_tick;
+}
@@ -0,0 +1,87 @@
+#include "controller/rollback_controller.h"
+#include "utils/log.h"
+#include <stdlib.h>
+
+void rollback_controller_free(controller *ctrl) {
+    rollback_controller *r = ctrl->data;
+    free(r);
+}
+
+// Buttons that need to be held for an action
+rollback_input rollback_controller_buttons(int action) {
+    switch(action) {
+        case ACT_KICK:      return ROLLBACK_KICK;
+        case ACT_PUNCH:     return ROLLBACK_PUNCH;
+        case ACT_UP:        return ROLLBACK_UP;
+        case ACT_UPLEFT:    return ROLLBACK_UP|ROLLBACK_LEFT;
+        case ACT_UPRIGHT:   return ROLLBACK_UP|ROLLBACK_RIGHT;
+        case ACT_DOWN:      return ROLLBACK_DOWN;
+        case ACT_DOWNLEFT:  return ROLLBACK_DOWN|ROLLBACK_LEFT;
+        case ACT_DOWNRIGHT: return ROLLBACK_DOWN|ROLLBACK_RIGHT;
+        case ACT_LEFT:      return ROLLBACK_LEFT;
+        case ACT_RIGHT:     return ROLLBACK_RIGHT;
+    }
+    return 0;
+}
+
+// Packs the actions of one controller tick into held buttons
+rollback_input rollback_controller_pack(ctrl_event *ev) {
+    rollback_input input = 0;
+    for(ctrl_event *i = ev; i != NULL; i = i->next) {
+        input |= rollback_controller_buttons(i->action);
+    }
+    return input;
+}
+
+// Turns held buttons back into actions, in the same order the keyboard sends them
+void rollback_controller_cmd(controller *ctrl, rollback_input input, ctrl_event **ev) {
+    int up = input & ROLLBACK_UP;
+    int down = input & ROLLBACK_DOWN;
+    int left = input & ROLLBACK_LEFT;
+    int right = input & ROLLBACK_RIGHT;
+
+    if(left && up) {
+        controller_cmd(ctrl, ACT_UPLEFT, ev);
+    } else if(left && down) {
+        controller_cmd(ctrl, ACT_DOWNLEFT, ev);
+    } else if(right && up) {
+        controller_cmd(ctrl, ACT_UPRIGHT, ev);
+    } else if(right && down) {
+        controller_cmd(ctrl, ACT_DOWNRIGHT, ev);
+    } else if(right) {
+        controller_cmd(ctrl, ACT_RIGHT, ev);
+    } else if(left) {
+        controller_cmd(ctrl, ACT_LEFT, ev);
+    } else if(up) {
+        controller_cmd(ctrl, ACT_UP, ev);
+    } else if(down) {
+        controller_cmd(ctrl, ACT_DOWN, ev);
+    }
+
+    if(input & ROLLBACK_PUNCH) {
+        controller_cmd(ctrl, ACT_PUNCH, ev);
+    }
+    if(input & ROLLBACK_KICK) {
+        controller_cmd(ctrl, ACT_KICK, ev);
+    }
+    if(input == 0) {
+        controller_cmd(ctrl, ACT_STOP, ev);
+    }
+}
+
+// Feeds the input the rollback session has for the tick being simulated;
+// this is either a confirmed input or a prediction.
+int rollback_controller_tick(controller *ctrl, ctrl_event **ev) {
+    rollback_controller *r = ctrl->data;
+    rollback_controller_cmd(ctrl, rollback_get_input(r->rb, r->player), ev);
+    return 0;
+}
+
+void rollback_controller_create(controller *ctrl, rollback *rb, int player) {
+    rollback_controller *r = malloc(sizeof(rollback_controller));
+    r->rb = rb;
+    r->player = player;
+    ctrl->data = r;
+    ctrl->type = CTRL_TYPE_ROLLBACK;
+    ctrl->tick_fun = &rollback_controller_tick;
+}
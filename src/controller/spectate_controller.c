@@ -0,0 +1,24 @@
+#include "controller/spectate_controller.h"
+#include "controller/rollback_controller.h"
+#include <stdlib.h>
+
+void spectate_controller_free(controller *ctrl) {
+    spectate_controller *s = ctrl->data;
+    free(s);
+}
+
+// Feeds the input the host confirmed for the tick being watched
+int spectate_controller_tick(controller *ctrl, ctrl_event **ev) {
+    spectate_controller *s = ctrl->data;
+    rollback_controller_cmd(ctrl, spectate_get_input(s->sv, s->player), ev);
+    return 0;
+}
+
+void spectate_controller_create(controller *ctrl, spectate_viewer *sv, int player) {
+    spectate_controller *s = malloc(sizeof(spectate_controller));
+    s->sv = sv;
+    s->player = player;
+    ctrl->data = s;
+    ctrl->type = CTRL_TYPE_SPECTATE;
+    ctrl->tick_fun = &spectate_controller_tick;
+}
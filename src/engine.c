@@ -1,4 +1,5 @@
 #include <SDL2/SDL.h>
+#include <string.h>
 #include "engine.h"
 #include "utils/log.h"
 #include "utils/config.h"
@@ -7,76 +8,414 @@
 #include "resources/sounds_loader.h"
 #include "video/texture.h"
 #include "video/video.h"
+#include "video/batch.h"
+#include "video/tcache.h"
+#include "video/glstate.h"
+#include "video/golden.h"
+#include "video/capture.h"
 #include "game/text/languages.h"
 #include "game/game_state.h"
 #include "game/settings.h"
 #include "game/ticktimer.h"
 #include "game/text/text.h"
 #include "console/console.h"
+#include "controller/random_controller.h"
+#include "controller/replay_controller.h"
+#include "controller/rollback_controller.h"
+#include "game/replay.h"
+#include "game/rollback.h"
+#include "game/netplay.h"
+#include "resources/ids.h"
+#include "utils/random.h"
+#include "utils/profiler.h"
+#include "utils/taskgraph.h"
+#include "controller/joystick.h"
+
+// Maximum amount of ticks to run per frame when catching up.
+// If we fall behind more than this, the rest is dropped.
+#define MAX_TICKS_PER_FRAME 5
 
 int _vsync = 0; // Needed in video.c
 static int run = 0;
-static int take_screenshot = 0;
 
-int engine_init() {
-    settings *setting = settings_get();
-    
-    int w = setting->video.screen_w;
-    int h = setting->video.screen_h;
-    int fs = setting->video.fullscreen;
-    int vsync = setting->video.vsync;
+// Simulation thread. Runs a batch of ticks and takes a render snapshot, while
+// the main thread draws the previous snapshot.
+typedef struct sim_thread_t {
+    SDL_Thread *thread;
+    SDL_sem *start;
+    SDL_sem *done;
+    int ticks;
+    int quit;
+} sim_thread;
+
+static sim_thread sim;
+
+// Replay being played back, if any
+static replay playback;
+
+// Headless rollback match against a loopback peer, for testing the sessions that
+// network matches run under. Session 0 runs the game, and session 1 is the peer,
+// which only sends its controller input.
+typedef struct loopback_match_t {
+    rollback_loopback net;
+    rollback sessions[2];
+    controller inputs[2];
+} loopback_match;
+
+static loopback_match loopback;
+
+// The peer has no game to run, so there is no state to save either
+static unsigned int loopback_peer_save_size(void *userdata) { return 0; }
+static int loopback_peer_save(void *userdata, char *buf, unsigned int size) { return 0; }
+static int loopback_peer_load(void *userdata, const char *buf, unsigned int size) { return 0; }
+static void loopback_peer_advance(void *userdata, int resimulating) {}
 
-    // Right now we only have one audio sink, so select that one.
-    int sink_id = 0;
+// Startup tasks take no arguments, so the init flags are kept here
+static engine_init_flags *startup_flags = NULL;
 
-    // Initialize everything.
-    _vsync = vsync;
-    if(video_init(w, h, fs, vsync)) {
-        goto exit_0;
+static int engine_init_video() {
+    settings *setting = settings_get();
+    if(startup_flags->golden_dir != NULL) {
+        _vsync = 0;
+        return video_init_software(0, 0, 0);
     }
-    if(audio_init(sink_id)) {
-        goto exit_1;
+    if(startup_flags->headless) {
+        _vsync = 0;
+        return video_init_headless();
     }
-    if(sounds_loader_init()) {
-        goto exit_2;
+    _vsync = setting->video.vsync;
+    if(!setting->video.software && video_init(setting->video.screen_w,
+                                              setting->video.screen_h,
+                                              setting->video.fullscreen,
+                                              setting->video.vsync) == 0) {
+        return 0;
     }
-    if(lang_init()) {
-        goto exit_3;
+
+    // No OpenGL, or it was asked not to be used
+    if(!setting->video.software) {
+        INFO("OpenGL could not be initialized, falling back to software rendering.");
     }
-    if(fonts_init()) {
-        goto exit_4;
+    _vsync = 0;
+    return video_init_software(setting->video.screen_w,
+                               setting->video.screen_h,
+                               setting->video.fullscreen);
+}
+
+static int engine_init_audio() {
+    // Sink 0 is OpenAL, sink 1 is the null sink for headless runs
+    return audio_init(startup_flags->headless ? 1 : 0);
+}
+
+static int engine_init_joysticks() {
+    if(!startup_flags->headless) {
+        joystick_probe();
     }
-    if(altpals_init()) {
-        goto exit_5;
+    return 0;
+}
+
+int engine_init(engine_init_flags *init_flags) {
+    taskgraph graph;
+    startup_flags = init_flags;
+
+    // Only tasks that touch GL need to be run on the main thread;
+    // file loading and decoding is done by the workers.
+    taskgraph_create(&graph);
+    int video = taskgraph_add(&graph, "video", engine_init_video, video_close, 0, 1);
+    taskgraph_add(&graph, "audio", engine_init_audio, audio_close, 0, 0);
+    taskgraph_add(&graph, "sounds", sounds_loader_init, sounds_loader_close, 0, 0);
+    taskgraph_add(&graph, "languages", lang_init, lang_close, 0, 0);
+    int fonts = taskgraph_add(&graph, "fonts", fonts_load, fonts_close, 0, 0);
+    int upload = taskgraph_add(&graph, "font upload", fonts_upload, NULL, (1u << video)|(1u << fonts), 1);
+    taskgraph_add(&graph, "altpals", altpals_init, altpals_close, 0, 0);
+    taskgraph_add(&graph, "console", console_init, console_close, (1u << video)|(1u << upload), 1);
+    taskgraph_add(&graph, "joysticks", engine_init_joysticks, NULL, 0, 1);
+
+    // Leave one core for the main thread
+    int workers = SDL_GetCPUCount() - 1;
+    if(workers < 1) {
+        workers = 1;
     }
-    if(console_init()) {
-        goto exit_6;
+
+    // Initialize everything. If something failed, close whatever did succeed.
+    int failed = taskgraph_run(&graph, workers);
+    taskgraph_report(&graph);
+    if(failed) {
+        taskgraph_close(&graph);
+        return 1;
     }
     ticktimer_init();
+    profiler_init();
     
     // Return successfully
     run = 1;
     INFO("Engine initialization successful.");
     return 0;
+}
 
-    // If something failed, close in correct order
-exit_6:
-    altpals_close();
-exit_5:
-    fonts_close();
-exit_4:
-    lang_close();
-exit_3:
-    sounds_loader_close();
-exit_2:
-    audio_close();
-exit_1:
-    video_close();
-exit_0:
-    return 1;
+// Simulates one tick, through the rollback session if one is running
+static void engine_sim_tick() {
+    rollback *rb = rollback_get_active();
+    if(netplay_is_watching()) {
+        // Players run the match; we only follow it
+        if(netplay_watch_tick() < 0) {
+            game_state_set_next(SCENE_MENU);
+        }
+    } else if(rb == NULL) {
+        ticktimer_run();
+        game_state_tick();
+    } else if(rollback_tick(rb) < 0) {
+        PERROR("Rollback session failed at tick %u!", rollback_get_tick(rb));
+        rollback_set_active(NULL);
+
+        // Network match is over; the session goes away with the arena
+        if(rb == netplay_get_session()) {
+            game_state_set_next(SCENE_MENU);
+        }
+    } else if(rb == netplay_get_session()) {
+        netplay_serve();
+    }
+}
+
+static void engine_tick() {
+    // Tick timers and scene
+    engine_sim_tick();
+
+    // Tick console
+    console_tick();
+}
+
+static int engine_sim_run(void *userdata) {
+    while(1) {
+        SDL_SemWait(sim.start);
+        if(sim.quit) {
+            break;
+        }
+        for(int i = 0; i < sim.ticks; i++) {
+            // Scene switches are done by the main thread
+            if(game_state_scene_pending() || !game_state_is_running()) {
+                break;
+            }
+            engine_tick();
+        }
+        game_state_snapshot();
+        SDL_SemPost(sim.done);
+    }
+    return 0;
+}
+
+// Sets up players and arena from the replay, and starts the match
+static void engine_start_playback() {
+    for(int i = 0; i < 2; i++) {
+        game_player *player = game_state_get_player(i);
+        controller *ctrl = malloc(sizeof(controller));
+        controller_init(ctrl);
+        replay_controller_create(ctrl, &playback, i);
+        game_player_set_ctrl(player, ctrl);
+        player->har_id = playback.players[i].har_id;
+        player->pilot_id = playback.players[i].pilot_id;
+        memcpy(player->colors, playback.players[i].colors, 3);
+    }
+    game_state_set_next(playback.arena_id);
+}
+
+// Gives both players a random controller. HARs and pilots are picked with the
+// game rng, so the whole match is reproducible from the rng seed.
+static void engine_random_players() {
+    for(int i = 0; i < 2; i++) {
+        game_player *player = game_state_get_player(i);
+        controller *ctrl = malloc(sizeof(controller));
+        controller_init(ctrl);
+        random_controller_create(ctrl, rand_intmax());
+        game_player_set_ctrl(player, ctrl);
+        player->har_id = HAR_JAGUAR + rand_int(HAR_NOVA - HAR_JAGUAR + 1);
+        player->pilot_id = rand_int(10);
+        INFO("Player %d is pilot %d with HAR %d.", i+1, player->pilot_id, player->har_id);
+    }
+}
+
+// Replay playback continues as long as the replay has input left and the match is on
+static int engine_playback_running() {
+    controller *ctrl = game_player_get_ctrl(game_state_get_player(0));
+    return ctrl != NULL && ctrl->type == CTRL_TYPE_REPLAY && !replay_controller_finished(ctrl);
+}
+
+// Player 1 plays locally and player 2 is the loopback peer. Both send their input
+// through the session; the game only sees what the rollback controllers give it.
+static int engine_start_loopback(int latency) {
+    rollback_sim sims[2];
+    rollback_transport net;
+    settings *setting = settings_get();
+
+    // Arena has to be up before the first state is saved
+    game_state_switch_scene(1);
+
+    rollback_loopback_create(&loopback.net, latency, 0);
+    for(int i = 0; i < 2; i++) {
+        controller_init(&loopback.inputs[i]);
+        random_controller_create(&loopback.inputs[i], rand_intmax());
+        netplay_sim_create(&sims[i], &loopback.inputs[i]);
+    }
+    sims[1].save_size = loopback_peer_save_size;
+    sims[1].save = loopback_peer_save;
+    sims[1].load = loopback_peer_load;
+    sims[1].advance = loopback_peer_advance;
+    sims[1].checksum = NULL;
+
+    for(int i = 0; i < 2; i++) {
+        rollback_loopback_transport(&loopback.net, i, &net);
+        if(rollback_create(&loopback.sessions[i], &sims[i], &net, i,
+                setting->net.input_delay, setting->net.rollback_window)) {
+            return 1;
+        }
+    }
+    for(int i = 0; i < 2; i++) {
+        controller *ctrl = malloc(sizeof(controller));
+        controller_init(ctrl);
+        rollback_controller_create(ctrl, &loopback.sessions[0], i);
+        game_player_set_ctrl(game_state_get_player(i), ctrl);
+    }
+    rollback_set_active(&loopback.sessions[0]);
+    INFO("Headless: rollback match over loopback, latency %d ticks.", latency);
+    return 0;
 }
 
-void engine_run() {
+static void engine_stop_loopback() {
+    rollback_stats *stats = &loopback.sessions[0].stats;
+    INFO("Headless: %u rollbacks, %u ticks resimulated, longest %u ticks, %u stalls.",
+        stats->rollbacks, stats->resimulated, stats->max_depth, stats->stalls);
+    for(int i = 0; i < 2; i++) {
+        rollback_free(&loopback.sessions[i]);
+        random_controller_free(&loopback.inputs[i]);
+    }
+}
+
+// Runs an arena match between two random controllers with no rendering,
+// and without waiting for the wall clock between ticks.
+static void engine_run_headless(engine_init_flags *init_flags) {
+    if(init_flags->playback_file != NULL) {
+        engine_start_playback();
+    } else {
+        engine_random_players();
+        game_state_set_next(SCENE_ARENA0 + init_flags->arena);
+        if(init_flags->loopback >= 0 && engine_start_loopback(init_flags->loopback)) {
+            return;
+        }
+    }
+
+    // Tick as fast as we can
+    unsigned int ticks = 0;
+    unsigned int start = SDL_GetTicks();
+    while(run && game_state_is_running()
+        && (init_flags->playback_file ? engine_playback_running() : ticks < init_flags->ticks)) {
+        if(init_flags->loopback >= 0) {
+            rollback_loopback_tick(&loopback.net);
+            rollback_tick(&loopback.sessions[1]);
+        }
+        engine_sim_tick();
+        game_state_free_dead();
+        audio_render();
+        ticks++;
+    }
+    unsigned int ms = SDL_GetTicks() - start;
+
+    // Report results
+    float tps = (ms > 0) ? ticks * 1000.0f / ms : 0.0f;
+    for(int i = 0; i < 2; i++) {
+        object *obj = game_player_get_har(game_state_get_player(i));
+        if(obj != NULL) {
+            har *h = object_get_userdata(obj);
+            INFO("Headless: player %d health %d/%d, endurance %d/%d.",
+                i+1, h->health, h->health_max, h->endurance, h->endurance_max);
+        }
+    }
+    profiler_stats stats;
+    for(int i = PROF_INPUT; i <= PROF_TICK; i++) {
+        profiler_get_stats(i, &stats);
+        INFO("Headless: %-7s min %.3f avg %.3f p99 %.3f ms.",
+            profiler_get_name(i), stats.min, stats.avg, stats.p99);
+    }
+    INFO("Headless: %u ticks in %u ms (%.1f ticks/sec).", ticks, ms, tps);
+    printf("%u ticks in %u ms (%.1f ticks/sec)\n", ticks, ms, tps);
+    if(init_flags->loopback >= 0) {
+        engine_stop_loopback();
+    }
+}
+
+// Scenes checked in golden frame runs. Every scene is run from a fixed
+// seed, and rendered every GOLDEN_INTERVAL ticks.
+#define GOLDEN_SEED 0x0F2097
+#define GOLDEN_TICKS 600
+#define GOLDEN_INTERVAL 60
+
+static const struct {
+    int scene;
+    const char *name;
+} golden_scenes[] = {
+    {SCENE_INTRO, "intro"},
+    {SCENE_MENU, "menu"},
+    {SCENE_MELEE, "melee"},
+    {SCENE_ARENA0, "arena0"},
+    {SCENE_ARENA1, "arena1"},
+    {SCENE_ARENA2, "arena2"},
+    {SCENE_ARENA3, "arena3"},
+    {SCENE_ARENA4, "arena4"},
+};
+
+static void engine_render_offscreen() {
+    video_render_prepare();
+    game_state_render_background();
+    game_state_snapshot();
+    game_state_swap_snapshot();
+    game_state_render(1.0f);
+    game_state_render_overlay();
+    video_render_finish();
+}
+
+// Runs the scripted scenes with the software renderer and no window, and
+// checks their frames against the golden frames.
+static void engine_run_golden(engine_init_flags *init_flags) {
+    golden_init(init_flags->golden_dir, init_flags->golden_write);
+    unsigned int start = SDL_GetTicks();
+    unsigned int ticks = 0;
+    int count = sizeof(golden_scenes) / sizeof(golden_scenes[0]);
+    for(int s = 0; s < count && run && game_state_is_running(); s++) {
+        rand_seed(GOLDEN_SEED);
+        if(golden_scenes[s].scene >= SCENE_ARENA0 && golden_scenes[s].scene <= SCENE_ARENA4) {
+            engine_random_players();
+        }
+        game_state_set_next(golden_scenes[s].scene);
+        if(game_state_switch_scene(1)) {
+            break;
+        }
+        for(unsigned int t = 0; t <= GOLDEN_TICKS && game_state_is_running(); t++) {
+            if(t % GOLDEN_INTERVAL == 0) {
+                char name[64];
+                sprintf(name, "%s-%04u", golden_scenes[s].name, t);
+                engine_render_offscreen();
+                golden_frame(name);
+            }
+            engine_sim_tick();
+            game_state_free_dead();
+            ticks++;
+        }
+    }
+    unsigned int ms = SDL_GetTicks() - start;
+
+    golden_stats stats;
+    golden_get_stats(&stats);
+    if(init_flags->golden_write) {
+        INFO("Golden: wrote %u frames to '%s', %u failed, in %u ticks and %u ms.",
+            stats.frames - stats.failed, init_flags->golden_dir, stats.failed, ticks, ms);
+    } else {
+        INFO("Golden: %u frames, %u differ, %u missing, in %u ticks and %u ms.",
+            stats.frames, stats.failed, stats.missing, ticks, ms);
+    }
+    if(stats.failed > 0 || stats.missing > 0 || !game_state_is_running()) {
+        init_flags->result = 1;
+    }
+}
+
+void engine_run(engine_init_flags *init_flags) {
     INFO(" --- BEGIN GAME LOG ---");
 
     // Set up game
@@ -84,15 +423,74 @@ void engine_run() {
         return;
     }
 
+    // Replays
+    if(init_flags->record_file != NULL) {
+        replay_record_start(init_flags->record_file);
+    }
+    replay_create(&playback);
+    if(init_flags->playback_file != NULL) {
+        if(replay_load(&playback, init_flags->playback_file)) {
+            replay_free(&playback);
+            game_state_free();
+            return;
+        }
+        INFO("Playing back replay '%s'.", init_flags->playback_file);
+    }
+
+    // Headless and golden frame runs have their own loops
+    if(init_flags->headless) {
+        if(init_flags->golden_dir != NULL) {
+            engine_run_golden(init_flags);
+        } else {
+            engine_run_headless(init_flags);
+        }
+        game_state_free();
+        replay_record_stop();
+        replay_free(&playback);
+        INFO(" --- END GAME LOG ---");
+        return;
+    }
+    if(init_flags->playback_file != NULL) {
+        engine_start_playback();
+    }
+    if(init_flags->spectate_host != NULL && netplay_watch(init_flags->spectate_host)) {
+        init_flags->result = 1;
+        game_state_free();
+        replay_record_stop();
+        replay_free(&playback);
+        return;
+    }
+    if(init_flags->capture_file != NULL) {
+        capture_record_start(init_flags->capture_file, game_state_ms_per_tick());
+    }
+
+    // Start up simulation thread
+    sim.start = SDL_CreateSemaphore(0);
+    sim.done = SDL_CreateSemaphore(0);
+    sim.ticks = 0;
+    sim.quit = 0;
+    sim.thread = SDL_CreateThread(engine_sim_run, "simulation", NULL);
+    if(sim.thread == NULL) {
+        PERROR("Could not create simulation thread: %s", SDL_GetError());
+        SDL_DestroySemaphore(sim.start);
+        SDL_DestroySemaphore(sim.done);
+        game_state_free();
+        replay_record_stop();
+        replay_free(&playback);
+        return;
+    }
+
     // Game loop
-    int frame_start = SDL_GetTicks();
-    int omf_wait = 0;
+    unsigned int next_tick = SDL_GetTicks();
+    unsigned int next_frame = next_tick;
+    unsigned int drawn_tick = next_tick; // Where next_tick was when the drawn snapshot was taken
     while(run && game_state_is_running()) {
         // Prepare rendering here
         video_render_prepare();
     
         // Handle events
         SDL_Event e;
+        profiler_begin(PROF_EVENTS);
         while(SDL_PollEvent(&e)) {
             // Handle other events
             switch(e.type) {
@@ -101,7 +499,14 @@ void engine_run() {
                     break;
                 case SDL_KEYDOWN:
                     if(e.key.keysym.sym == SDLK_F1) {
-                        take_screenshot = 1;
+                        capture_screenshot("screenshot.tga");
+                    }
+                    if(e.key.keysym.sym == SDLK_F2) {
+                        if(capture_is_recording()) {
+                            capture_record_stop();
+                        } else {
+                            capture_record_start("recording.y4m", game_state_ms_per_tick());
+                        }
                     }
                     break;
             }
@@ -124,53 +529,113 @@ void engine_run() {
                 game_state_handle_event(&e);
             }
         }
+        profiler_end(PROF_EVENTS);
+
+        // Scene switches happen here, while the simulation thread is idle. Until the
+        // next scene has been loaded, the old one keeps rendering.
+        if(game_state_switch_scene(0)) {
+            break;
+        }
+
+        // Count the ticks whose deadline has passed. Tick length is fixed,
+        // so simulation speed does not depend on the frame rate.
+        unsigned int now = SDL_GetTicks();
+        int ticks = 0;
+        while((int)(now - next_tick) >= 0) {
+            // Don't try to catch up forever if we are way behind.
+            if(ticks >= MAX_TICKS_PER_FRAME) {
+                next_tick = now;
+                break;
+            }
+            next_tick += game_state_ms_per_tick();
+            ticks++;
+        }
 
-        // Render scene
-        int dt = (SDL_GetTicks() - frame_start);
-        omf_wait += dt;
-        while(omf_wait > game_state_ms_per_tick()) {
-            // Tick timers
-            ticktimer_run();
+        // How far we are between the last two ticks of the snapshot that is drawn.
+        // The ticks counted above only go into the next one.
+        float alpha = 1.0f - (float)(int)(drawn_tick - now) / game_state_ms_per_tick();
+        if(alpha < 0.0f) alpha = 0.0f;
+        if(alpha > 1.0f) alpha = 1.0f;
 
-            // Tick scene
-            game_state_tick();
+        // Background is drawn from the live state, before the simulation starts
+        profiler_begin(PROF_RENDER);
+        game_state_render_background();
 
-            // Tick console
-            console_tick();
-            
-            // Handle waiting period leftover time
-            omf_wait -= game_state_ms_per_tick();
+        // Simulate the next ticks while the objects of the previous snapshot are drawn
+        if(ticks > 0) {
+            sim.ticks = ticks;
+            SDL_SemPost(sim.start);
+        }
+        game_state_render(alpha);
+        if(ticks > 0) {
+            SDL_SemWait(sim.done);
+            game_state_free_dead();
+            game_state_swap_snapshot();
+            drawn_tick = next_tick;
         }
-        frame_start = SDL_GetTicks();
 
-        // Do the actual rendering jobs
-        game_state_render();
+        // Overlays and console read the live state; simulation is idle again
+        game_state_render_overlay();
         console_render();
+        profiler_end(PROF_RENDER);
+        profiler_begin(PROF_FINISH);
+        capture_set_ticks(ticks);
         video_render_finish();
+        profiler_end(PROF_FINISH);
+        profiler_begin(PROF_AUDIO);
         audio_render();
+        profiler_end(PROF_AUDIO);
         
-        // If screenshot requested, do it here.
-        if(take_screenshot) {
-            image img;
-            video_screenshot(&img);
-            image_write_tga(&img, "screenshot.tga");
-            image_free(&img);
-            take_screenshot = 0;
-        }
-        
-        // Delay stuff a bit if vsync is off
+        // If vsync is off, sleep until the next frame or tick is due.
+        // With fps_limit 0, we render once per tick.
         if(!_vsync && run) {
-            SDL_Delay(1);
+            int fps_limit = settings_get()->video.fps_limit;
+            unsigned int deadline = next_tick;
+            now = SDL_GetTicks();
+            if(fps_limit > 0) {
+                next_frame += 1000 / fps_limit;
+                if((int)(next_frame - now) < 0) {
+                    next_frame = now;
+                }
+                if((int)(next_frame - deadline) < 0) {
+                    deadline = next_frame;
+                }
+            }
+            if((int)(deadline - now) > 0) {
+                SDL_Delay(deadline - now);
+            }
         }
     }
     
+    // Stop simulation thread
+    sim.quit = 1;
+    SDL_SemPost(sim.start);
+    SDL_WaitThread(sim.thread, NULL);
+    SDL_DestroySemaphore(sim.start);
+    SDL_DestroySemaphore(sim.done);
+
+    // Report how well sprites were batched
+    batch_stats bstats;
+    batch_get_stats(&bstats);
+    INFO("Render: %u quads in %u draw calls.", bstats.quads, bstats.draws);
+    tcache_stats tstats;
+    tcache_get_stats(&tstats);
+    INFO("Render: texture cache had %u hits, %u misses and %u evictions, %u textures in %u bytes.",
+        tstats.hits, tstats.misses, tstats.evictions, tstats.entries, tstats.bytes);
+    glstate_stats gstats;
+    glstate_get_stats(&gstats);
+    INFO("Render: %u GL state changes made, %u redundant ones skipped.", gstats.calls, gstats.skipped);
+
     // Free scene object
     game_state_free();
+    replay_record_stop();
+    replay_free(&playback);
 
     INFO(" --- END GAME LOG ---");
 }
 
 void engine_close() {
+    profiler_close();
     ticktimer_close();
     console_close();
     altpals_close();
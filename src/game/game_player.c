@@ -1,4 +1,8 @@
 #include "game/game_player.h"
+#include "controller/random_controller.h"
+#include "controller/replay_controller.h"
+#include "controller/rollback_controller.h"
+#include "controller/spectate_controller.h"
 #include <stdlib.h>
 
 void game_player_create(game_player *gp) {
@@ -30,6 +34,14 @@ void game_player_set_ctrl(game_player *gp, controller *ctrl) {
     if(gp->ctrl != NULL) {
         if(gp->ctrl->type == CTRL_TYPE_KEYBOARD) {
             keyboard_free(gp->ctrl);
+        } else if(gp->ctrl->type == CTRL_TYPE_RANDOM) {
+            random_controller_free(gp->ctrl);
+        } else if(gp->ctrl->type == CTRL_TYPE_REPLAY) {
+            replay_controller_free(gp->ctrl);
+        } else if(gp->ctrl->type == CTRL_TYPE_ROLLBACK) {
+            rollback_controller_free(gp->ctrl);
+        } else if(gp->ctrl->type == CTRL_TYPE_SPECTATE) {
+            spectate_controller_free(gp->ctrl);
         }
         free(gp->ctrl);
     }
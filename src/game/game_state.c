@@ -2,13 +2,21 @@
 #include <SDL2/SDL.h>
 #include "controller/keyboard.h"
 #include "utils/log.h"
+#include "utils/profiler.h"
+#include "utils/random.h"
 #include "resources/ids.h"
 #include "console/console.h"
 #include "game/game_state.h"
+#include "game/netplay.h"
 #include "game/settings.h"
+#include "game/ticktimer.h"
+#include "game/state_refs.h"
 #include "game/protos/scene.h"
 #include "game/protos/object.h"
 #include "game/protos/intersect.h"
+#include "game/objects/har.h"
+#include "game/objects/projectile.h"
+#include "game/objects/scrap.h"
 #include "game/scenes/intro.h"
 #include "game/scenes/mainmenu.h"
 #include "game/scenes/credits.h"
@@ -27,10 +35,46 @@ typedef struct {
     object *obj;
 } render_obj;
 
+// Saved states are padded to this, so that the parts can be packed back to back
+#define STATE_ALIGN(n) (((n) + 7) & ~7u)
+
+// Saved simulation state. Followed by the tick timers, the state of the scene,
+// and then a state_object and an object record for every object. Holds no
+// pointers; see state_refs.h.
+typedef struct state_header_t {
+    unsigned int size;
+    unsigned int scene_id;
+    uint32_t seed;
+    unsigned int next_object_id;
+    unsigned int object_count;
+    unsigned int timers_size;
+    unsigned int scene_size;
+    unsigned int reserved;
+} state_header;
+
+typedef struct state_object_t {
+    unsigned int id;
+    int layer;
+    unsigned int size; // Including this struct
+    int type;
+    object_refs refs;
+    unsigned int reserved;
+} state_object;
+
 int game_state_create() {
     gamestate = malloc(sizeof(game_state));
     gamestate->run = 1;
     vector_create(&gamestate->objects, sizeof(render_obj));
+    vector_create(&gamestate->dead_objects, sizeof(object*));
+    for(int i = 0; i < 2; i++) {
+        gamestate->snapshots[i].items = NULL;
+        gamestate->snapshots[i].count = 0;
+        gamestate->snapshots[i].size = 0;
+    }
+    gamestate->snapshot_front = 0;
+    gamestate->snapshot_ready = 0;
+    scene_loader_create(&gamestate->loader);
+    gamestate->next_object_id = 1;
     int nscene = SCENE_INTRO;
     if(scene_create(&gamestate->sc, nscene)) {
         PERROR("Error while loading scene %d.", nscene);
@@ -50,7 +94,30 @@ int game_state_create() {
     return 0;
 }
 
+// Objects are not freed in the middle of a tick, since the render thread
+// may still be drawing them from the previous snapshot. They are collected
+// here and freed by game_state_free_dead() once rendering is done.
+static void game_state_kill_object(object *obj) {
+    vector_append(&gamestate->dead_objects, &obj);
+}
+
+void game_state_free_dead() {
+    object **obj;
+    iterator it;
+    vector_iter_begin(&gamestate->dead_objects, &it);
+    while((obj = iter_next(&it)) != NULL) {
+        object_free(*obj);
+        free(*obj);
+        vector_delete(&gamestate->dead_objects, &it);
+    }
+}
+
 void game_state_add_object(object *obj, int layer) {
+    // Objects are identified by id in saved states; ids are not reused within a scene
+    if(obj->id == 0) {
+        obj->id = gamestate->next_object_id++;
+    }
+
     render_obj o;
     o.obj = obj;
     o.layer = layer;
@@ -69,8 +136,7 @@ void game_state_del_animation(int anim_id) {
     while((robj = iter_next(&it)) != NULL) {
         animation *ani = object_get_animation(robj->obj);
         if(ani != NULL && ani->id == anim_id) {
-            object_free(robj->obj);
-            free(robj->obj);
+            game_state_kill_object(robj->obj);
             vector_delete(&gamestate->objects, &it);
             DEBUG("Deleted animation %i from game_state.", anim_id);
             return;
@@ -85,8 +151,7 @@ void game_state_del_object(object *target) {
     vector_iter_begin(&gamestate->objects, &it);
     while((robj = iter_next(&it)) != NULL) {
         if(target == robj->obj) {
-            object_free(robj->obj);
-            free(robj->obj);
+            game_state_kill_object(robj->obj);
             vector_delete(&gamestate->objects, &it);
             return;
         }
@@ -95,6 +160,13 @@ void game_state_del_object(object *target) {
 
 void game_state_set_next(unsigned int next_scene_id) {
     gamestate->next_id = next_scene_id;
+
+    // Start loading the next scene in the background. Current scene runs until it is done.
+    if(next_scene_id != gamestate->this_id
+        && next_scene_id != SCENE_NONE
+        && !scene_loader_is_loading(&gamestate->loader, next_scene_id)) {
+        scene_loader_start(&gamestate->loader, next_scene_id);
+    }
 }
 
 scene* game_state_get_scene() {
@@ -113,61 +185,109 @@ int game_state_handle_event(SDL_Event *event) {
     return 1;
 }
 
-void game_state_render() {
+static void snapshot_add(render_snapshot *snap, object *obj) {
+    if(obj->cur_sprite == NULL) return;
+
+    if(snap->count >= snap->size) {
+        snap->size = (snap->size > 0) ? snap->size * 2 : 32;
+        snap->items = realloc(snap->items, snap->size * sizeof(object));
+    }
+    // The copy carries the texture revision; the render thread compares it
+    // against the shared reference, so the live object is left alone
+    snap->items[snap->count++] = *obj;
+}
+
+// Takes a copy of all objects in the order they should be rendered. 
+// The copy is drawn by game_state_render() while the next ticks are
+// being simulated.
+void game_state_snapshot() {
+    render_snapshot *snap = &gamestate->snapshots[!gamestate->snapshot_front];
     iterator it;
     render_obj *robj;
-
-    // Render scene background
-    scene_render(&gamestate->sc);
+    snap->count = 0;
 
     // Get har objects
     object *har[2];
     har[0] = game_state_get_player(0)->har;
     har[1] = game_state_get_player(1)->har;
 
-    // Render BOTTOM layer
+    // BOTTOM layer
     vector_iter_begin(&gamestate->objects, &it);
     while((robj = iter_next(&it)) != NULL) {
         if(robj->layer == RENDER_LAYER_BOTTOM) {
             if(robj->obj == har[0] || robj->obj == har[1]) continue;
-            object_render(robj->obj);
+            snapshot_add(snap, robj->obj);
         }
     }
 
-    // Render passive HARs here
+    // Passive HARs
     for(int i = 0; i < 2; i++) {
         if(har[i] != NULL && !har_is_active(har[i])) {
-            object_render(har[i]);
+            snapshot_add(snap, har[i]);
         }
     }
 
-    // Render MIDDLE layer
+    // MIDDLE layer
     vector_iter_begin(&gamestate->objects, &it);
     while((robj = iter_next(&it)) != NULL) {
         if(robj->layer == RENDER_LAYER_MIDDLE) {
             if(robj->obj == har[0] || robj->obj == har[1]) continue;
-            object_render(robj->obj);
+            snapshot_add(snap, robj->obj);
         }
     }
 
-    // Render active HARs here
+    // Active HARs
     for(int i = 0; i < 2; i++) {
         if(har[i] != NULL && har_is_active(har[i])) {
-            object_render(har[i]);
+            snapshot_add(snap, har[i]);
         }
     }
 
-    // Render TOP layer
+    // TOP layer
     vector_iter_begin(&gamestate->objects, &it);
     while((robj = iter_next(&it)) != NULL) {
         if(robj->layer == RENDER_LAYER_TOP) {
             if(robj->obj == har[0] || robj->obj == har[1]) continue;
-            object_render(robj->obj);
+            snapshot_add(snap, robj->obj);
         }
     }
 
+    gamestate->snapshot_ready = 1;
+}
+
+// Makes the latest snapshot visible. Call only when the simulation is idle.
+void game_state_swap_snapshot() {
+    if(gamestate->snapshot_ready) {
+        gamestate->snapshot_front = !gamestate->snapshot_front;
+        gamestate->snapshot_ready = 0;
+    }
+}
+
+static void game_state_clear_snapshots() {
+    gamestate->snapshots[0].count = 0;
+    gamestate->snapshots[1].count = 0;
+    gamestate->snapshot_ready = 0;
+}
+
+void game_state_render_background() {
+    scene_render(&gamestate->sc);
+}
+
+// Renders the objects from the front snapshot. Does not touch the live 
+// game state, so this may run at the same time as the simulation.
+void game_state_render(float alpha) {
+    render_snapshot *snap = &gamestate->snapshots[gamestate->snapshot_front];
+    for(unsigned int i = 0; i < snap->count; i++) {
+        object_render_interpolated(&snap->items[i], alpha);
+    }
+}
+
+void game_state_render_overlay() {
     // If we are in debug mode, handle HAR debug layers
 #ifdef DEBUGMODE
+    object *har[2];
+    har[0] = game_state_get_player(0)->har;
+    har[1] = game_state_get_player(1)->har;
     for(int i = 0; i < 2; i++) {
         if(har[i] != NULL) {
             object_debug(har[i]);
@@ -180,8 +300,13 @@ void game_state_render() {
 }
 
 int game_load_new(int scene_id) {
-    // Free old scene
+    // Old objects are going away; drop everything that refers to them
+    game_state_clear_snapshots();
+    game_state_free_dead();
+
+    // Free old scene, and end the network match if there was one
     scene_free(&gamestate->sc);
+    netplay_stop();
 
     render_obj *robj;
     iterator it;
@@ -192,8 +317,19 @@ int game_load_new(int scene_id) {
         vector_delete(&gamestate->objects, &it);
     }
 
-    // Initialize new scene with BK data etc.
-    if(scene_create(&gamestate->sc, scene_id)) {
+    // Ids only need to be unique within a scene. Starting every scene from the same
+    // one gives objects the same ids on every machine that runs the same match.
+    gamestate->next_object_id = 1;
+
+    // Initialize new scene with BK data etc. If the loader has the data ready, use that.
+    if(scene_loader_is_loading(&gamestate->loader, scene_id)) {
+        bk bk_data;
+        if(scene_loader_finish(&gamestate->loader, &bk_data)) {
+            PERROR("Unable to load BK file %s (%d)!", get_id_name(scene_id), scene_id);
+            return 1;
+        }
+        scene_create_from_bk(&gamestate->sc, scene_id, &bk_data);
+    } else if(scene_create(&gamestate->sc, scene_id)) {
         PERROR("Error while loading scene %d.", scene_id);
         return 1;
     }
@@ -245,6 +381,10 @@ int game_load_new(int scene_id) {
                 PERROR("Error while creating arena scene.");
                 return 1;
             } 
+            if(netplay_start()) {
+                PERROR("Error while starting network match.");
+                return 1;
+            }
             break;
     }
 
@@ -280,8 +420,7 @@ void game_state_cleanup() {
     while((robj = iter_next(&it)) != NULL) {
         if(object_finished(robj->obj)) {
             DEBUG("Animation object %d is finished, removing.", robj->obj->cur_animation->id);
-            object_free(robj->obj);
-            free(robj->obj);
+            game_state_kill_object(robj->obj);
             vector_delete(&gamestate->objects, &it);
         }
     }
@@ -296,6 +435,15 @@ void game_state_call_move() {
     }
 }
 
+void game_state_store_pos() {
+    render_obj *robj;
+    iterator it;
+    vector_iter_begin(&gamestate->objects, &it);
+    while((robj = iter_next(&it)) != NULL) {
+        object_store_pos(robj->obj);
+    }
+}
+
 void game_state_call_tick() {
     render_obj *robj;
     iterator it;
@@ -305,41 +453,74 @@ void game_state_call_tick() {
     }
 }
 
-void game_state_tick() {
+int game_state_scene_pending() {
+    return gamestate->this_id != gamestate->next_id;
+}
+
+// Loads the next scene if one has been requested.
+// Returns 1 if the game should stop.
+int game_state_switch_scene(int wait) {
     // We want to load another scene
     if(gamestate->this_id != gamestate->next_id) {
         // If this is the end, set run to 0 so that engine knows to close here
         if(gamestate->next_id == SCENE_NONE) {
             DEBUG("Next ID is SCENE_NONE! bailing.");
             gamestate->run = 0;
-            return;
+            return 1;
+        }
+
+        // Keep the old scene around until the BK file has been loaded
+        if(!wait && !scene_loader_ready(&gamestate->loader)
+            && scene_loader_is_loading(&gamestate->loader, gamestate->next_id)) {
+            return 0;
         }
 
         // Load up new scene
         if(game_load_new(gamestate->next_id)) {
             PERROR("Error while loading new scene! bailing.");
             gamestate->run = 0;
-            return;
+            return 1;
         }
     }
+    return 0;
+}
+
+void game_state_tick() {
+    // We want to load another scene
+    if(game_state_switch_scene(1)) {
+        return;
+    }
+
+    // Remember positions for render interpolation
+    game_state_store_pos();
 
     // Tick input. If console is opened, do not tick the controllers.
+    profiler_begin(PROF_INPUT);
     if(!console_window_is_open()) { scene_input_tick(&gamestate->sc); }
+    profiler_end(PROF_INPUT);
 
     // Tick scene
     scene_tick(&gamestate->sc);
 
     // Clean up objects
+    profiler_begin(PROF_CLEANUP);
     game_state_cleanup();
+    profiler_end(PROF_CLEANUP);
 
     // Call object_move for all objects
+    profiler_begin(PROF_MOVE);
     game_state_call_move();
+    profiler_end(PROF_MOVE);
 
     // Handle physics for all pairs of objects
+    profiler_begin(PROF_COLLIDE);
     game_state_call_collide();
+    profiler_end(PROF_COLLIDE);
 
     // Tick all objects
+    profiler_begin(PROF_TICK);
     game_state_call_tick();
+    profiler_end(PROF_TICK);
 }
 
 game_player* game_state_get_player(int player_id) {
@@ -357,14 +538,20 @@ void game_state_free() {
         vector_delete(&gamestate->objects, &it);
     }
     vector_free(&gamestate->objects);
+    game_state_free_dead();
+    vector_free(&gamestate->dead_objects);
+    free(gamestate->snapshots[0].items);
+    free(gamestate->snapshots[1].items);
     
     // Free players
     for(int i = 0; i < 2; i++) {
         game_player_free(&gamestate->players[i]);
     }
 
-    // Free scene
+    // Free scene, and the next one if it was being loaded
     scene_free(&gamestate->sc);
+    netplay_stop();
+    scene_loader_cancel(&gamestate->loader);
 
     // Free up state
     free(gamestate);
@@ -381,3 +568,308 @@ int game_state_ms_per_tick() {
     }
     return MS_PER_OMF_TICK;
 }
+
+// Returns the size of the buffer game_state_save needs
+unsigned int game_state_save_size() {
+    unsigned int size = sizeof(state_header) + STATE_ALIGN(ticktimer_save_size());
+    size += STATE_ALIGN(scene_serialize(&gamestate->sc, NULL));
+    iterator it;
+    render_obj *robj;
+    vector_iter_begin(&gamestate->objects, &it);
+    while((robj = iter_next(&it)) != NULL) {
+        size += sizeof(state_object) + object_save_size(robj->obj);
+    }
+    return size;
+}
+
+static animation* state_bk_animation(void *file, int id) {
+    bk_info *info = bk_get_info(file, id);
+    return (info != NULL) ? &info->ani : NULL;
+}
+
+static animation* state_af_animation(void *file, int id) {
+    af_move *move = af_get_move(file, id);
+    return (move != NULL) ? &move->ani : NULL;
+}
+
+// Saved states refer to the BK file of the scene, and the AF files of the HARs
+static void game_state_get_refs(state_refs *refs) {
+    bk *bk_data = &gamestate->sc.bk_data;
+    state_refs_create(refs);
+    state_refs_set_source(refs, STATE_SOURCE_SCENE, bk_data, state_bk_animation,
+        bk_get_palette(bk_data, 0), bk_get_stl(bk_data));
+    for(int i = 0; i < 2; i++) {
+        object *har_obj = gamestate->players[i].har;
+        if(har_obj != NULL) {
+            har *h = object_get_userdata(har_obj);
+            state_refs_set_source(refs, STATE_SOURCE_PLAYER1 + i, &h->af_data, state_af_animation,
+                object_get_palette(har_obj), h->af_data.sound_translation_table);
+        }
+    }
+}
+
+// Plain objects are saved without callbacks, so they must not have any
+static int game_state_has_callbacks(object *obj) {
+    return obj->free != NULL || obj->act != NULL || obj->tick != NULL
+        || obj->collide != NULL || obj->finish != NULL || obj->move != NULL
+        || obj->serialize != NULL || obj->animation_state.spawn != NULL
+        || obj->animation_state.destroy != NULL;
+}
+
+// Gives an object that is created from a saved state the callbacks of its type
+static int game_state_bind_object(object *obj) {
+    switch(obj->type) {
+        case OBJECT_TYPE_PLAIN:
+            return 0;
+        case OBJECT_TYPE_SCENE:
+            object_set_spawn_cb(obj, cb_scene_spawn_object, &gamestate->sc);
+            object_set_destroy_cb(obj, cb_scene_destroy_object, &gamestate->sc);
+            return 0;
+        case OBJECT_TYPE_PROJECTILE:
+            return projectile_create(obj);
+        case OBJECT_TYPE_SCRAP:
+            return scrap_create(obj);
+        case OBJECT_TYPE_READY:
+            object_set_finish_cb(obj, scene_ready_anim_done);
+            return 0;
+        case OBJECT_TYPE_FIGHT:
+            object_set_finish_cb(obj, scene_fight_anim_done);
+            return 0;
+        case OBJECT_TYPE_YOUWIN:
+            object_set_finish_cb(obj, scene_youwin_anim_done);
+            return 0;
+        case OBJECT_TYPE_YOULOSE:
+            object_set_finish_cb(obj, scene_youlose_anim_done);
+            return 0;
+    }
+    // HARs live through the whole match, so they are never created from saved states
+    PERROR("Unable to create object %u of type %d from saved state!", obj->id, obj->type);
+    return 1;
+}
+
+// Saves the complete simulation state into a flat buffer. The buffer contains no
+// pointers: animations, palettes and sound tables are saved by reference, and
+// callbacks by the type of the object. It can be loaded into any running copy of
+// the same scene. Returns 1 if the buffer is too small, or something can't be saved.
+int game_state_save(char *buf, unsigned int size) {
+    unsigned int needed = game_state_save_size();
+    if(size < needed) {
+        return 1;
+    }
+
+    state_header *hdr = (state_header*)buf;
+    hdr->size = needed;
+    hdr->scene_id = gamestate->this_id;
+    hdr->seed = rand_get_seed();
+    hdr->next_object_id = gamestate->next_object_id;
+    hdr->object_count = vector_size(&gamestate->objects);
+    hdr->timers_size = ticktimer_save_size();
+    hdr->reserved = 0;
+    char *pos = buf + sizeof(state_header);
+    if(ticktimer_save(pos)) {
+        return 1;
+    }
+    pos += STATE_ALIGN(hdr->timers_size);
+    hdr->scene_size = scene_serialize(&gamestate->sc, pos);
+    pos += STATE_ALIGN(hdr->scene_size);
+
+    state_refs refs;
+    game_state_get_refs(&refs);
+
+    iterator it;
+    render_obj *robj;
+    vector_iter_begin(&gamestate->objects, &it);
+    while((robj = iter_next(&it)) != NULL) {
+        object *obj = robj->obj;
+        state_object *so = (state_object*)pos;
+        if(state_refs_find(&refs, obj, &so->refs)
+            || (obj->type == OBJECT_TYPE_PLAIN && game_state_has_callbacks(obj))) {
+            PERROR("Unable to save object %u; it uses something the scene does not have!", obj->id);
+            return 1;
+        }
+        so->id = obj->id;
+        so->layer = robj->layer;
+        so->type = obj->type;
+        so->reserved = 0;
+        so->size = sizeof(state_object) + object_save(obj, pos + sizeof(state_object));
+        pos += so->size;
+    }
+    return 0;
+}
+
+// Restores an object from its saved state. If the object was just created, it gets
+// the callbacks of its type first. Returns 1 if the object can't be restored.
+static int game_state_load_object(state_refs *refs, object *obj, const state_object *so, int fresh) {
+    animation *ani;
+    sprite *spr;
+    palette *pal;
+    char *stl;
+    if(state_refs_resolve(refs, &so->refs, &ani, &spr, &pal, &stl)) {
+        PERROR("Saved state of object %u refers to something the scene does not have!", so->id);
+        return 1;
+    }
+
+    // Animations the object owns can only be kept
+    if(so->refs.ani_source == STATE_SOURCE_OWN) {
+        if(fresh || obj->cur_animation_own != OWNER_OBJECT) {
+            PERROR("Unable to restore object %u with an owned animation!", so->id);
+            return 1;
+        }
+        spr = (so->refs.sprite >= 0) ? animation_get_sprite(obj->cur_animation, so->refs.sprite) : NULL;
+    } else if(obj->cur_animation_own == OWNER_OBJECT) {
+        PERROR("Unable to restore object %u; it owns its animation!", so->id);
+        return 1;
+    }
+
+    if(fresh && game_state_bind_object(obj)) {
+        return 1;
+    }
+    object_set_refs(obj, ani, spr, pal, stl);
+    return object_load(obj, (const char*)so + sizeof(state_object), so->size - sizeof(state_object));
+}
+
+// Checks that every part of a saved state is within the buffer, before anything is loaded
+static int game_state_check(const char *buf, unsigned int size) {
+    const state_header *hdr = (const state_header*)buf;
+    if(size < sizeof(state_header) || hdr->size != size) {
+        return 1;
+    }
+    unsigned int left = size - sizeof(state_header);
+    if(hdr->timers_size > left || STATE_ALIGN(hdr->timers_size) > left) {
+        return 1;
+    }
+    left -= STATE_ALIGN(hdr->timers_size);
+    if(hdr->scene_size > left || STATE_ALIGN(hdr->scene_size) > left) {
+        return 1;
+    }
+    left -= STATE_ALIGN(hdr->scene_size);
+    const char *pos = buf + sizeof(state_header) + STATE_ALIGN(hdr->timers_size) + STATE_ALIGN(hdr->scene_size);
+    for(unsigned int i = 0; i < hdr->object_count; i++) {
+        const state_object *so = (const state_object*)pos;
+        if(left < sizeof(state_object) || so->size < sizeof(state_object)
+            || so->size > left || STATE_ALIGN(so->size) != so->size) {
+            return 1;
+        }
+        left -= so->size;
+        pos += so->size;
+    }
+    return left != 0;
+}
+
+// Restores a state saved with game_state_save. Objects that still exist are restored
+// in place, objects that have been removed since are created again, and objects that
+// did not exist yet are removed. Returns 1 if the state could not be fully restored.
+int game_state_load(const char *buf, unsigned int size) {
+    const state_header *hdr = (const state_header*)buf;
+    if(game_state_check(buf, size)) {
+        PERROR("Saved state is invalid!");
+        return 1;
+    }
+    if(hdr->scene_id != gamestate->this_id) {
+        PERROR("Saved state is from scene %u, but scene %u is running!", hdr->scene_id, gamestate->this_id);
+        return 1;
+    }
+
+    rand_seed(hdr->seed);
+    gamestate->next_object_id = hdr->next_object_id;
+    const char *pos = buf + sizeof(state_header);
+    int failed = ticktimer_load(pos, hdr->timers_size);
+    pos += STATE_ALIGN(hdr->timers_size);
+    if(scene_unserialize(&gamestate->sc, pos, hdr->scene_size)) {
+        PERROR("Unable to restore the state of scene %u!", hdr->scene_id);
+        failed = 1;
+    }
+    pos += STATE_ALIGN(hdr->scene_size);
+
+    state_refs refs;
+    game_state_get_refs(&refs);
+
+    // Take the live objects aside; the ones that are in the saved state are reused
+    unsigned int live_count = vector_size(&gamestate->objects);
+    render_obj *live = malloc((live_count + 1) * sizeof(render_obj));
+    for(unsigned int i = 0; i < live_count; i++) {
+        live[i] = *(render_obj*)vector_get(&gamestate->objects, i);
+    }
+    vector_clear(&gamestate->objects);
+
+    for(unsigned int i = 0; i < hdr->object_count; i++) {
+        const state_object *so = (const state_object*)pos;
+        pos += so->size;
+
+        render_obj o;
+        o.layer = so->layer;
+        o.obj = NULL;
+        for(unsigned int k = 0; k < live_count; k++) {
+            if(live[k].obj != NULL && live[k].obj->id == so->id && live[k].obj->type == so->type) {
+                o.obj = live[k].obj;
+                live[k].obj = NULL;
+                break;
+            }
+        }
+        if(o.obj != NULL) {
+            if(game_state_load_object(&refs, o.obj, so, 0)) {
+                failed = 1;
+            }
+        } else {
+            o.obj = malloc(sizeof(object));
+            object_create(o.obj, vec2i_create(0,0), vec2f_create(0,0));
+            o.obj->id = so->id;
+            o.obj->type = so->type;
+            if(game_state_load_object(&refs, o.obj, so, 1)) {
+                object_free(o.obj);
+                free(o.obj);
+                failed = 1;
+                continue;
+            }
+        }
+        vector_append(&gamestate->objects, &o);
+    }
+
+    // Objects that were created after the state was saved
+    for(unsigned int k = 0; k < live_count; k++) {
+        if(live[k].obj != NULL) {
+            game_state_kill_object(live[k].obj);
+        }
+    }
+    free(live);
+    return failed;
+}
+
+// FNV-1a over the given bytes
+static uint32_t checksum_add(uint32_t hash, const void *data, unsigned int len) {
+    const unsigned char *p = data;
+    for(unsigned int i = 0; i < len; i++) {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Hash of the state that decides how the match goes on: the rng, and the
+// position, speed and animation of every object. For HARs, also health,
+// endurance and state. Two peers running the same match must get the
+// same hash for the same tick; anything else means they have desynced.
+uint32_t game_state_checksum() {
+    uint32_t hash = 2166136261u;
+    uint32_t seed = rand_get_seed();
+    hash = checksum_add(hash, &seed, sizeof(seed));
+
+    iterator it;
+    render_obj *robj;
+    vector_iter_begin(&gamestate->objects, &it);
+    while((robj = iter_next(&it)) != NULL) {
+        object *obj = robj->obj;
+        hash = checksum_add(hash, &obj->id, sizeof(obj->id));
+        hash = checksum_add(hash, &obj->pos, sizeof(obj->pos));
+        hash = checksum_add(hash, &obj->vel, sizeof(obj->vel));
+        hash = checksum_add(hash, &obj->animation_state.ticks, sizeof(obj->animation_state.ticks));
+        for(int i = 0; i < 2; i++) {
+            if(obj == gamestate->players[i].har) {
+                har *h = object_get_userdata(obj);
+                hash = checksum_add(hash, &h->health, sizeof(h->health));
+                hash = checksum_add(hash, &h->endurance, sizeof(h->endurance));
+                hash = checksum_add(hash, &h->state, sizeof(h->state));
+            }
+        }
+    }
+    return hash;
+}
@@ -0,0 +1,269 @@
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "game/netplay.h"
+#include "game/spectate_net.h"
+#include "game/game_state.h"
+#include "game/settings.h"
+#include "game/ticktimer.h"
+#include "game/scenes/arena.h"
+#include "controller/keyboard.h"
+#include "controller/joystick.h"
+#include "controller/rollback_controller.h"
+#include "controller/spectate_controller.h"
+#include "audio/sound.h"
+#include "utils/log.h"
+
+// Match setup for viewers: the arena, and HAR, pilot and colors of both players
+#define NETPLAY_SETUP_LEN 11
+
+// How long viewers wait for the match to come in, and how often they check, in ms
+#define NETPLAY_JOIN_TIMEOUT 10000
+#define NETPLAY_JOIN_WAIT 10
+
+typedef struct netplay_t {
+    rollback session;
+    controller *inputs[2]; // Controllers the players had before the session took over
+    int remote;
+    int running;
+    spectate_server server;
+    int serving;
+    spectate_client client;
+    spectate_viewer viewer;
+    int watching;
+} netplay;
+
+static netplay match;
+
+static unsigned int netplay_save_size(void *userdata) {
+    return game_state_save_size();
+}
+
+static int netplay_save(void *userdata, char *buf, unsigned int size) {
+    return game_state_save(buf, size);
+}
+
+static int netplay_load(void *userdata, const char *buf, unsigned int size) {
+    return game_state_load(buf, size);
+}
+
+static void netplay_advance(void *userdata, int resimulating) {
+    // Scene switches are left to the engine, which stops the session first
+    if(game_state_scene_pending()) {
+        return;
+    }
+    // Sounds of ticks that are simulated again have been heard already
+    sound_mute(resimulating);
+    ticktimer_run();
+    game_state_tick();
+    sound_mute(0);
+}
+
+static uint32_t netplay_checksum(void *userdata) {
+    return game_state_checksum();
+}
+
+static rollback_input netplay_poll(void *userdata) {
+    controller *ctrl = userdata;
+    ctrl_event *ev = NULL;
+    controller_tick(ctrl, &ev);
+    // Keys that steer the menu don't move the HAR. Both sides still get the tick.
+    int human = ctrl->type == CTRL_TYPE_KEYBOARD || ctrl->type == CTRL_TYPE_GAMEPAD;
+    if(human && arena_is_menu_visible(game_state_get_scene())) {
+        controller_free_chain(ev);
+        ev = NULL;
+    }
+    rollback_input input = rollback_controller_pack(ev);
+    controller_free_chain(ev);
+    return input;
+}
+
+void netplay_sim_create(rollback_sim *sim, controller *input) {
+    sim->userdata = input;
+    sim->save_size = netplay_save_size;
+    sim->save = netplay_save;
+    sim->load = netplay_load;
+    sim->advance = netplay_advance;
+    sim->poll = netplay_poll;
+    sim->checksum = netplay_checksum;
+}
+
+static void netplay_free_ctrl(controller *ctrl) {
+    switch(ctrl->type) {
+        case CTRL_TYPE_KEYBOARD: keyboard_free(ctrl); break;
+        case CTRL_TYPE_GAMEPAD: joystick_free(ctrl); break;
+        case CTRL_TYPE_NETWORK: net_controller_free(ctrl); break;
+    }
+    free(ctrl);
+}
+
+static void netplay_setup_write(char *buf) {
+    buf[0] = game_state_get_scene()->id;
+    for(int i = 0; i < 2; i++) {
+        game_player *player = game_state_get_player(i);
+        buf[1 + i * 5] = player->har_id;
+        buf[2 + i * 5] = player->pilot_id;
+        memcpy(buf + 3 + i * 5, player->colors, 3);
+    }
+}
+
+int netplay_start() {
+    settings *setting = settings_get();
+    rollback_sim sim;
+    rollback_transport net;
+    int remote = -1;
+
+    for(int i = 0; i < 2; i++) {
+        controller *ctrl = game_player_get_ctrl(game_state_get_player(i));
+        if(ctrl != NULL && ctrl->type == CTRL_TYPE_NETWORK) {
+            remote = i;
+        }
+    }
+    if(remote < 0) {
+        return 0;
+    }
+    controller *local = game_player_get_ctrl(game_state_get_player(!remote));
+    if(local == NULL || local->type == CTRL_TYPE_NETWORK) {
+        PERROR("Netplay: network match needs one local player!");
+        return 1;
+    }
+
+    netplay_sim_create(&sim, local);
+    net_controller_get_transport(game_player_get_ctrl(game_state_get_player(remote)), &net);
+    if(rollback_create(&match.session, &sim, &net, !remote,
+            setting->net.input_delay, setting->net.rollback_window)) {
+        PERROR("Netplay: unable to create rollback session!");
+        return 1;
+    }
+
+    // Session keeps the original controllers until the match is over
+    for(int i = 0; i < 2; i++) {
+        game_player *player = game_state_get_player(i);
+        controller *ctrl = malloc(sizeof(controller));
+        match.inputs[i] = player->ctrl;
+        player->ctrl = NULL;
+        controller_init(ctrl);
+        rollback_controller_create(ctrl, &match.session, i);
+        ctrl->har = match.inputs[i]->har;
+        game_player_set_ctrl(player, ctrl);
+    }
+    match.remote = remote;
+    match.running = 1;
+    rollback_set_active(&match.session);
+    INFO("Netplay: player %d is remote, input delay %d, rollback window %d.",
+        remote + 1, match.session.delay, match.session.window);
+
+    // Viewers are optional; the match goes on without them
+    match.serving = 0;
+    if(setting->net.spectate_port > 0) {
+        char setup[NETPLAY_SETUP_LEN];
+        netplay_setup_write(setup);
+        match.serving = !spectate_server_create(&match.server, &match.session,
+            setup, NETPLAY_SETUP_LEN, setting->net.spectate_port);
+    }
+    return 0;
+}
+
+void netplay_stop() {
+    if(match.watching) {
+        spectate_viewer_free(&match.viewer);
+        spectate_client_free(&match.client);
+        match.watching = 0;
+    }
+    if(!match.running) {
+        return;
+    }
+    if(match.serving) {
+        spectate_server_free(&match.server);
+        match.serving = 0;
+    }
+    rollback_stats *stats = &match.session.stats;
+    INFO("Netplay: %u rollbacks, %u ticks resimulated, longest %u ticks, %u stalls.",
+        stats->rollbacks, stats->resimulated, stats->max_depth, stats->stalls);
+    if(rollback_get_active() == &match.session) {
+        rollback_set_active(NULL);
+    }
+    rollback_free(&match.session);
+    for(int i = 0; i < 2; i++) {
+        netplay_free_ctrl(match.inputs[i]);
+        match.inputs[i] = NULL;
+    }
+    match.running = 0;
+}
+
+rollback* netplay_get_session() {
+    return match.running ? &match.session : NULL;
+}
+
+void netplay_serve() {
+    if(match.serving) {
+        spectate_server_tick(&match.server);
+    }
+}
+
+// Sets up the players as the host has them, and loads the arena for the snapshot
+static void netplay_watch_setup(void *userdata, const char *setup, unsigned int len) {
+    if(len != NETPLAY_SETUP_LEN) {
+        PERROR("Netplay: match setup has %u bytes instead of %d!", len, NETPLAY_SETUP_LEN);
+        return;
+    }
+    for(int i = 0; i < 2; i++) {
+        game_player *player = game_state_get_player(i);
+        controller *ctrl = malloc(sizeof(controller));
+        controller_init(ctrl);
+        spectate_controller_create(ctrl, &match.viewer, i);
+        game_player_set_ctrl(player, ctrl);
+        player->har_id = setup[1 + i * 5];
+        player->pilot_id = setup[2 + i * 5];
+        memcpy(player->colors, setup + 3 + i * 5, 3);
+    }
+    game_state_set_next(setup[0]);
+    game_state_switch_scene(1);
+
+    // From here on, the viewer goes away with the arena
+    match.watching = 1;
+}
+
+int netplay_watch(const char *addr) {
+    rollback_sim sim;
+    rollback_transport net;
+    if(spectate_client_connect(&match.client, addr, settings_get()->net.spectate_port)) {
+        return 1;
+    }
+    netplay_sim_create(&sim, NULL);
+    spectate_client_transport(&match.client, &net);
+    spectate_viewer_create(&match.viewer, &sim, &net, &netplay_watch_setup);
+
+    unsigned int start = SDL_GetTicks();
+    while(!match.viewer.joined) {
+        if(spectate_viewer_tick(&match.viewer) < 0 || SDL_GetTicks() - start > NETPLAY_JOIN_TIMEOUT) {
+            PERROR("Netplay: unable to join the match at %s!", addr);
+            // Once the arena is up, the viewer goes away with it
+            if(!match.watching) {
+                spectate_viewer_free(&match.viewer);
+                spectate_client_free(&match.client);
+            }
+            return 1;
+        }
+        SDL_Delay(NETPLAY_JOIN_WAIT);
+    }
+    INFO("Netplay: watching the match at %s from tick %u.", addr, match.viewer.tick);
+    return 0;
+}
+
+int netplay_is_watching() {
+    return match.watching;
+}
+
+int netplay_watch_tick() {
+    return spectate_viewer_tick(&match.viewer) < 0 ? -1 : 0;
+}
+
+int netplay_get_stats(net_stats *stats) {
+    if(!match.running || net_controller_get_stats(match.inputs[match.remote], stats)) {
+        return 1;
+    }
+    // The network controller is not ticked during the session, so the delay comes from here
+    stats->input_delay = match.session.tick - match.session.confirmed;
+    return 0;
+}
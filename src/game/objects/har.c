@@ -36,6 +36,44 @@ void har_free(object *obj) {
     free(h);
 }
 
+// Saves everything but the AF data, which stays the same for the whole match
+unsigned int har_serialize(object *obj, char *buf) {
+    if(buf != NULL) {
+        har *h = (har*)buf;
+        memcpy(h, object_get_userdata(obj), sizeof(har));
+        memset(&h->af_data, 0, sizeof(af));
+#ifdef DEBUGMODE
+        memset(&h->debug_tex, 0, sizeof(texture));
+        memset(&h->debug_img, 0, sizeof(image));
+#endif
+    }
+    return sizeof(har);
+}
+
+int har_unserialize(object *obj, const char *buf) {
+    har *h = object_get_userdata(obj);
+
+    // HARs live through the whole match, so there is always a live one to restore to
+    if(h == NULL) {
+        PERROR("Unable to restore a HAR that does not exist!");
+        return 1;
+    }
+    af af_data = h->af_data;
+#ifdef DEBUGMODE
+    texture debug_tex = h->debug_tex;
+    image debug_img = h->debug_img;
+    int debug_enabled = h->debug_enabled;
+#endif
+    memcpy(h, buf, sizeof(har));
+    h->af_data = af_data;
+#ifdef DEBUGMODE
+    h->debug_tex = debug_tex;
+    h->debug_img = debug_img;
+    h->debug_enabled = debug_enabled;
+#endif
+    return 0;
+}
+
 // Simple helper function
 void har_set_ani(object *obj, int animation_id, int repeat) {
     har *h = object_get_userdata(obj);
@@ -902,12 +940,15 @@ int har_create(object *obj, palette *pal, int dir, int har_id, int pilot_id, int
     local->inputs[10] = '\0';
 
     // Callbacks and userdata
+    object_set_type(obj, OBJECT_TYPE_HAR);
     object_set_free_cb(obj, har_free);
     object_set_act_cb(obj, har_act);
     object_set_tick_cb(obj, har_tick);
     object_set_move_cb(obj, har_move);
     object_set_collide_cb(obj, har_collide);
     object_set_finish_cb(obj, har_finished);
+    object_set_serialize_cb(obj, har_serialize);
+    object_set_unserialize_cb(obj, har_unserialize);
 
 #ifdef DEBUGMODE
     object_set_debug_cb(obj, har_debug);
@@ -1,6 +1,8 @@
 #include <stdlib.h>
+#include <string.h>
 #include "game/objects/projectile.h"
 #include "game/objects/har.h"
+#include "game/game_state.h"
 #include "utils/log.h"
 
 typedef struct projectile_local_t {
@@ -26,6 +28,30 @@ void projectile_free(object *obj) {
     free(object_get_userdata(obj));
 }
 
+// The HAR is saved as the player it belongs to
+unsigned int projectile_serialize(object *obj, char *buf) {
+    if(buf != NULL) {
+        projectile_local *local = object_get_userdata(obj);
+        memcpy(buf, &local->har->player_id, sizeof(int));
+    }
+    return sizeof(int);
+}
+
+int projectile_unserialize(object *obj, const char *buf) {
+    int player_id;
+    memcpy(&player_id, buf, sizeof(int));
+    object *har_obj = (player_id == 0 || player_id == 1) ? game_state_get_player(player_id)->har : NULL;
+    if(har_obj == NULL) {
+        PERROR("Unable to restore a projectile of player %d, who has no HAR!", player_id);
+        return 1;
+    }
+    if(object_get_userdata(obj) == NULL) {
+        object_set_userdata(obj, malloc(sizeof(projectile_local)));
+    }
+    ((projectile_local*)object_get_userdata(obj))->har = object_get_userdata(har_obj);
+    return 0;
+}
+
 void projectile_move(object *obj) {
     obj->pos.x += obj->vel.x;
     obj->vel.y += obj->gravity;
@@ -54,9 +80,12 @@ int projectile_create(object *obj) {
     local->har = object_get_userdata(obj);
     object_set_userdata(obj, local);
 
+    object_set_type(obj, OBJECT_TYPE_PROJECTILE);
     object_set_tick_cb(obj, projectile_tick);
     object_set_free_cb(obj, projectile_free);
     object_set_move_cb(obj, projectile_move);
+    object_set_serialize_cb(obj, projectile_serialize);
+    object_set_unserialize_cb(obj, projectile_unserialize);
 
     return 0;
 }
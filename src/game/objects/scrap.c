@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <string.h>
 #include "game/objects/scrap.h"
 
 #define SCRAP_KEEPALIVE 80
@@ -22,6 +23,21 @@ void scrap_free(object *obj) {
     free(object_get_userdata(obj));
 }
 
+unsigned int scrap_serialize(object *obj, char *buf) {
+    if(buf != NULL) {
+        memcpy(buf, object_get_userdata(obj), sizeof(scrap_local));
+    }
+    return sizeof(scrap_local);
+}
+
+int scrap_unserialize(object *obj, const char *buf) {
+    if(object_get_userdata(obj) == NULL) {
+        object_set_userdata(obj, malloc(sizeof(scrap_local)));
+    }
+    memcpy(object_get_userdata(obj), buf, sizeof(scrap_local));
+    return 0;
+}
+
 // TODO: This is kind of quick and dirty, think of something better.
 void scrap_move(object *obj) {
     vec2f vel = object_get_vel(obj);
@@ -69,9 +85,12 @@ int scrap_create(object *obj) {
     object_set_userdata(obj, local);
     local->tick = 0;
 
+    object_set_type(obj, OBJECT_TYPE_SCRAP);
     object_set_tick_cb(obj, scrap_tick);
     object_set_free_cb(obj, scrap_free);
     object_set_move_cb(obj, scrap_move);
+    object_set_serialize_cb(obj, scrap_serialize);
+    object_set_unserialize_cb(obj, scrap_unserialize);
 
     return 0;
 }
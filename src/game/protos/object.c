@@ -2,15 +2,63 @@
 #include <shadowdive/vga_image.h>
 #include <shadowdive/sprite_image.h>
 #include <shadowdive/sprite.h>
+#include <shadowdive/stringparser.h>
 #include "game/protos/object.h"
 #include "video/video.h"
+#include "video/indexed.h"
+#include "resources/atlas.h"
 #include "utils/log.h"
 
 #define UNUSED(x) (void)(x)
 
+// If an object moves more than this during one tick, it was most likely
+// teleported. Don't interpolate those.
+#define OBJECT_LERP_MAX_DIST 32.0f
+
+// Saved object states are padded to this, so that they can be packed back to back
+#define OBJECT_SAVE_ALIGN(n) (((n) + 7) & ~7u)
+
+// Saved object state, by value. Followed by the animation string and the serialized
+// userdata. Id, type and whatever the object uses from outside of itself are saved
+// by the game state.
+typedef struct object_record_t {
+    vec2f pos;
+    vec2f prev_pos;
+    vec2f vel;
+    int vstate;
+    int hstate;
+    int direction;
+    float y_percent;
+    float gravity;
+    int is_static;
+    int group;
+    int layers;
+    int cur_remap;
+    int halt;
+    int stride;
+    player_sprite_state sprite_state;
+    player_slide_state slide_state;
+    unsigned int finished;
+    unsigned int ticks;
+    unsigned int ticks_len;
+    unsigned int repeat;
+    unsigned int reverse;
+    unsigned int end_frame;
+    int previous;
+    int enemy_x;
+    int enemy_y;
+    unsigned int string_len;
+    unsigned int userdata_len;
+} object_record;
+
 void object_create(object *obj, vec2i pos, vec2f vel) {
+    // Set by game_state
+    obj->id = 0;
+    obj->type = OBJECT_TYPE_PLAIN;
+
     // Position related
     obj->pos = vec2i_to_f(pos);
+    obj->prev_pos = obj->pos;
     obj->vel = vel;
     object_reset_vstate(obj);
     object_reset_hstate(obj);
@@ -25,12 +73,14 @@ void object_create(object *obj, vec2i pos, vec2f vel) {
 
     // Animation playback related
     obj->cur_animation_own = OWNER_EXTERNAL;
-    obj->texture_refresh = 0;
+    obj->texture_rev = 0;
     obj->cur_palette = NULL;
     obj->cur_animation = NULL;
     obj->cur_sprite = NULL;
     obj->sound_translation_table = NULL;
-    obj->cur_texture = NULL;
+    obj->cur_texture = malloc(sizeof(tcache_ref));
+    obj->cur_texture->entry = NULL;
+    obj->cur_texture->rev = 0;
     obj->cur_remap = 0;
     obj->halt = 0;
     obj->stride = 1;
@@ -45,6 +95,147 @@ void object_create(object *obj, vec2i pos, vec2f vel) {
     obj->finish = NULL;
     obj->move = NULL;
     obj->debug = NULL;
+    obj->serialize = NULL;
+    obj->unserialize = NULL;
+}
+
+// Returns the amount of bytes object_save will write
+unsigned int object_save_size(object *obj) {
+    unsigned int size = sizeof(object_record);
+    size += OBJECT_SAVE_ALIGN(obj->animation_state.string.len + 1);
+    if(obj->serialize != NULL) {
+        size += OBJECT_SAVE_ALIGN(obj->serialize(obj, NULL));
+    }
+    return size;
+}
+
+// Saves the state of the object to a flat buffer. Everything the object owns is
+// copied by value; animations, palettes and callbacks are left to the caller.
+// Returns the amount of bytes written.
+unsigned int object_save(object *obj, char *buf) {
+    object_record *rec = (object_record*)buf;
+    char *string = buf + sizeof(object_record);
+
+    rec->pos = obj->pos;
+    rec->prev_pos = obj->prev_pos;
+    rec->vel = obj->vel;
+    rec->vstate = obj->vstate;
+    rec->hstate = obj->hstate;
+    rec->direction = obj->direction;
+    rec->y_percent = obj->y_percent;
+    rec->gravity = obj->gravity;
+    rec->is_static = obj->is_static;
+    rec->group = obj->group;
+    rec->layers = obj->layers;
+    rec->cur_remap = obj->cur_remap;
+    rec->halt = obj->halt;
+    rec->stride = obj->stride;
+    rec->sprite_state = obj->sprite_state;
+    rec->slide_state = obj->slide_state;
+    rec->finished = obj->animation_state.finished;
+    rec->ticks = obj->animation_state.ticks;
+    rec->ticks_len = obj->animation_state.ticks_len;
+    rec->repeat = obj->animation_state.repeat;
+    rec->reverse = obj->animation_state.reverse;
+    rec->end_frame = obj->animation_state.end_frame;
+    rec->previous = obj->animation_state.previous;
+    rec->enemy_x = obj->animation_state.enemy_x;
+    rec->enemy_y = obj->animation_state.enemy_y;
+
+    // Animation string
+    rec->string_len = obj->animation_state.string.len;
+    if(rec->string_len > 0) {
+        memcpy(string, obj->animation_state.string.data, rec->string_len);
+    }
+    string[rec->string_len] = 0;
+
+    // Userdata, if the object owns it
+    char *userdata = string + OBJECT_SAVE_ALIGN(rec->string_len + 1);
+    rec->userdata_len = 0;
+    if(obj->serialize != NULL) {
+        rec->userdata_len = obj->serialize(obj, userdata);
+    }
+    return sizeof(object_record)
+        + OBJECT_SAVE_ALIGN(rec->string_len + 1)
+        + OBJECT_SAVE_ALIGN(rec->userdata_len);
+}
+
+// Restores object state saved with object_save. The object must already have the
+// callbacks it had when it was saved. Returns 1 if the state can't be restored.
+int object_load(object *obj, const char *buf, unsigned int size) {
+    const object_record *rec = (const object_record*)buf;
+    const char *string = buf + sizeof(object_record);
+
+    // Everything must be within the record, and userdata the size the object expects
+    unsigned int left = size - sizeof(object_record);
+    unsigned int expected = (obj->serialize != NULL) ? obj->serialize(obj, NULL) : 0;
+    if(size < sizeof(object_record)
+        || rec->string_len >= left
+        || OBJECT_SAVE_ALIGN(rec->string_len + 1) > left
+        || rec->userdata_len > left - OBJECT_SAVE_ALIGN(rec->string_len + 1)
+        || rec->userdata_len != expected
+        || string[rec->string_len] != 0) {
+        PERROR("Saved state of object %u is invalid!", obj->id);
+        return 1;
+    }
+    const char *userdata = string + OBJECT_SAVE_ALIGN(rec->string_len + 1);
+
+    if(obj->cur_remap != rec->cur_remap) {
+        obj->texture_rev++;
+    }
+    obj->pos = rec->pos;
+    obj->prev_pos = rec->prev_pos;
+    obj->vel = rec->vel;
+    obj->vstate = rec->vstate;
+    obj->hstate = rec->hstate;
+    obj->direction = rec->direction;
+    obj->y_percent = rec->y_percent;
+    obj->gravity = rec->gravity;
+    obj->is_static = rec->is_static;
+    obj->group = rec->group;
+    obj->layers = rec->layers;
+    obj->cur_remap = rec->cur_remap;
+    obj->halt = rec->halt;
+    obj->stride = rec->stride;
+    obj->sprite_state = rec->sprite_state;
+    obj->slide_state = rec->slide_state;
+    obj->animation_state.finished = rec->finished;
+    obj->animation_state.ticks = rec->ticks;
+    obj->animation_state.ticks_len = rec->ticks_len;
+    obj->animation_state.repeat = rec->repeat;
+    obj->animation_state.reverse = rec->reverse;
+    obj->animation_state.end_frame = rec->end_frame;
+    obj->animation_state.previous = rec->previous;
+    obj->animation_state.enemy_x = rec->enemy_x;
+    obj->animation_state.enemy_y = rec->enemy_y;
+
+    // Only reparse the animation string if it has changed
+    str *cur = &obj->animation_state.string;
+    if(cur->data == NULL || cur->len != rec->string_len
+        || memcmp(cur->data, string, rec->string_len) != 0) {
+        sd_stringparser_set_string(obj->animation_state.parser, string);
+        str_free(cur);
+        str_create_from_data(cur, string, rec->string_len);
+    }
+
+    if(obj->unserialize != NULL && obj->unserialize(obj, userdata)) {
+        return 1;
+    }
+    return 0;
+}
+
+// Points the object at the animation, sprite, palette and sound table it had
+// in a saved state. The animation is left as it is if the object owns it.
+void object_set_refs(object *obj, animation *ani, sprite *spr, palette *pal, char *stl) {
+    if(obj->cur_sprite != spr || obj->cur_palette != pal) {
+        obj->texture_rev++;
+    }
+    if(obj->cur_animation_own != OWNER_OBJECT) {
+        obj->cur_animation = ani;
+    }
+    obj->cur_sprite = spr;
+    obj->cur_palette = pal;
+    obj->sound_translation_table = stl;
 }
 
 void object_set_stride(object *obj, int stride) {
@@ -101,7 +292,7 @@ void object_collide(object *obj, object *b) {
 }
 
 void object_revalidate(object *obj) {
-    obj->texture_refresh = 1;
+    obj->texture_rev++;
 }
 
 int _max(int r, int g, int b) {
@@ -119,106 +310,137 @@ int min(int a, int b) {
     return (a > b) ? b : a;
 }
 
-void object_check_texture(object *obj) {
-    // (Re)generate texture if necessary
-    if(obj->cur_texture == NULL) {
-        obj->cur_texture = malloc(sizeof(texture));
-        texture_create(obj->cur_texture);
-        obj->texture_refresh = 1;
+// Uploads the palette indexes of the sprite as they are. Colors are looked
+// up when drawing, so palette changes don't need a new texture.
+static int object_fill_indexed(texture *tex, void *userdata) {
+    object *obj = userdata;
+    sd_vga_image *vga = obj->cur_sprite->raw_sprite;
+    unsigned int len = vga->w * vga->h;
+    char *data = malloc(len * 2);
+    for(unsigned int i = 0; i < len; i++) {
+        data[i*2] = vga->data[i];
+        data[i*2+1] = vga->stencil[i] ? 0xFF : 0;
     }
-
-    // Check if we need to do palette stuff on every tick
-    player_sprite_state *rstate = &obj->sprite_state;
-    if(rstate->pal_entry_count > 0 && rstate->duration > 0) {
-        obj->texture_refresh = 1;
+    int ret = texture_init_indexed(tex, data, vga->w, vga->h);
+    if(ret) {
+        PERROR("object_render: Error while creating texture!");
     }
+    free(data);
+    return ret;
+}
 
-    // If palette has changed, load up new texture here
-    if(obj->texture_refresh) {
-        // Load up sprite with defined palette
-        sd_rgba_image *img = sd_vga_image_decode(
-            obj->cur_sprite->raw_sprite, 
-            (sd_palette*)obj->cur_palette, 
-            obj->cur_remap);
-
-        // If texture size differs, free it here
-        if(obj->cur_texture->w != img->w || obj->cur_texture->h != img->h) {
-            texture_free(obj->cur_texture);
-        }
+// Decodes the sprite with the current palette and remap
+static int object_fill_rgba(texture *tex, void *userdata) {
+    object *obj = userdata;
+    sd_rgba_image *img = sd_vga_image_decode(
+        obj->cur_sprite->raw_sprite, 
+        (sd_palette*)obj->cur_palette, 
+        obj->cur_remap);
 /*
-        // Do palette tricks
-        if(rstate->pal_entry_count > 0 && rstate->duration > 0) {
-            float bp = rstate->pal_begin + 
-                ((float)rstate->pal_end - (float)rstate->pal_begin) * 
-                (float)rstate->timer / (float)rstate->duration;
-            sd_vga_image *vga = obj->cur_sprite->raw_sprite;
-            int pix = 0;
-            float m = 0;
-            int r = obj->cur_palette->data[rstate->pal_ref_index][0];
-            int g = obj->cur_palette->data[rstate->pal_ref_index][1];
-            int b = obj->cur_palette->data[rstate->pal_ref_index][2];
-            color s;
-            for(int y = 0; y < img->h; y++) {
-                for(int x = 0; x < img->w; x++) {
-                    pix = vga->data[y * img->w + x];
-                    if(img->data[(y * img->w + x)*4 + 3] == 0) continue;
-                    if(pix >= rstate->pal_start_index && 
-                       pix <= (rstate->pal_start_index + rstate->pal_entry_count)) {
-                        s.r = img->data[(y * img->w + x)*4 + 0];
-                        s.g = img->data[(y * img->w + x)*4 + 1];
-                        s.b = img->data[(y * img->w + x)*4 + 2];
-                        float rr,gr,br;
-                        if(rstate->pal_tint) {
-                            m = _max(s.r, s.g, s.b);
-                            rr = (float)s.r + m/64.0f + bp/64.0f + (float)(r - s.r);
-                            gr = (float)s.g + m/64.0f + bp/64.0f + (float)(g - s.g);
-                            br = (float)s.b + m/64.0f + bp/64.0f + (float)(b - s.b);
-                        } else {
-                            rr = (float)r * (float)bp/64.0f;
-                            gr = s.g * (float)(1 - bp/64.0f) + (float)g * bp/64.0f;
-                            br = s.b * (float)(1 - bp/64.0f) + (float)b * bp/64.0f;
-                        }
-                        img->data[(y * img->w + x)*4 + 0] = max(0, min(63, rr));
-                        img->data[(y * img->w + x)*4 + 1] = max(0, min(63, gr));
-                        img->data[(y * img->w + x)*4 + 2] = max(0, min(63, br));
+    // Do palette tricks
+    if(rstate->pal_entry_count > 0 && rstate->duration > 0) {
+        float bp = rstate->pal_begin + 
+            ((float)rstate->pal_end - (float)rstate->pal_begin) * 
+            (float)rstate->timer / (float)rstate->duration;
+        sd_vga_image *vga = obj->cur_sprite->raw_sprite;
+        int pix = 0;
+        float m = 0;
+        int r = obj->cur_palette->data[rstate->pal_ref_index][0];
+        int g = obj->cur_palette->data[rstate->pal_ref_index][1];
+        int b = obj->cur_palette->data[rstate->pal_ref_index][2];
+        color s;
+        for(int y = 0; y < img->h; y++) {
+            for(int x = 0; x < img->w; x++) {
+                pix = vga->data[y * img->w + x];
+                if(img->data[(y * img->w + x)*4 + 3] == 0) continue;
+                if(pix >= rstate->pal_start_index && 
+                   pix <= (rstate->pal_start_index + rstate->pal_entry_count)) {
+                    s.r = img->data[(y * img->w + x)*4 + 0];
+                    s.g = img->data[(y * img->w + x)*4 + 1];
+                    s.b = img->data[(y * img->w + x)*4 + 2];
+                    float rr,gr,br;
+                    if(rstate->pal_tint) {
+                        m = _max(s.r, s.g, s.b);
+                        rr = (float)s.r + m/64.0f + bp/64.0f + (float)(r - s.r);
+                        gr = (float)s.g + m/64.0f + bp/64.0f + (float)(g - s.g);
+                        br = (float)s.b + m/64.0f + bp/64.0f + (float)(b - s.b);
+                    } else {
+                        rr = (float)r * (float)bp/64.0f;
+                        gr = s.g * (float)(1 - bp/64.0f) + (float)g * bp/64.0f;
+                        br = s.b * (float)(1 - bp/64.0f) + (float)b * bp/64.0f;
                     }
+                    img->data[(y * img->w + x)*4 + 0] = max(0, min(63, rr));
+                    img->data[(y * img->w + x)*4 + 1] = max(0, min(63, gr));
+                    img->data[(y * img->w + x)*4 + 2] = max(0, min(63, br));
                 }
             }
-        }*/
-
-        // If texture is valid, just reupload. We checked for size similarity previously.
-        // If texture is NOT valid, re-create it with a free ID etc.
-        if(texture_is_valid(obj->cur_texture)) {
-            if(texture_upload(obj->cur_texture, img->data)) {
-                PERROR("object_render: Error while uploading to an existing texture!");
-            }
-        } else {
-            if(texture_init(obj->cur_texture, img->data, img->w, img->h)) {
-                PERROR("object_render: Error while creating texture!");
-            }
         }
+    }*/
 
-        // Delete resources
-        sd_rgba_image_delete(img);
-        obj->texture_refresh = 0;
+    int ret = texture_init(tex, img->data, img->w, img->h);
+    if(ret) {
+        PERROR("object_render: Error while creating texture!");
     }
+    sd_rgba_image_delete(img);
+    return ret;
 }
 
-void object_render(object *obj) {
+// Returns the texture for the current sprite, palette and remap. Textures
+// come from the shared cache, so objects showing the same frame share one.
+static texture* object_check_texture(object *obj, int indexed) {
+    // Objects bump texture_rev when the texture should change. The render side
+    // keeps the revision it last made the texture for in the shared reference,
+    // since it only ever sees copies of the objects.
+    tcache_ref *ref = obj->cur_texture;
+    int refresh = ref->entry == NULL || ref->entry->key.indexed != indexed || ref->rev != obj->texture_rev;
+
+    // Check if we need to do palette stuff on every tick
+    player_sprite_state *rstate = &obj->sprite_state;
+    if(!indexed && rstate->pal_entry_count > 0 && rstate->duration > 0) {
+        refresh = 1;
+    }
+    if(!refresh) {
+        return &ref->entry->tex;
+    }
+    ref->rev = obj->texture_rev;
+
+    // Only the sprite matters for indexed textures
+    tcache_key key;
+    key.sprite = obj->cur_sprite->uid;
+    key.palette = 0;
+    key.remap = 0;
+    key.indexed = indexed;
+    if(!indexed && obj->cur_palette != NULL) {
+        const unsigned char *remap = (obj->cur_remap >= 0) ? obj->cur_palette->remaps[obj->cur_remap] : NULL;
+        key.palette = tcache_palette_hash(&obj->cur_palette->data[0][0], remap);
+        key.remap = obj->cur_remap;
+    }
+    return tcache_acquire(ref, &key, indexed ? object_fill_indexed : object_fill_rgba, obj);
+}
+
+static void object_render_at(object *obj, vec2f pos) {
     // Stop here if cur_sprite is NULL
     if(obj->cur_sprite == NULL) return;
 
     // Something to ease the pain ...
     player_sprite_state *rstate = &obj->sprite_state;
 
-    // Make sure texture is valid etc.
-    object_check_texture(obj);
+    // Sprites with a palette can be drawn straight from their palette indexes,
+    // if the video card can do it. Those are picked from the atlas of their file
+    // when possible; otherwise make sure the texture is valid etc.
+    int indexed = indexed_supported() && obj->cur_palette != NULL;
+    vec2i size = sprite_get_size(obj->cur_sprite);
+    vec2i tpos = vec2i_create(0, 0);
+    texture *tex = indexed ? atlas_get_sprite(obj->cur_sprite, &tpos) : NULL;
+    if(tex == NULL && (tex = object_check_texture(obj, indexed)) == NULL) {
+        return;
+    }
 
     // Render
-    int y = obj->pos.y + obj->cur_sprite->pos.y;
-    int x = obj->pos.x + obj->cur_sprite->pos.x;
+    int y = pos.y + obj->cur_sprite->pos.y;
+    int x = pos.x + obj->cur_sprite->pos.x;
     if(object_get_direction(obj) == OBJECT_FACE_LEFT) {
-        x = obj->pos.x - obj->cur_sprite->pos.x - object_get_size(obj).x;
+        x = pos.x - obj->cur_sprite->pos.x - object_get_size(obj).x;
     }
     int flipmode = rstate->flipmode;
     if(obj->direction == OBJECT_FACE_LEFT) {
@@ -235,14 +457,43 @@ void object_render(object *obj) {
     }
 
     // Render
-    video_render_sprite_flip_scale(obj->cur_texture, x, y, rstate->blendmode, flipmode, obj->y_percent);
+    if(indexed) {
+        const unsigned char *remap = (obj->cur_remap >= 0) ? obj->cur_palette->remaps[obj->cur_remap] : NULL;
+        video_render_sprite_palette(tex, x, y, tpos.x, tpos.y, size.x, size.y,
+            rstate->blendmode, flipmode, obj->y_percent, &obj->cur_palette->data[0][0], remap);
+    } else {
+        video_render_sprite_flip_scale(tex, x, y, rstate->blendmode, flipmode, obj->y_percent);
+    }
+}
+
+void object_render(object *obj) {
+    object_render_at(obj, obj->pos);
+}
+
+// Renders the object at a position between the previous and the current tick.
+// Alpha 0.0 is the previous tick position, 1.0 is the current position.
+void object_render_interpolated(object *obj, float alpha) {
+    vec2f d = vec2f_sub(obj->pos, obj->prev_pos);
+    if(d.x > OBJECT_LERP_MAX_DIST || d.x < -OBJECT_LERP_MAX_DIST ||
+       d.y > OBJECT_LERP_MAX_DIST || d.y < -OBJECT_LERP_MAX_DIST) {
+        object_render_at(obj, obj->pos);
+        return;
+    }
+    object_render_at(obj, vec2f_create(obj->prev_pos.x + d.x * alpha, obj->prev_pos.y + d.y * alpha));
+}
+
+// Remember the current position as the starting point for render interpolation
+void object_store_pos(object *obj) {
+    obj->prev_pos = obj->pos;
 }
 
 // Renders sprite to left top corner with no special stuff applied
 void object_render_neutral(object *obj) {
     if(obj->cur_sprite == NULL) return;
-    object_check_texture(obj);
-    video_render_background(obj->cur_texture);
+    texture *tex = object_check_texture(obj, 0);
+    if(tex != NULL) {
+        video_render_background(tex);
+    }
 }
 
 void object_act(object *obj, int action) {
@@ -267,7 +518,7 @@ void object_free(object *obj) {
         free(obj->cur_animation);
     }
     if(obj->cur_texture != NULL) {
-        texture_free(obj->cur_texture);
+        tcache_release(obj->cur_texture);
         free(obj->cur_texture);
     }
     obj->cur_texture = NULL;
@@ -289,7 +540,7 @@ void object_set_animation_owner(object *obj, int owner) {
 void object_set_palette(object *obj, palette *pal, int remap) {
     obj->cur_palette = pal;
     obj->cur_remap = remap;
-    obj->texture_refresh = 1;
+    obj->texture_rev++;
 }
 
 palette* object_get_palette(object *obj) {
@@ -328,11 +579,13 @@ animation* object_get_animation(object *obj) {
 
 void object_select_sprite(object *obj, int id) {
     obj->cur_sprite = animation_get_sprite(obj->cur_animation, id);
-    obj->texture_refresh = 1;
+    obj->texture_rev++;
     obj->sprite_state.blendmode = BLEND_ALPHA;
     obj->sprite_state.flipmode = FLIP_NONE;
 }
 
+void object_set_type(object *obj, int type) { obj->type = type; }
+int object_get_type(object *obj) { return obj->type; }
 void object_set_userdata(object *obj, void *ptr) { obj->userdata = ptr; }
 void* object_get_userdata(object *obj) { return obj->userdata; }
 void object_set_free_cb(object *obj, object_free_cb cbfunc) { obj->free = cbfunc; }
@@ -342,6 +595,8 @@ void object_set_collide_cb(object *obj, object_collide_cb cbfunc) { obj->collide
 void object_set_finish_cb(object *obj, object_finish_cb cbfunc) { obj->finish = cbfunc; }
 void object_set_move_cb(object *obj, object_move_cb cbfunc) { obj->move = cbfunc; }
 void object_set_debug_cb(object *obj, object_debug_cb cbfunc) { obj->debug = cbfunc; }
+void object_set_serialize_cb(object *obj, object_serialize_cb cbfunc) { obj->serialize = cbfunc; }
+void object_set_unserialize_cb(object *obj, object_unserialize_cb cbfunc) { obj->unserialize = cbfunc; }
 
 void object_set_layers(object *obj, int layers) { obj->layers = layers; }
 void object_set_group(object *obj, int group) { obj->group = group; }
@@ -113,6 +113,7 @@ void player_create(object *obj) {
     obj->animation_state.previous = -1;
     obj->animation_state.ticks_len = 0;
     obj->animation_state.parser = sd_stringparser_create();
+    str_create(&obj->animation_state.string);
     obj->slide_state.timer = 0;
     obj->slide_state.vel = vec2f_create(0,0);
     player_clear_frame(obj);
@@ -122,6 +123,7 @@ void player_free(object *obj) {
     if(obj->animation_state.parser != NULL) {
         sd_stringparser_delete(obj->animation_state.parser);
     }
+    str_free(&obj->animation_state.string);
 }
 
 void player_reload_with_str(object *obj, const char* custom_str) {
@@ -129,6 +131,8 @@ void player_reload_with_str(object *obj, const char* custom_str) {
     sd_stringparser_set_string(
         obj->animation_state.parser, 
         custom_str);
+    str_free(&obj->animation_state.string);
+    str_create_from_cstr(&obj->animation_state.string, custom_str);
 
     // Find string length
     sd_stringparser_frame tmp;
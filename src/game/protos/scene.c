@@ -7,11 +7,6 @@
 #include "utils/vec.h"
 #include "game/game_state.h"
 
-// Some internal functions
-void cb_scene_spawn_object(object *parent, int id, vec2i pos, int g, void *userdata);
-void cb_scene_destroy_object(object *parent, int id, void *userdata);
-
-
 // Loads BK file etc.
 int scene_create(scene *scene, int scene_id) {
     // Load BK
@@ -19,6 +14,13 @@ int scene_create(scene *scene, int scene_id) {
         PERROR("Unable to load BK file %s (%d)!", get_id_name(scene_id), scene_id);
         return 1;
     }
+    scene_create_from_bk(scene, scene_id, &scene->bk_data);
+    return 0;
+}
+
+// Creates the scene from already loaded BK data. Scene takes ownership of the data.
+void scene_create_from_bk(scene *scene, int scene_id, bk *bk_data) {
+    scene->bk_data = *bk_data;
     scene->id = scene_id;
 
     // Init functions
@@ -30,10 +32,11 @@ int scene_create(scene *scene, int scene_id) {
     scene->tick = NULL;
     scene->input_tick = NULL;
     scene->startup = NULL;
+    scene->serialize = NULL;
+    scene->unserialize = NULL;
 
     // All done.
     DEBUG("Loaded BK file %s (%d).", get_id_name(scene_id), scene_id);
-    return 0;
 }
 
 void scene_init(scene *scene) {
@@ -60,6 +63,7 @@ void scene_init(scene *scene) {
             if(info->probability == 1) {
                 object_set_repeat(obj, 1);
             }
+            object_set_type(obj, OBJECT_TYPE_SCENE);
             object_set_spawn_cb(obj, cb_scene_spawn_object, (void*)scene);
             object_set_destroy_cb(obj, cb_scene_destroy_object, (void*)scene);
             game_state_add_object(obj, RENDER_LAYER_BOTTOM);
@@ -83,6 +87,25 @@ int scene_startup(scene *scene, int id) {
     return 0;
 }
 
+// Returns the amount of bytes written, or needed if buf is NULL
+unsigned int scene_serialize(scene *scene, char *buf) {
+    if(scene->serialize != NULL) {
+        return scene->serialize(scene, buf);
+    }
+    return 0;
+}
+
+// Returns 1 if the saved state is not what the scene saves
+int scene_unserialize(scene *scene, const char *buf, unsigned int size) {
+    if(size != scene_serialize(scene, NULL)) {
+        return 1;
+    }
+    if(scene->unserialize != NULL) {
+        return scene->unserialize(scene, buf);
+    }
+    return 0;
+}
+
 // Return 0 if event was handled here
 int scene_event(scene *scene, SDL_Event *event) {
     if(scene->event != NULL) {
@@ -144,6 +167,14 @@ void scene_set_startup_cb(scene *scene, scene_startup_cb cbfunc) {
     scene->startup = cbfunc;
 }
 
+void scene_set_serialize_cb(scene *scene, scene_serialize_cb cbfunc) {
+    scene->serialize = cbfunc;
+}
+
+void scene_set_unserialize_cb(scene *scene, scene_unserialize_cb cbfunc) {
+    scene->unserialize = cbfunc;
+}
+
 void scene_set_tick_cb(scene *scene, scene_tick_cb cbfunc) {
     scene->tick = cbfunc;
 }
@@ -163,6 +194,7 @@ void cb_scene_spawn_object(object *parent, int id, vec2i pos, int g, void *userd
         object_set_stl(obj, object_get_stl(parent));
         object_set_palette(obj, object_get_palette(parent), 0);
         object_set_animation(obj, &info->ani);
+        object_set_type(obj, OBJECT_TYPE_SCENE);
         object_set_spawn_cb(obj, cb_scene_spawn_object, userdata);
         object_set_destroy_cb(obj, cb_scene_destroy_object, userdata);
         if(info->probability == 1) {
@@ -0,0 +1,246 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "game/replay.h"
+#include "game/game_state.h"
+#include "game/game_player.h"
+#include "resources/ids.h"
+#include "utils/random.h"
+#include "utils/log.h"
+
+// File format, all values little endian:
+//   "OMFR", u8 version, u32 seed, u8 arena, 2 * (u8 har, u8 pilot, u8 colors[3]),
+//   u32 ticks, u32 event count, and then the events.
+// Each event is a varint tick delta from the previous event,
+// followed by a byte with the player in the high and the action in the low nibble.
+#define REPLAY_MAGIC "OMFR"
+#define REPLAY_VERSION 1
+
+typedef struct replay_recorder_t {
+    char *filename;
+    int recording;
+    replay rep;
+} replay_recorder;
+
+static replay_recorder recorder = { NULL, 0 };
+
+void replay_create(replay *rep) {
+    rep->seed = 0;
+    rep->arena_id = 0;
+    rep->ticks = 0;
+    for(int i = 0; i < 2; i++) {
+        rep->players[i].har_id = HAR_JAGUAR;
+        rep->players[i].pilot_id = 0;
+        memset(rep->players[i].colors, 0, 3);
+    }
+    vector_create(&rep->events, sizeof(replay_event));
+}
+
+void replay_free(replay *rep) {
+    vector_free(&rep->events);
+}
+
+void replay_add(replay *rep, uint32_t tick, int player, int action) {
+    replay_event ev;
+    ev.tick = tick;
+    ev.player = player;
+    ev.action = action;
+    vector_append(&rep->events, &ev);
+}
+
+static void write_u32(FILE *f, uint32_t v) {
+    for(int i = 0; i < 4; i++) {
+        fputc((v >> (i*8)) & 0xFF, f);
+    }
+}
+
+static int read_u32(FILE *f, uint32_t *v) {
+    *v = 0;
+    for(int i = 0; i < 4; i++) {
+        int c = fgetc(f);
+        if(c == EOF) return 1;
+        *v |= (uint32_t)c << (i*8);
+    }
+    return 0;
+}
+
+static void write_varint(FILE *f, uint32_t v) {
+    while(v >= 0x80) {
+        fputc((v & 0x7F) | 0x80, f);
+        v >>= 7;
+    }
+    fputc(v, f);
+}
+
+static int read_varint(FILE *f, uint32_t *v) {
+    *v = 0;
+    for(int shift = 0; shift < 32; shift += 7) {
+        int c = fgetc(f);
+        if(c == EOF) return 1;
+        *v |= (uint32_t)(c & 0x7F) << shift;
+        if(!(c & 0x80)) return 0;
+    }
+    return 1;
+}
+
+int replay_save(replay *rep, const char *filename) {
+    FILE *f = fopen(filename, "wb");
+    if(f == NULL) {
+        PERROR("Unable to open replay file '%s' for writing!", filename);
+        return 1;
+    }
+    fwrite(REPLAY_MAGIC, 1, 4, f);
+    fputc(REPLAY_VERSION, f);
+    write_u32(f, rep->seed);
+    fputc(rep->arena_id - SCENE_ARENA0, f);
+    for(int i = 0; i < 2; i++) {
+        fputc(rep->players[i].har_id - HAR_JAGUAR, f);
+        fputc(rep->players[i].pilot_id, f);
+        fwrite(rep->players[i].colors, 1, 3, f);
+    }
+    write_u32(f, rep->ticks);
+    write_u32(f, vector_size(&rep->events));
+
+    iterator it;
+    replay_event *ev;
+    uint32_t last = 0;
+    vector_iter_begin(&rep->events, &it);
+    while((ev = iter_next(&it)) != NULL) {
+        write_varint(f, ev->tick - last);
+        fputc((ev->player << 4) | (ev->action & 0x0F), f);
+        last = ev->tick;
+    }
+
+    int failed = ferror(f);
+    fclose(f);
+    if(failed) {
+        PERROR("Error while writing replay file '%s'!", filename);
+        return 1;
+    }
+    DEBUG("Wrote replay file '%s' (%u ticks, %u events).", filename, rep->ticks, vector_size(&rep->events));
+    return 0;
+}
+
+// Replay should be created with replay_create first.
+int replay_load(replay *rep, const char *filename) {
+    char magic[4];
+    uint32_t count, delta, tick = 0;
+    int c;
+
+    FILE *f = fopen(filename, "rb");
+    if(f == NULL) {
+        PERROR("Unable to open replay file '%s'!", filename);
+        return 1;
+    }
+    if(fread(magic, 1, 4, f) != 4 || memcmp(magic, REPLAY_MAGIC, 4) != 0 || fgetc(f) != REPLAY_VERSION) {
+        PERROR("File '%s' is not a valid replay file!", filename);
+        goto error_0;
+    }
+    if(read_u32(f, &rep->seed) || (c = fgetc(f)) == EOF || c > 4) {
+        goto error_1;
+    }
+    rep->arena_id = SCENE_ARENA0 + c;
+    for(int i = 0; i < 2; i++) {
+        int har = fgetc(f);
+        int pilot = fgetc(f);
+        if(har == EOF || har > HAR_NOVA - HAR_JAGUAR || pilot == EOF || pilot > 9) {
+            goto error_1;
+        }
+        if(fread(rep->players[i].colors, 1, 3, f) != 3) {
+            goto error_1;
+        }
+        rep->players[i].har_id = HAR_JAGUAR + har;
+        rep->players[i].pilot_id = pilot;
+    }
+    if(read_u32(f, &rep->ticks) || read_u32(f, &count)) {
+        goto error_1;
+    }
+
+    // Every event takes at least two bytes, so the rest of the file
+    // tells how many there can be.
+    long pos = ftell(f);
+    if(pos < 0 || fseek(f, 0, SEEK_END) != 0) {
+        goto error_1;
+    }
+    long remaining = ftell(f) - pos;
+    if(fseek(f, pos, SEEK_SET) != 0 || remaining < 0 || count > remaining / 2) {
+        goto error_1;
+    }
+    if(vector_reserve(&rep->events, count)) {
+        goto error_1;
+    }
+    for(uint32_t i = 0; i < count; i++) {
+        if(read_varint(f, &delta) || (c = fgetc(f)) == EOF) {
+            goto error_1;
+        }
+        tick += delta;
+        replay_add(rep, tick, c >> 4, c & 0x0F);
+    }
+    fclose(f);
+    DEBUG("Loaded replay file '%s' (%u ticks, %u events).", filename, rep->ticks, count);
+    return 0;
+
+error_1:
+    PERROR("Replay file '%s' is truncated or corrupted!", filename);
+error_0:
+    fclose(f);
+    return 1;
+}
+
+void replay_record_start(const char *filename) {
+    replay_record_stop();
+    recorder.filename = malloc(strlen(filename) + 1);
+    strcpy(recorder.filename, filename);
+    INFO("Recording matches to '%s'.", filename);
+}
+
+void replay_record_stop() {
+    if(recorder.recording) {
+        replay_free(&recorder.rep);
+        recorder.recording = 0;
+    }
+    free(recorder.filename);
+    recorder.filename = NULL;
+}
+
+// Must be called before anything in the match uses the rng
+void replay_record_match_start(int arena_id) {
+    if(recorder.filename == NULL) {
+        return;
+    }
+    if(recorder.recording) {
+        replay_free(&recorder.rep);
+    }
+    replay_create(&recorder.rep);
+    recorder.rep.seed = rand_get_seed();
+    recorder.rep.arena_id = arena_id;
+    for(int i = 0; i < 2; i++) {
+        game_player *player = game_state_get_player(i);
+        recorder.rep.players[i].har_id = player->har_id;
+        recorder.rep.players[i].pilot_id = player->pilot_id;
+        memcpy(recorder.rep.players[i].colors, player->colors, 3);
+    }
+    recorder.recording = 1;
+}
+
+void replay_record_action(int player, int action) {
+    if(recorder.recording) {
+        replay_add(&recorder.rep, recorder.rep.ticks, player, action);
+    }
+}
+
+// Call after all actions of the tick have been recorded
+void replay_record_tick() {
+    if(recorder.recording) {
+        recorder.rep.ticks++;
+    }
+}
+
+void replay_record_match_end() {
+    if(!recorder.recording) {
+        return;
+    }
+    replay_save(&recorder.rep, recorder.filename);
+    replay_free(&recorder.rep);
+    recorder.recording = 0;
+}
@@ -0,0 +1,444 @@
+#include <stdlib.h>
+#include <string.h>
+#include "game/rollback.h"
+#include "utils/log.h"
+
+#define NO_REWIND 0xFFFFFFFF
+
+static rollback *active = NULL;
+
+static void write_u32(char *buf, uint32_t v) {
+    for(int i = 0; i < 4; i++) {
+        buf[i] = (v >> (i * 8)) & 0xFF;
+    }
+}
+
+static uint32_t read_u32(const char *buf) {
+    const unsigned char *p = (const unsigned char*)buf;
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Returns the packet length
+int rollback_packet_write(char *buf, const rollback_packet_info *info, const rollback_input *inputs, int count) {
+    write_u32(buf, info->ack);
+    write_u32(buf + 4, info->first);
+    write_u32(buf + 8, info->check_tick);
+    write_u32(buf + 12, info->checksum);
+    buf[16] = count;
+    memcpy(buf + ROLLBACK_PACKET_HEADER, inputs, count);
+    return ROLLBACK_PACKET_HEADER + count;
+}
+
+// Returns the amount of inputs, or -1 if the packet is broken
+int rollback_packet_read(const char *buf, int len, rollback_packet_info *info, rollback_input *inputs) {
+    if(len < ROLLBACK_PACKET_HEADER) {
+        return -1;
+    }
+    int count = (unsigned char)buf[16];
+    if(count > ROLLBACK_MAX_INPUTS || len != ROLLBACK_PACKET_HEADER + count) {
+        return -1;
+    }
+    info->ack = read_u32(buf);
+    info->first = read_u32(buf + 4);
+    info->check_tick = read_u32(buf + 8);
+    info->checksum = read_u32(buf + 12);
+    memcpy(inputs, buf + ROLLBACK_PACKET_HEADER, count);
+    return count;
+}
+
+// Returns the frame for the given tick, clearing it if the slot still holds an older tick
+static rollback_frame* rollback_frame_get(rollback *rb, uint32_t tick) {
+    rollback_frame *f = &rb->frames[tick % ROLLBACK_RING];
+    if(f->tick != tick) {
+        f->tick = tick;
+        f->input[0] = 0;
+        f->input[1] = 0;
+        f->predicted = 0;
+        f->known[0] = 0;
+        f->known[1] = 0;
+        f->saved = 0;
+    }
+    return f;
+}
+
+// Sends all the local input the peer has not acknowledged yet, along with
+// our own ack. This is done every tick, so a lost packet is simply replaced
+// by the next one. End is the tick after the newest local input.
+// The checksum of the newest state that can no longer be rolled back
+// rides along, so that the peer can tell if we have desynced.
+static int rollback_send_inputs(rollback *rb, uint32_t end) {
+    rollback_input inputs[ROLLBACK_MAX_INPUTS];
+    char buf[ROLLBACK_PACKET_MAX];
+    rollback_packet_info info;
+    int count = 0;
+    for(uint32_t t = rb->acked; t < end && count < ROLLBACK_MAX_INPUTS; t++) {
+        inputs[count++] = rb->frames[t % ROLLBACK_RING].input[rb->local];
+    }
+    info.ack = rb->confirmed;
+    info.first = rb->acked;
+    info.check_tick = ROLLBACK_NO_TICK;
+    info.checksum = 0;
+    rollback_frame *f = rollback_get_final(rb);
+    if(rb->sim.checksum != NULL && f != NULL) {
+        info.check_tick = f->tick;
+        info.checksum = f->checksum;
+    }
+    int len = rollback_packet_write(buf, &info, inputs, count);
+    rb->stats.packets++;
+    rb->stats.bytes += len;
+    return rb->net.send(rb->net.userdata, buf, len);
+}
+
+// Remote input for ticks we have no input for is predicted to be the same as
+// the last confirmed input; players mostly hold their controls for a while.
+static rollback_input rollback_predict(rollback *rb) {
+    if(rb->confirmed == 0) {
+        return 0;
+    }
+    rollback_frame *f = &rb->frames[(rb->confirmed - 1) % ROLLBACK_RING];
+    return f->input[!rb->local];
+}
+
+static void rollback_handle_input(rollback *rb, uint32_t tick, rollback_input input) {
+    int remote = !rb->local;
+
+    // Already have this one, or it is too far ahead to fit in the ring
+    if(tick < rb->confirmed) {
+        return;
+    }
+    if((int)(tick - rb->tick) >= ROLLBACK_RING - rb->window) {
+        DEBUG("Rollback: input for tick %u is too far ahead, dropping.", tick);
+        return;
+    }
+    rollback_frame *f = rollback_frame_get(rb, tick);
+    f->input[remote] = input;
+    f->known[remote] = 1;
+}
+
+static void rollback_handle_packet(rollback *rb, const char *buf, int len) {
+    rollback_input inputs[ROLLBACK_MAX_INPUTS];
+    rollback_packet_info info;
+    int count = rollback_packet_read(buf, len, &info, inputs);
+    if(count < 0) {
+        DEBUG("Rollback: ignoring broken packet of %d bytes.", len);
+        return;
+    }
+
+    // Packets may come in any order, so the ack only ever moves forwards
+    if(info.ack > rb->acked && info.ack <= rb->tick + rb->delay) {
+        rb->acked = info.ack;
+    }
+    for(int i = 0; i < count; i++) {
+        rollback_handle_input(rb, info.first + i, inputs[i]);
+    }
+
+    // Peer checksum is compared once our own state for that tick is final
+    if(info.check_tick != ROLLBACK_NO_TICK) {
+        rollback_check *c = &rb->checks[info.check_tick % ROLLBACK_CHECKS];
+        c->tick = info.check_tick;
+        c->checksum = info.checksum;
+    }
+
+    // Move the confirmed point forwards. Any tick we already simulated with
+    // a prediction that turned out wrong needs to be simulated again.
+    int remote = !rb->local;
+    while(1) {
+        rollback_frame *f = &rb->frames[rb->confirmed % ROLLBACK_RING];
+        if(f->tick != rb->confirmed || !f->known[remote]) {
+            break;
+        }
+        if(rb->confirmed < rb->tick && f->predicted != f->input[remote] && rb->confirmed < rb->rewind) {
+            rb->rewind = rb->confirmed;
+        }
+        rb->confirmed++;
+    }
+}
+
+static int rollback_save(rollback *rb, rollback_frame *f) {
+    unsigned int size = rb->sim.save_size(rb->sim.userdata);
+    if(size > f->state_alloc) {
+        char *state = realloc(f->state, size);
+        if(state == NULL) {
+            PERROR("Rollback: unable to allocate %u bytes for tick %u state!", size, f->tick);
+            return 1;
+        }
+        f->state = state;
+        f->state_alloc = size;
+    }
+    if(rb->sim.save(rb->sim.userdata, f->state, size)) {
+        PERROR("Rollback: unable to save state of tick %u!", f->tick);
+        return 1;
+    }
+    f->state_size = size;
+    f->saved = 1;
+    if(rb->sim.checksum != NULL) {
+        f->checksum = rb->sim.checksum(rb->sim.userdata);
+    }
+    return 0;
+}
+
+// Compares peer checksums against our own states that can no longer change.
+// Only the first differing tick is reported; everything after it differs too.
+static void rollback_verify(rollback *rb) {
+    if(rb->sim.checksum == NULL) {
+        return;
+    }
+    for(int i = 0; i < ROLLBACK_CHECKS; i++) {
+        rollback_check *c = &rb->checks[i];
+        if(c->tick == ROLLBACK_NO_TICK || c->tick > rb->confirmed || c->tick >= rb->tick) {
+            continue;
+        }
+        rollback_frame *f = &rb->frames[c->tick % ROLLBACK_RING];
+        if(f->tick == c->tick && f->saved) {
+            rb->stats.checks++;
+            if(f->checksum != c->checksum && c->tick < rb->desync) {
+                if(rb->desync == ROLLBACK_NO_TICK) {
+                    PERROR("Rollback: desync with peer at tick %u! (ours 0x%08x, peer 0x%08x)",
+                        c->tick, f->checksum, c->checksum);
+                }
+                rb->desync = c->tick;
+            }
+        }
+        c->tick = ROLLBACK_NO_TICK;
+    }
+}
+
+static void rollback_run(rollback *rb, uint32_t tick, int resimulating) {
+    rollback_frame *f = rollback_frame_get(rb, tick);
+    if(f->known[!rb->local]) {
+        f->predicted = f->input[!rb->local];
+    } else {
+        f->predicted = rollback_predict(rb);
+    }
+    rb->current = tick;
+    rb->sim.advance(rb->sim.userdata, resimulating);
+}
+
+// Restores the state before the first mispredicted tick, and runs
+// everything after that again with the inputs we have now.
+static int rollback_resimulate(rollback *rb) {
+    uint32_t from = rb->rewind;
+    rb->rewind = NO_REWIND;
+
+    rollback_frame *f = &rb->frames[from % ROLLBACK_RING];
+    if(f->tick != from || !f->saved) {
+        PERROR("Rollback: no saved state for tick %u!", from);
+        return 1;
+    }
+    if(rb->sim.load(rb->sim.userdata, f->state, f->state_size)) {
+        PERROR("Rollback: unable to restore state of tick %u!", from);
+        return 1;
+    }
+
+    unsigned int depth = rb->tick - from;
+    rb->stats.rollbacks++;
+    rb->stats.resimulated += depth;
+    if(depth > rb->stats.max_depth) {
+        rb->stats.max_depth = depth;
+    }
+
+    for(uint32_t t = from; t < rb->tick; t++) {
+        if(t > from && rollback_save(rb, rollback_frame_get(rb, t))) {
+            return 1;
+        }
+        rollback_run(rb, t, 1);
+    }
+    return 0;
+}
+
+int rollback_create(rollback *rb, const rollback_sim *sim, const rollback_transport *net, int local, int delay, int window) {
+    memset(rb, 0, sizeof(rollback));
+    rb->sim = *sim;
+    rb->net = *net;
+    rb->local = local;
+    rb->delay = delay;
+    rb->window = window;
+    rb->rewind = NO_REWIND;
+    rb->desync = ROLLBACK_NO_TICK;
+    for(int i = 0; i < ROLLBACK_CHECKS; i++) {
+        rb->checks[i].tick = ROLLBACK_NO_TICK;
+    }
+    if(rb->delay < 0) rb->delay = 0;
+    if(rb->delay > ROLLBACK_MAX_DELAY) rb->delay = ROLLBACK_MAX_DELAY;
+    if(rb->window < 1) rb->window = 1;
+    if(rb->window > ROLLBACK_MAX_WINDOW) rb->window = ROLLBACK_MAX_WINDOW;
+    for(int i = 0; i < ROLLBACK_RING; i++) {
+        rb->frames[i].tick = i + 1; // Anything but the tick the slot is used for first
+    }
+
+    // Nothing is read for the ticks before the input delay has passed, so
+    // those are empty. They are sent too, so that the peer can use another delay.
+    for(int t = 0; t < rb->delay; t++) {
+        rollback_frame *f = rollback_frame_get(rb, t);
+        f->known[local] = 1;
+    }
+    DEBUG("Rollback: session created for player %d, input delay %d, window %d.",
+        local+1, rb->delay, rb->window);
+    return 0;
+}
+
+void rollback_free(rollback *rb) {
+    if(active == rb) {
+        active = NULL;
+    }
+    for(int i = 0; i < ROLLBACK_RING; i++) {
+        free(rb->frames[i].state);
+        rb->frames[i].state = NULL;
+    }
+}
+
+// Runs the session for one tick of wall clock time. Returns 0 if a tick
+// was simulated, 1 if we are waiting for the peer, and -1 on error.
+int rollback_tick(rollback *rb) {
+    char buf[ROLLBACK_PACKET_MAX];
+    int len;
+
+    if(rb->disconnected) {
+        return -1;
+    }
+
+    // Get whatever the peer has sent
+    while((len = rb->net.recv(rb->net.userdata, buf, sizeof(buf))) > 0) {
+        rollback_handle_packet(rb, buf, len);
+    }
+    if(len < 0) {
+        DEBUG("Rollback: peer disconnected.");
+        rb->disconnected = 1;
+        return -1;
+    }
+
+    // Late input that disagrees with what we guessed
+    if(rb->rewind < rb->tick && rollback_resimulate(rb)) {
+        return -1;
+    }
+    rollback_verify(rb);
+
+    // Don't get further ahead of the peer than we can roll back. Keep sending
+    // while we wait, in case the peer is waiting for input that got lost.
+    if((int)(rb->tick - rb->confirmed) >= rb->window) {
+        rb->stats.stalls++;
+        if(rollback_send_inputs(rb, rb->tick + rb->delay)) {
+            PERROR("Rollback: unable to send input to peer!");
+            return -1;
+        }
+        return 1;
+    }
+
+    // Local input is scheduled in the future, and sent to the peer right away
+    rollback_input input = rb->sim.poll(rb->sim.userdata);
+    rollback_frame *f = rollback_frame_get(rb, rb->tick + rb->delay);
+    f->input[rb->local] = input;
+    f->known[rb->local] = 1;
+    if(rollback_send_inputs(rb, rb->tick + rb->delay + 1)) {
+        PERROR("Rollback: unable to send input to peer!");
+        return -1;
+    }
+
+    // Save state for rolling back to this tick, and run it
+    if(rollback_save(rb, rollback_frame_get(rb, rb->tick))) {
+        return -1;
+    }
+    rollback_run(rb, rb->tick, 0);
+    rb->tick++;
+    return 0;
+}
+
+// Returns the input of a player for the tick being simulated.
+// For the remote player, this may be a prediction.
+rollback_input rollback_get_input(rollback *rb, int player) {
+    rollback_frame *f = &rb->frames[rb->current % ROLLBACK_RING];
+    if(f->tick != rb->current) {
+        return 0;
+    }
+    if(f->known[player]) {
+        return f->input[player];
+    }
+    return f->predicted;
+}
+
+// Returns the newest saved state that can no longer be rolled back, or NULL
+rollback_frame* rollback_get_final(rollback *rb) {
+    if(rb->tick == 0) {
+        return NULL;
+    }
+    uint32_t final = (rb->confirmed < rb->tick) ? rb->confirmed : rb->tick - 1;
+    rollback_frame *f = &rb->frames[final % ROLLBACK_RING];
+    if(f->tick != final || !f->saved) {
+        return NULL;
+    }
+    return f;
+}
+
+uint32_t rollback_get_tick(rollback *rb) {
+    return rb->current;
+}
+
+void rollback_set_active(rollback *rb) {
+    active = rb;
+}
+
+rollback* rollback_get_active() {
+    return active;
+}
+
+// -------- Loopback transport --------
+
+static int rollback_loopback_send(void *userdata, const char *buf, unsigned int len) {
+    rollback_loopback_end *end = userdata;
+    rollback_loopback *lb = end->lb;
+    rollback_loopback_queue *q = &lb->queues[!end->side];
+    if(q->count >= ROLLBACK_LOOPBACK_QUEUE || len > ROLLBACK_PACKET_MAX) {
+        return 1;
+    }
+
+    // Lost packets are not an error; the sender just never hears of them
+    lb->seed = lb->seed * 1103515245u + 12345u;
+    if((int)((lb->seed >> 16) % 100) < lb->loss) {
+        return 0;
+    }
+    rollback_packet *p = &q->packets[(q->head + q->count) % ROLLBACK_LOOPBACK_QUEUE];
+    p->deliver = lb->now + lb->latency;
+    p->len = len;
+    memcpy(p->data, buf, len);
+    q->count++;
+    return 0;
+}
+
+static int rollback_loopback_recv(void *userdata, char *buf, unsigned int size) {
+    rollback_loopback_end *end = userdata;
+    rollback_loopback *lb = end->lb;
+    rollback_loopback_queue *q = &lb->queues[end->side];
+    if(q->count == 0) {
+        return 0;
+    }
+    rollback_packet *p = &q->packets[q->head];
+    if((int)(p->deliver - lb->now) > 0 || p->len > size) {
+        return 0;
+    }
+    memcpy(buf, p->data, p->len);
+    q->head = (q->head + 1) % ROLLBACK_LOOPBACK_QUEUE;
+    q->count--;
+    return p->len;
+}
+
+void rollback_loopback_create(rollback_loopback *lb, int latency, int loss) {
+    memset(lb, 0, sizeof(rollback_loopback));
+    lb->latency = latency;
+    lb->loss = loss;
+    lb->seed = 1;
+    for(int i = 0; i < 2; i++) {
+        lb->ends[i].lb = lb;
+        lb->ends[i].side = i;
+    }
+}
+
+void rollback_loopback_transport(rollback_loopback *lb, int side, rollback_transport *net) {
+    net->userdata = &lb->ends[side];
+    net->send = &rollback_loopback_send;
+    net->recv = &rollback_loopback_recv;
+}
+
+// Packets sent before this are one tick closer to being delivered
+void rollback_loopback_tick(rollback_loopback *lb) {
+    lb->now++;
+}
@@ -0,0 +1,68 @@
+#include "game/scene_loader.h"
+#include "resources/bk_loader.h"
+#include "resources/ids.h"
+#include "utils/log.h"
+
+static int scene_loader_run(void *userdata) {
+    scene_loader *loader = userdata;
+    loader->failed = load_bk_file(&loader->bk_data, loader->scene_id);
+    SDL_AtomicSet(&loader->done, 1);
+    return 0;
+}
+
+void scene_loader_create(scene_loader *loader) {
+    loader->thread = NULL;
+    loader->scene_id = SCENE_NONE;
+    loader->failed = 0;
+    SDL_AtomicSet(&loader->done, 0);
+}
+
+// Starts loading the BK file of the given scene. Returns 1 if no thread could be started.
+int scene_loader_start(scene_loader *loader, int scene_id) {
+    if(loader->thread != NULL) {
+        scene_loader_cancel(loader);
+    }
+    loader->scene_id = scene_id;
+    loader->failed = 0;
+    SDL_AtomicSet(&loader->done, 0);
+    loader->thread = SDL_CreateThread(scene_loader_run, "scene loader", loader);
+    if(loader->thread == NULL) {
+        PERROR("Could not create scene loader thread: %s", SDL_GetError());
+        loader->scene_id = SCENE_NONE;
+        return 1;
+    }
+    DEBUG("Started loading BK file %s (%d).", get_id_name(scene_id), scene_id);
+    return 0;
+}
+
+int scene_loader_is_loading(scene_loader *loader, int scene_id) {
+    return (loader->thread != NULL && loader->scene_id == scene_id);
+}
+
+int scene_loader_ready(scene_loader *loader) {
+    return (loader->thread != NULL && SDL_AtomicGet(&loader->done));
+}
+
+// Waits for the loader to finish and hands the BK data over to the caller.
+// Returns 1 if loading failed.
+int scene_loader_finish(scene_loader *loader, bk *bk_data) {
+    if(loader->thread == NULL) {
+        return 1;
+    }
+    SDL_WaitThread(loader->thread, NULL);
+    loader->thread = NULL;
+    loader->scene_id = SCENE_NONE;
+    if(loader->failed) {
+        return 1;
+    }
+    *bk_data = loader->bk_data;
+    return 0;
+}
+
+// Waits for the loader to finish and throws away the results.
+void scene_loader_cancel(scene_loader *loader) {
+    bk tmp;
+    if(scene_loader_finish(loader, &tmp) == 0) {
+        bk_free(&tmp);
+    }
+}
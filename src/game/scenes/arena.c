@@ -26,6 +26,10 @@
 #include "game/menu/textslider.h"
 #include "controller/controller.h"
 #include "controller/net_controller.h"
+#include "controller/replay_controller.h"
+#include "game/replay.h"
+#include "game/netplay.h"
+#include "utils/random.h"
 #include "resources/ids.h"
 #include "utils/log.h"
 
@@ -111,6 +115,7 @@ void scene_fight_anim_start(void *userdata) {
     object_set_stl(fight, bk_get_stl(&scene->bk_data));
     object_set_palette(fight, bk_get_palette(&scene->bk_data, 0), 0);
     object_set_animation(fight, fight_ani);
+    object_set_type(fight, OBJECT_TYPE_FIGHT);
     object_set_finish_cb(fight, scene_fight_anim_done);
     game_state_add_object(fight, RENDER_LAYER_TOP);
 }
@@ -140,6 +145,7 @@ void scene_youwin_anim_start(void *userdata) {
     object_set_stl(youwin, bk_get_stl(&scene->bk_data));
     object_set_palette(youwin, bk_get_palette(&scene->bk_data, 0), 0);
     object_set_animation(youwin, youwin_ani);
+    object_set_type(youwin, OBJECT_TYPE_YOUWIN);
     object_set_finish_cb(youwin, scene_youwin_anim_done);
     game_state_add_object(youwin, RENDER_LAYER_TOP);
 
@@ -163,6 +169,7 @@ void scene_youlose_anim_start(void *userdata) {
     object_set_stl(youlose, bk_get_stl(&scene->bk_data));
     object_set_palette(youlose, bk_get_palette(&scene->bk_data, 0), 0);
     object_set_animation(youlose, youlose_ani);
+    object_set_type(youlose, OBJECT_TYPE_YOULOSE);
     object_set_finish_cb(youlose, scene_youlose_anim_done);
     game_state_add_object(youlose, RENDER_LAYER_TOP);
 
@@ -205,12 +212,56 @@ void arena_free(scene *scene) {
 
     free(local->player_palettes[0]);
     free(local->player_palettes[1]);
+
+    // Write out the replay, if we were recording
+    replay_record_match_end();
     
     settings_save();
     
     free(local);
 }
 
+// Simulation state of the arena, apart from its objects. The menu is local UI
+// and stays as it is.
+typedef struct arena_record_t {
+    unsigned int state;
+    int scores[2];
+    int consecutive_hits[2];
+    int combo_hits[2];
+} arena_record;
+
+unsigned int arena_serialize(scene *scene, char *buf) {
+    if(buf != NULL) {
+        arena_local *local = scene_get_userdata(scene);
+        arena_record *rec = (arena_record*)buf;
+        chr_score *scores[2] = {&local->player1_score, &local->player2_score};
+        rec->state = local->state;
+        for(int i = 0; i < 2; i++) {
+            rec->scores[i] = scores[i]->score;
+            rec->consecutive_hits[i] = scores[i]->consecutive_hits;
+            rec->combo_hits[i] = scores[i]->combo_hits;
+        }
+    }
+    return sizeof(arena_record);
+}
+
+int arena_unserialize(scene *scene, const char *buf) {
+    arena_local *local = scene_get_userdata(scene);
+    const arena_record *rec = (const arena_record*)buf;
+    chr_score *scores[2] = {&local->player1_score, &local->player2_score};
+    local->state = rec->state;
+    for(int i = 0; i < 2; i++) {
+        scores[i]->score = rec->scores[i];
+        scores[i]->consecutive_hits = rec->consecutive_hits[i];
+        scores[i]->combo_hits = rec->combo_hits[i];
+    }
+    return 0;
+}
+
+static int arena_is_local_ctrl(controller *ctrl) {
+    return ctrl->type == CTRL_TYPE_KEYBOARD || ctrl->type == CTRL_TYPE_GAMEPAD;
+}
+
 void arena_tick(scene *scene) {
     arena_local *local = scene_get_userdata(scene);
 
@@ -218,61 +269,58 @@ void arena_tick(scene *scene) {
     chr_score_tick(&local->player1_score);
     chr_score_tick(&local->player2_score);
 
-    // Handle menu, if visible
-    if(!local->menu_visible) {
-        // Turn the HARs to face the enemy
-        object *obj_har1,*obj_har2;
-        obj_har1 = game_player_get_har(game_state_get_player(0));
-        obj_har2 = game_player_get_har(game_state_get_player(1));
-        har *har1, *har2;
-        har1 = obj_har1->userdata;
-        har2 = obj_har2->userdata;
-        if (
-                (har1->state == STATE_STANDING || har1->state == STATE_CROUCHING || har1->state == STATE_WALKING || har1->state == STATE_STUNNED) &&
-                (har2->state == STATE_STANDING || har2->state == STATE_CROUCHING || har2->state == STATE_WALKING || har2->state == STATE_STUNNED)) {
-            // XXX if the other har is stunned, turn the non stunned HAR to face it, but never turn a stunned HAR
-            vec2i pos1, pos2;
-            pos1 = object_get_pos(obj_har1);
-            pos2 = object_get_pos(obj_har2);
-            if(pos1.x > pos2.x) {
-                if(object_get_direction(obj_har1) == OBJECT_FACE_RIGHT || object_get_direction(obj_har2) == OBJECT_FACE_LEFT) {
-                    if (har1->state != STATE_STUNNED) {
-                        object_set_direction(obj_har1, OBJECT_FACE_LEFT);
-                    }
-                    if (har2->state != STATE_STUNNED) {
-                        object_set_direction(obj_har2, OBJECT_FACE_RIGHT);
-                    }
+    // Turn the HARs to face the enemy
+    object *obj_har1,*obj_har2;
+    obj_har1 = game_player_get_har(game_state_get_player(0));
+    obj_har2 = game_player_get_har(game_state_get_player(1));
+    har *har1, *har2;
+    har1 = obj_har1->userdata;
+    har2 = obj_har2->userdata;
+    if (
+            (har1->state == STATE_STANDING || har1->state == STATE_CROUCHING || har1->state == STATE_WALKING || har1->state == STATE_STUNNED) &&
+            (har2->state == STATE_STANDING || har2->state == STATE_CROUCHING || har2->state == STATE_WALKING || har2->state == STATE_STUNNED)) {
+        // XXX if the other har is stunned, turn the non stunned HAR to face it, but never turn a stunned HAR
+        vec2i pos1, pos2;
+        pos1 = object_get_pos(obj_har1);
+        pos2 = object_get_pos(obj_har2);
+        if(pos1.x > pos2.x) {
+            if(object_get_direction(obj_har1) == OBJECT_FACE_RIGHT || object_get_direction(obj_har2) == OBJECT_FACE_LEFT) {
+                if (har1->state != STATE_STUNNED) {
+                    object_set_direction(obj_har1, OBJECT_FACE_LEFT);
+                }
+                if (har2->state != STATE_STUNNED) {
+                    object_set_direction(obj_har2, OBJECT_FACE_RIGHT);
                 }
-            } else if(pos1.x < pos2.x) {
-                if(object_get_direction(obj_har1) == OBJECT_FACE_LEFT || object_get_direction(obj_har2) == OBJECT_FACE_RIGHT) {
-                    if (har1->state != STATE_STUNNED) {
-                        object_set_direction(obj_har1, OBJECT_FACE_RIGHT);
-                    }
-                    if (har2->state != STATE_STUNNED) {
-                        object_set_direction(obj_har2, OBJECT_FACE_LEFT);
-                    }
+            }
+        } else if(pos1.x < pos2.x) {
+            if(object_get_direction(obj_har1) == OBJECT_FACE_LEFT || object_get_direction(obj_har2) == OBJECT_FACE_RIGHT) {
+                if (har1->state != STATE_STUNNED) {
+                    object_set_direction(obj_har1, OBJECT_FACE_RIGHT);
+                }
+                if (har2->state != STATE_STUNNED) {
+                    object_set_direction(obj_har2, OBJECT_FACE_LEFT);
                 }
             }
         }
+    }
 
-        // Display you win/lose animation
-        if(local->state != ARENA_STATE_ENDING) {
-
-            // Har victory animation
-            if(har2->health <= 0) {
-                scene_youwin_anim_start(NULL);
-                har_set_ani(obj_har1, ANIM_VICTORY, 1);
-                har_set_ani(obj_har2, ANIM_DEFEAT, 1);
-                har1->state = STATE_VICTORY;
-                har2->state = STATE_DEFEAT;
-            } else if(har1->health <= 0) {
-                scene_youlose_anim_start(NULL);
-                har_set_ani(obj_har2, ANIM_VICTORY, 1);
-                har_set_ani(obj_har1, ANIM_DEFEAT, 1);
-                har2->state = STATE_VICTORY;
-                har1->state = STATE_DEFEAT;
+    // Display you win/lose animation
+    if(local->state != ARENA_STATE_ENDING) {
+
+        // Har victory animation
+        if(har2->health <= 0) {
+            scene_youwin_anim_start(NULL);
+            har_set_ani(obj_har1, ANIM_VICTORY, 1);
+            har_set_ani(obj_har2, ANIM_DEFEAT, 1);
+            har1->state = STATE_VICTORY;
+            har2->state = STATE_DEFEAT;
+        } else if(har1->health <= 0) {
+            scene_youlose_anim_start(NULL);
+            har_set_ani(obj_har2, ANIM_VICTORY, 1);
+            har_set_ani(obj_har1, ANIM_DEFEAT, 1);
+            har2->state = STATE_VICTORY;
+            har1->state = STATE_DEFEAT;
 
-            }
         }
     }
 }
@@ -283,36 +331,53 @@ void arena_input_tick(scene *scene) {
     game_player *player1 = game_state_get_player(0);
     game_player *player2 = game_state_get_player(1);
 
-    if(!local->menu_visible) {
-        ctrl_event *p1 = NULL, *p2 = NULL, *i;
-        if(controller_tick(player1->ctrl, &p1) ||
-                controller_tick(player2->ctrl, &p2)) {
-            // one of the controllers bailed
+    ctrl_event *p1 = NULL, *p2 = NULL, *i;
+    if(controller_tick(player1->ctrl, &p1) ||
+            controller_tick(player2->ctrl, &p2)) {
+        // one of the controllers bailed
 
-            if(player1->ctrl->type == CTRL_TYPE_NETWORK) {
-                net_controller_free(player1->ctrl);
-            }
+        if(player1->ctrl->type == CTRL_TYPE_NETWORK) {
+            net_controller_free(player1->ctrl);
+        }
 
-            if(player2->ctrl->type == CTRL_TYPE_NETWORK) {
-                net_controller_free(player2->ctrl);
-            }
+        if(player2->ctrl->type == CTRL_TYPE_NETWORK) {
+            net_controller_free(player2->ctrl);
         }
+    }
 
-        i = p1;
-        if (i) {
-            do {
-                object_act(game_player_get_har(player1), i->action);
-            } while((i = i->next));
+    // While the menu is open, local players steer the menu instead of their HARs.
+    // Their input is dropped before it is acted on and recorded, so that the
+    // simulation keeps running the same way everywhere.
+    if(local->menu_visible) {
+        if(arena_is_local_ctrl(player1->ctrl)) {
+            controller_free_chain(p1);
+            p1 = NULL;
         }
-        controller_free_chain(p1);
-        i = p2;
-        if (i) {
-            do {
-                object_act(game_player_get_har(player2), i->action);
-            } while((i = i->next));
+        if(arena_is_local_ctrl(player2->ctrl)) {
+            controller_free_chain(p2);
+            p2 = NULL;
         }
-        controller_free_chain(p2);
     }
+
+    i = p1;
+    if (i) {
+        do {
+            replay_record_action(0, i->action);
+            object_act(game_player_get_har(player1), i->action);
+        } while((i = i->next));
+    }
+    controller_free_chain(p1);
+    i = p2;
+    if (i) {
+        do {
+            replay_record_action(1, i->action);
+            object_act(game_player_get_har(player2), i->action);
+        } while((i = i->next));
+    }
+    controller_free_chain(p2);
+
+    // Every simulated tick is recorded, so that playback stays in step
+    replay_record_tick();
 }
 
 int arena_event(scene *scene, SDL_Event *e) {
@@ -336,6 +401,19 @@ int arena_event(scene *scene, SDL_Event *e) {
     return 0;
 }
 
+// Connection quality for network matches, in the bottom left corner
+static void arena_render_net_stats() {
+    net_stats stats;
+    char tmp[64];
+    if(netplay_get_stats(&stats)) {
+        return;
+    }
+    sprintf(tmp, "RTT %ums +-%u LOSS %.1f%% DELAY %d", stats.rtt, stats.jitter, stats.loss, stats.input_delay);
+    font_render(&font_small, tmp, 5, 182, TEXT_COLOR);
+    sprintf(tmp, "IN %uB/S OUT %uB/S", stats.bytes_in, stats.bytes_out);
+    font_render(&font_small, tmp, 5, 189, TEXT_COLOR);
+}
+
 void arena_render_overlay(scene *scene) {
     arena_local *local = scene_get_userdata(scene);
 
@@ -382,6 +460,7 @@ void arena_render_overlay(scene *scene) {
         chr_score_format(&local->player2_score, tmp);
         font_render(&font_small, tmp, 315-s2len, 33, TEXT_COLOR);
     }
+    arena_render_net_stats();
 
     // Render menu (if visible)
     if(local->menu_visible) {
@@ -395,6 +474,11 @@ int arena_get_state(scene *scene) {
     return local->state;
 }
 
+int arena_is_menu_visible(scene *scene) {
+    arena_local *local = scene_get_userdata(scene);
+    return local->menu_visible;
+}
+
 void arena_set_state(scene *scene, int state) {
     arena_local *local = scene_get_userdata(scene);
     local->state = state;
@@ -411,6 +495,18 @@ int arena_create(scene *scene) {
 
     // Load up settings
     setting = settings_get();
+
+    // Replays start from the recorded rng state; recordings save the current one.
+    for(int i = 0; i < 2; i++) {
+        controller *ctrl = game_player_get_ctrl(game_state_get_player(i));
+        if(ctrl->type == CTRL_TYPE_REPLAY) {
+            rand_seed(replay_controller_get_seed(ctrl));
+        }
+    }
+    replay_record_match_start(scene->id);
+
+    // Timers of the arena can be in saved states
+    ticktimer_register(TICKTIMER_FIGHT_START, scene_fight_anim_start);
     
     // Handle music playback
     music_stop();
@@ -586,6 +682,7 @@ int arena_create(scene *scene) {
     object_set_stl(ready, scene->bk_data.sound_translation_table);
     object_set_palette(ready, bk_get_palette(&scene->bk_data, 0), 0);
     object_set_animation(ready, ready_ani);
+    object_set_type(ready, OBJECT_TYPE_READY);
     object_set_finish_cb(ready, scene_ready_anim_done);
     game_state_add_object(ready, RENDER_LAYER_TOP);
 
@@ -595,6 +692,8 @@ int arena_create(scene *scene) {
     scene_set_tick_cb(scene, arena_tick);
     scene_set_input_tick_cb(scene, arena_input_tick);
     scene_set_render_overlay_cb(scene, arena_render_overlay);
+    scene_set_serialize_cb(scene, arena_serialize);
+    scene_set_unserialize_cb(scene, arena_unserialize);
 
     // All done!
     return 0;
@@ -2,23 +2,20 @@
 #include "video/image.h"
 #include "video/video.h"
 
-void progressbar_create_block(progress_bar *bar) {
-    float prog = bar->percentage / 100.0f;
-    int w = bar->w * prog;
-    if(w > 0) {
-        image tmp;
-        image_create(&tmp, w, bar->h);
-        image_clear(&tmp, bar->int_bg_color);
-        image_rect_bevel(&tmp, 
-                         0, 0, w - 1, bar->h-1, 
-                         bar->int_topleft_color, 
-                         bar->int_bottomright_color, 
-                         bar->int_bottomright_color, 
-                         bar->int_topleft_color);
-        texture_create(&bar->block);
-        texture_init_from_img(&bar->block, &tmp);
-        image_free(&tmp);
-    }
+// The block is made once at full width. Narrower blocks are drawn from its
+// left part and its right edge, so changing the value needs no new texture.
+static void progressbar_create_block(progress_bar *bar) {
+    image tmp;
+    image_create(&tmp, bar->w, bar->h);
+    image_clear(&tmp, bar->int_bg_color);
+    image_rect_bevel(&tmp, 
+                     0, 0, bar->w - 1, bar->h-1, 
+                     bar->int_topleft_color, 
+                     bar->int_bottomright_color, 
+                     bar->int_bottomright_color, 
+                     bar->int_topleft_color);
+    texture_init_from_img(&bar->block, &tmp);
+    image_free(&tmp);
 }
 
 void progressbar_create(progress_bar *bar,     
@@ -37,6 +34,7 @@ void progressbar_create(progress_bar *bar,
     bar->h = h;
     bar->orientation = orientation;
     bar->percentage = 100;
+    bar->block_w = w;
     bar->int_topleft_color = int_topleft_color;
     bar->int_bottomright_color = int_bottomright_color;
     bar->int_bg_color = int_bg_color;
@@ -68,17 +66,19 @@ void progressbar_free(progress_bar *bar) {
 
 void progressbar_set(progress_bar *bar, unsigned int percentage) {
     bar->percentage = (percentage > 100 ? 100 : percentage);
-    texture_free(&bar->block);
-    progressbar_create_block(bar);
+    bar->block_w = bar->w * (bar->percentage / 100.0f);
 }
 
 void progressbar_render(progress_bar *bar) {
     video_render_sprite(&bar->background, bar->x, bar->y, BLEND_ALPHA_FULL);
-    if(bar->block.w > 0) {
-        video_render_sprite(
-            &bar->block, 
-            bar->x + (bar->orientation == PROGRESSBAR_LEFT ? 0 : bar->w - bar->block.w + 1), 
-            bar->y, 
-            BLEND_ALPHA_FULL);
+    if(bar->block_w == 0) {
+        return;
+    }
+    int x = bar->x + (bar->orientation == PROGRESSBAR_LEFT ? 0 : bar->w - bar->block_w + 1);
+    if(bar->block_w == 1) {
+        video_render_sprite_area(&bar->block, x, bar->y, 0, 0, 1, bar->h, BLEND_ALPHA_FULL);
+        return;
     }
+    video_render_sprite_area(&bar->block, x, bar->y, 0, 0, bar->block_w - 1, bar->h, BLEND_ALPHA_FULL);
+    video_render_sprite_area(&bar->block, x + bar->block_w - 1, bar->y, bar->w - 1, 0, 1, bar->h, BLEND_ALPHA_FULL);
 }
@@ -42,7 +42,9 @@ const field f_video[] = {
     F_BOOL(settings_video, vsync,           0),
     F_BOOL(settings_video, fullscreen,      0),
     F_INT(settings_video,  scaling,         0),
-    F_BOOL(settings_video, instant_console, 0)
+    F_BOOL(settings_video, instant_console, 0),
+    F_INT(settings_video,  fps_limit,     144),
+    F_BOOL(settings_video, software,        0)
 };
 
 const field f_sound[] = {
@@ -71,6 +73,12 @@ const field f_gameplay[] = {
     F_INT(settings_gameplay,  rounds,      1)
 };
 
+const field f_network[] = {
+    F_INT(settings_network, input_delay,     2),
+    F_INT(settings_network, rollback_window, 8),
+    F_INT(settings_network, spectate_port,   1338)
+};
+
 const field f_keyboard[] = {
     // Player one
     F_STRING(settings_keyboard, key1_up,    "Up"),
@@ -210,6 +218,7 @@ int settings_init(const char *path) {
     settings_add_fields(f_sound, NFIELDS(f_sound));
     settings_add_fields(f_gameplay, NFIELDS(f_gameplay));
     settings_add_fields(f_keyboard, NFIELDS(f_keyboard));
+    settings_add_fields(f_network, NFIELDS(f_network));
     return conf_init(settings_path);
 }
 
@@ -218,6 +227,7 @@ void settings_load() {
     settings_load_fields(&_settings.sound, f_sound, NFIELDS(f_sound));
     settings_load_fields(&_settings.gameplay, f_gameplay, NFIELDS(f_gameplay));
     settings_load_fields(&_settings.keys, f_keyboard, NFIELDS(f_keyboard));
+    settings_load_fields(&_settings.net, f_network, NFIELDS(f_network));
 }
 
 void settings_save() {
@@ -225,6 +235,7 @@ void settings_save() {
     settings_save_fields(&_settings.sound, f_sound, NFIELDS(f_sound));
     settings_save_fields(&_settings.gameplay, f_gameplay, NFIELDS(f_gameplay));
     settings_save_fields(&_settings.keys, f_keyboard, NFIELDS(f_keyboard));
+    settings_save_fields(&_settings.net, f_network, NFIELDS(f_network));
     if(conf_write_config(settings_path)) {
         PERROR("Failed to write config file!\n");
     }
@@ -235,6 +246,7 @@ void settings_free() {
     settings_free_strings(&_settings.sound, f_sound, NFIELDS(f_sound));
     settings_free_strings(&_settings.gameplay, f_gameplay, NFIELDS(f_gameplay));
     settings_free_strings(&_settings.keys, f_keyboard, NFIELDS(f_keyboard));
+    settings_free_strings(&_settings.net, f_network, NFIELDS(f_network));
     conf_close();
 }
 
@@ -0,0 +1,306 @@
+#include <stdlib.h>
+#include <string.h>
+#include "game/spectate.h"
+#include "utils/log.h"
+
+static void write_u32(char *buf, uint32_t v) {
+    for(int i = 0; i < 4; i++) {
+        buf[i] = (v >> (i * 8)) & 0xFF;
+    }
+}
+
+static uint32_t read_u32(const char *buf) {
+    const unsigned char *p = (const unsigned char*)buf;
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// -------- Host --------
+
+static int spectate_send(spectate_host *sh, spectate_viewer_conn *v, const char *buf, unsigned int len) {
+    sh->stats.packets++;
+    sh->stats.bytes += len;
+    return v->net.send(v->net.userdata, buf, len);
+}
+
+// Sends the setup and the newest state that can no longer be rolled back.
+// Returns 1 if there is no such state yet, and -1 if sending failed.
+static int spectate_send_join(spectate_host *sh, spectate_viewer_conn *v) {
+    char buf[SPECTATE_PACKET_MAX];
+    rollback_frame *f = rollback_get_final(sh->rb);
+    if(f == NULL) {
+        return 1;
+    }
+    if(f->state_size > SPECTATE_STATE_MAX) {
+        PERROR("Spectate: state of %u bytes is too big to send!", f->state_size);
+        return -1;
+    }
+
+    buf[0] = SPECTATE_SETUP;
+    memcpy(buf + 1, sh->setup, sh->setup_len);
+    if(spectate_send(sh, v, buf, 1 + sh->setup_len)) {
+        return -1;
+    }
+
+    // Big states are split into chunks; the transport keeps them in order
+    unsigned int offset = 0;
+    do {
+        unsigned int len = f->state_size - offset;
+        if(len > SPECTATE_CHUNK) {
+            len = SPECTATE_CHUNK;
+        }
+        buf[0] = SPECTATE_SNAPSHOT;
+        write_u32(buf + 1, f->tick);
+        write_u32(buf + 5, f->state_size);
+        write_u32(buf + 9, offset);
+        memcpy(buf + 13, f->state + offset, len);
+        if(spectate_send(sh, v, buf, 13 + len)) {
+            return -1;
+        }
+        offset += len;
+    } while(offset < f->state_size);
+
+    v->next = f->tick;
+    v->joined = 1;
+    DEBUG("Spectate: viewer joins at tick %u with %u bytes of state.", f->tick, f->state_size);
+    return 0;
+}
+
+// Sends the confirmed inputs the viewer does not have yet, a batch at a time
+static int spectate_send_inputs(spectate_host *sh, spectate_viewer_conn *v) {
+    char buf[SPECTATE_PACKET_MAX];
+    rollback *rb = sh->rb;
+
+    // Local input is only known up to the input delay
+    uint32_t end = rb->confirmed;
+    if(end > rb->tick + rb->delay) {
+        end = rb->tick + rb->delay;
+    }
+    while((int)(end - v->next) >= SPECTATE_BATCH) {
+        int count = end - v->next;
+        if(count > SPECTATE_MAX_INPUTS) {
+            count = SPECTATE_MAX_INPUTS;
+        }
+        buf[0] = SPECTATE_INPUTS;
+        write_u32(buf + 1, v->next);
+        buf[5] = count;
+        for(int i = 0; i < count; i++) {
+            rollback_frame *f = &rb->frames[(v->next + i) % ROLLBACK_RING];
+            if(f->tick != v->next + i) {
+                PERROR("Spectate: input for tick %u is gone!", v->next + i);
+                return -1;
+            }
+            buf[6 + i * 2] = f->input[0];
+            buf[7 + i * 2] = f->input[1];
+        }
+        if(spectate_send(sh, v, buf, 6 + count * 2)) {
+            return -1;
+        }
+        v->next += count;
+    }
+    return 0;
+}
+
+void spectate_host_create(spectate_host *sh, rollback *rb, const char *setup, unsigned int setup_len) {
+    memset(sh, 0, sizeof(spectate_host));
+    sh->rb = rb;
+    if(setup_len > SPECTATE_SETUP_MAX) {
+        PERROR("Spectate: setup of %u bytes does not fit, cutting it short.", setup_len);
+        setup_len = SPECTATE_SETUP_MAX;
+    }
+    memcpy(sh->setup, setup, setup_len);
+    sh->setup_len = setup_len;
+}
+
+// Returns the viewer number, or -1 if there is no room
+int spectate_host_add(spectate_host *sh, const rollback_transport *net) {
+    for(int i = 0; i < SPECTATE_MAX_VIEWERS; i++) {
+        spectate_viewer_conn *v = &sh->viewers[i];
+        if(!v->active) {
+            v->net = *net;
+            v->active = 1;
+            v->joined = 0;
+            v->next = 0;
+            return i;
+        }
+    }
+    return -1;
+}
+
+void spectate_host_remove(spectate_host *sh, int viewer) {
+    sh->viewers[viewer].active = 0;
+}
+
+int spectate_host_count(spectate_host *sh) {
+    int count = 0;
+    for(int i = 0; i < SPECTATE_MAX_VIEWERS; i++) {
+        count += sh->viewers[i].active;
+    }
+    return count;
+}
+
+// Call after every tick of the session. Viewers that can't keep up are dropped.
+void spectate_host_tick(spectate_host *sh) {
+    for(int i = 0; i < SPECTATE_MAX_VIEWERS; i++) {
+        spectate_viewer_conn *v = &sh->viewers[i];
+        if(!v->active) {
+            continue;
+        }
+        if(!v->joined) {
+            int ret = spectate_send_join(sh, v);
+            if(ret > 0) {
+                continue;
+            }
+            if(ret < 0) {
+                PERROR("Spectate: unable to send snapshot to viewer %d, dropping.", i);
+                v->active = 0;
+                continue;
+            }
+        }
+        if(spectate_send_inputs(sh, v)) {
+            PERROR("Spectate: unable to send input to viewer %d, dropping.", i);
+            v->active = 0;
+        }
+    }
+}
+
+// -------- Viewer --------
+
+static int spectate_handle_snapshot(spectate_viewer *sv, const char *buf, int len) {
+    if(len < 13) {
+        return 1;
+    }
+    uint32_t tick = read_u32(buf + 1);
+    uint32_t size = read_u32(buf + 5);
+    uint32_t offset = read_u32(buf + 9);
+    unsigned int chunk = len - 13;
+
+    // First chunk of a new snapshot. Size comes from the network, so it is checked first.
+    if(offset == 0) {
+        if(size > SPECTATE_STATE_MAX) {
+            PERROR("Spectate: snapshot of %u bytes is too big!", size);
+            return 1;
+        }
+        char *state = realloc(sv->state, size);
+        if(state == NULL && size > 0) {
+            PERROR("Spectate: unable to allocate %u bytes for snapshot!", size);
+            return 1;
+        }
+        sv->state = state;
+        sv->state_size = size;
+        sv->state_received = 0;
+        sv->snapshot_tick = tick;
+    }
+    if(tick != sv->snapshot_tick || offset != sv->state_received || offset + chunk > sv->state_size) {
+        return 1;
+    }
+    memcpy(sv->state + offset, buf + 13, chunk);
+    sv->state_received += chunk;
+    if(sv->state_received < sv->state_size) {
+        return 0;
+    }
+
+    // Whole state is here; start watching from its tick
+    if(sv->setup_cb != NULL) {
+        sv->setup_cb(sv->sim.userdata, sv->setup, sv->setup_len);
+    }
+    if(sv->sim.load(sv->sim.userdata, sv->state, sv->state_size)) {
+        PERROR("Spectate: unable to load snapshot of tick %u!", tick);
+        return 1;
+    }
+    sv->tick = tick;
+    sv->received = tick;
+    sv->joined = 1;
+    DEBUG("Spectate: joined at tick %u.", tick);
+    return 0;
+}
+
+static int spectate_handle_inputs(spectate_viewer *sv, const char *buf, int len) {
+    if(len < 6) {
+        return 1;
+    }
+    uint32_t first = read_u32(buf + 1);
+    int count = (unsigned char)buf[5];
+    if(len != 6 + count * 2 || !sv->joined || first > sv->received) {
+        return 1;
+    }
+    if(first + count - sv->tick > SPECTATE_RING) {
+        PERROR("Spectate: fell more than %d ticks behind the match!", SPECTATE_RING);
+        return 1;
+    }
+    // Skip anything from before the snapshot
+    for(int i = sv->received - first; i < count; i++) {
+        rollback_input *in = sv->inputs[(first + i) % SPECTATE_RING];
+        in[0] = buf[6 + i * 2];
+        in[1] = buf[7 + i * 2];
+        sv->received++;
+    }
+    return 0;
+}
+
+static int spectate_handle_packet(spectate_viewer *sv, const char *buf, int len) {
+    switch(buf[0]) {
+        case SPECTATE_SETUP:
+            if(len - 1 > SPECTATE_SETUP_MAX) {
+                return 1;
+            }
+            memcpy(sv->setup, buf + 1, len - 1);
+            sv->setup_len = len - 1;
+            return 0;
+        case SPECTATE_SNAPSHOT:
+            return spectate_handle_snapshot(sv, buf, len);
+        case SPECTATE_INPUTS:
+            return spectate_handle_inputs(sv, buf, len);
+    }
+    return 1;
+}
+
+int spectate_viewer_create(spectate_viewer *sv, const rollback_sim *sim, const rollback_transport *net, spectate_setup_cb setup_cb) {
+    memset(sv, 0, sizeof(spectate_viewer));
+    sv->sim = *sim;
+    sv->net = *net;
+    sv->setup_cb = setup_cb;
+    return 0;
+}
+
+void spectate_viewer_free(spectate_viewer *sv) {
+    free(sv->state);
+    sv->state = NULL;
+}
+
+// Runs the match for one tick of wall clock time, or a few if we have fallen
+// behind. Returns 0 if a tick was simulated, 1 if we are waiting for the host,
+// and -1 on error or when the host is gone.
+int spectate_viewer_tick(spectate_viewer *sv) {
+    char buf[SPECTATE_PACKET_MAX];
+    int len;
+
+    while((len = sv->net.recv(sv->net.userdata, buf, sizeof(buf))) > 0) {
+        if(spectate_handle_packet(sv, buf, len)) {
+            PERROR("Spectate: bad packet from host!");
+            return -1;
+        }
+    }
+    if(len < 0) {
+        DEBUG("Spectate: host is gone.");
+        return -1;
+    }
+    if(!sv->joined || sv->tick == sv->received) {
+        return 1;
+    }
+
+    int steps = 1;
+    if(sv->received - sv->tick > SPECTATE_BATCH * 2) {
+        steps = SPECTATE_CATCHUP;
+    }
+    for(int i = 0; i < steps && sv->tick < sv->received; i++) {
+        sv->current = sv->tick;
+        sv->sim.advance(sv->sim.userdata, 0);
+        sv->tick++;
+    }
+    return 0;
+}
+
+// Returns the input of a player for the tick being simulated
+rollback_input spectate_get_input(spectate_viewer *sv, int player) {
+    return sv->inputs[sv->current % SPECTATE_RING][player];
+}
@@ -0,0 +1,176 @@
+#include <stdint.h>
+#include <string.h>
+#include "game/spectate_net.h"
+#include "utils/log.h"
+
+#define SPECTATE_CHANNEL 0
+
+// -------- Player end --------
+
+static int spectate_server_send(void *userdata, const char *buf, unsigned int len) {
+    ENetPeer *peer = userdata;
+    ENetPacket *packet = enet_packet_create(buf, len, ENET_PACKET_FLAG_RELIABLE);
+    if(packet == NULL) {
+        return 1;
+    }
+    if(enet_peer_send(peer, SPECTATE_CHANNEL, packet) < 0) {
+        enet_packet_destroy(packet);
+        return 1;
+    }
+    return 0;
+}
+
+// Viewers only listen, so there is never anything to receive from them
+static int spectate_server_recv(void *userdata, char *buf, unsigned int size) {
+    return 0;
+}
+
+int spectate_server_create(spectate_server *ss, rollback *rb, const char *setup, unsigned int setup_len, int port) {
+    ENetAddress address;
+    address.host = ENET_HOST_ANY;
+    address.port = port;
+    memset(ss->peers, 0, sizeof(ss->peers));
+    ss->host = enet_host_create(&address, SPECTATE_MAX_VIEWERS, 1, 0, 0);
+    if(ss->host == NULL) {
+        PERROR("Spectate: unable to take viewers on port %d!", port);
+        return 1;
+    }
+    spectate_host_create(&ss->sh, rb, setup, setup_len);
+    INFO("Spectate: taking viewers on port %d.", port);
+    return 0;
+}
+
+void spectate_server_free(spectate_server *ss) {
+    for(int i = 0; i < SPECTATE_MAX_VIEWERS; i++) {
+        if(ss->peers[i] != NULL) {
+            enet_peer_disconnect(ss->peers[i], 0);
+        }
+    }
+    enet_host_flush(ss->host);
+    enet_host_destroy(ss->host);
+    ss->host = NULL;
+}
+
+static void spectate_server_accept(spectate_server *ss, ENetPeer *peer) {
+    rollback_transport net;
+    net.userdata = peer;
+    net.send = &spectate_server_send;
+    net.recv = &spectate_server_recv;
+    int viewer = spectate_host_add(&ss->sh, &net);
+    if(viewer < 0) {
+        DEBUG("Spectate: no room for viewer %x:%u.", peer->address.host, peer->address.port);
+        enet_peer_disconnect(peer, 0);
+        return;
+    }
+    ss->peers[viewer] = peer;
+    peer->data = (void*)(intptr_t)(viewer + 1);
+    INFO("Spectate: viewer %d connected from %x:%u.", viewer, peer->address.host, peer->address.port);
+}
+
+void spectate_server_tick(spectate_server *ss) {
+    ENetEvent event;
+    while(enet_host_service(ss->host, &event, 0) > 0) {
+        int viewer = (int)(intptr_t)event.peer->data - 1;
+        switch(event.type) {
+            case ENET_EVENT_TYPE_CONNECT:
+                spectate_server_accept(ss, event.peer);
+                break;
+            case ENET_EVENT_TYPE_DISCONNECT:
+                if(viewer >= 0) {
+                    INFO("Spectate: viewer %d left.", viewer);
+                    spectate_host_remove(&ss->sh, viewer);
+                    ss->peers[viewer] = NULL;
+                }
+                event.peer->data = NULL;
+                break;
+            case ENET_EVENT_TYPE_RECEIVE:
+                enet_packet_destroy(event.packet);
+                break;
+            default:
+                break;
+        }
+    }
+
+    spectate_host_tick(&ss->sh);
+
+    // Viewers the host gave up on are let go
+    for(int i = 0; i < SPECTATE_MAX_VIEWERS; i++) {
+        if(ss->peers[i] != NULL && !ss->sh.viewers[i].active) {
+            enet_peer_disconnect(ss->peers[i], 0);
+            ss->peers[i]->data = NULL;
+            ss->peers[i] = NULL;
+        }
+    }
+    enet_host_flush(ss->host);
+}
+
+// -------- Viewer end --------
+
+int spectate_client_connect(spectate_client *sc, const char *addr, int port) {
+    ENetAddress address;
+    ENetEvent event;
+    sc->gone = 0;
+    sc->host = enet_host_create(NULL, 1, 1, 0, 0);
+    if(sc->host == NULL) {
+        PERROR("Spectate: unable to create ENet host!");
+        return 1;
+    }
+    enet_address_set_host(&address, addr);
+    address.port = port;
+    sc->peer = enet_host_connect(sc->host, &address, 1, 0);
+    if(sc->peer == NULL) {
+        PERROR("Spectate: unable to connect to %s:%d!", addr, port);
+        enet_host_destroy(sc->host);
+        return 1;
+    }
+    if(enet_host_service(sc->host, &event, SPECTATE_CONNECT_TIMEOUT) > 0 && event.type == ENET_EVENT_TYPE_CONNECT) {
+        INFO("Spectate: connected to %s:%d.", addr, port);
+        return 0;
+    }
+    PERROR("Spectate: connection to %s:%d failed!", addr, port);
+    enet_peer_reset(sc->peer);
+    enet_host_destroy(sc->host);
+    return 1;
+}
+
+void spectate_client_free(spectate_client *sc) {
+    if(!sc->gone) {
+        enet_peer_disconnect(sc->peer, 0);
+        enet_host_flush(sc->host);
+    }
+    enet_host_destroy(sc->host);
+    sc->host = NULL;
+}
+
+// Players do not listen to their viewers
+static int spectate_client_send(void *userdata, const char *buf, unsigned int len) {
+    return 1;
+}
+
+static int spectate_client_recv(void *userdata, char *buf, unsigned int size) {
+    spectate_client *sc = userdata;
+    ENetEvent event;
+    while(!sc->gone && enet_host_service(sc->host, &event, 0) > 0) {
+        if(event.type == ENET_EVENT_TYPE_DISCONNECT) {
+            sc->gone = 1;
+        } else if(event.type == ENET_EVENT_TYPE_RECEIVE) {
+            // Stream is in order, so a packet that does not fit breaks it
+            int len = event.packet->dataLength;
+            if(len <= size) {
+                memcpy(buf, event.packet->data, len);
+            } else {
+                PERROR("Spectate: packet of %d bytes does not fit!", len);
+                len = -1;
+            }
+            enet_packet_destroy(event.packet);
+            return len;
+        }
+    }
+    return sc->gone ? -1 : 0;
+}
+
+void spectate_client_transport(spectate_client *sc, rollback_transport *net) {
+    net->userdata = sc;
+    net->send = &spectate_client_send;
+    net->recv = &spectate_client_recv;
+}
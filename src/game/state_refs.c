@@ -0,0 +1,135 @@
+#include <string.h>
+#include "game/state_refs.h"
+
+void state_refs_create(state_refs *refs) {
+    memset(refs, 0, sizeof(state_refs));
+}
+
+void state_refs_set_source(state_refs *refs, int source, void *file, state_animation_cb animation, palette *pal, char *stl) {
+    state_source *src = &refs->sources[source];
+    src->file = file;
+    src->animation = animation;
+    src->pal = pal;
+    src->stl = stl;
+}
+
+static int state_refs_find_animation(state_refs *refs, animation *ani) {
+    for(int i = 0; i < STATE_SOURCES; i++) {
+        state_source *src = &refs->sources[i];
+        if(src->file != NULL && src->animation(src->file, ani->id) == ani) {
+            return i;
+        }
+    }
+    return STATE_SOURCE_NONE;
+}
+
+static int state_refs_find_palette(state_refs *refs, palette *pal) {
+    for(int i = 0; i < STATE_SOURCES; i++) {
+        if(refs->sources[i].file != NULL && refs->sources[i].pal == pal) {
+            return i;
+        }
+    }
+    return STATE_SOURCE_NONE;
+}
+
+static int state_refs_find_stl(state_refs *refs, char *stl) {
+    for(int i = 0; i < STATE_SOURCES; i++) {
+        if(refs->sources[i].file != NULL && refs->sources[i].stl == stl) {
+            return i;
+        }
+    }
+    return STATE_SOURCE_NONE;
+}
+
+// Index of the sprite in the animation, as animation_get_sprite takes it
+static int state_refs_find_sprite(animation *ani, sprite *spr) {
+    for(unsigned int i = 0; i < vector_size(&ani->sprites); i++) {
+        if(vector_get(&ani->sprites, i) == spr) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int state_refs_find(state_refs *refs, object *obj, object_refs *out) {
+    out->ani_source = STATE_SOURCE_NONE;
+    out->ani_id = -1;
+    out->sprite = -1;
+    out->pal_source = STATE_SOURCE_NONE;
+    out->stl_source = STATE_SOURCE_NONE;
+
+    if(obj->cur_animation != NULL) {
+        if(obj->cur_animation_own == OWNER_OBJECT) {
+            out->ani_source = STATE_SOURCE_OWN;
+        } else {
+            out->ani_source = state_refs_find_animation(refs, obj->cur_animation);
+            if(out->ani_source == STATE_SOURCE_NONE) {
+                return 1;
+            }
+        }
+        out->ani_id = obj->cur_animation->id;
+        if(obj->cur_sprite != NULL) {
+            out->sprite = state_refs_find_sprite(obj->cur_animation, obj->cur_sprite);
+            if(out->sprite < 0) {
+                return 1;
+            }
+        }
+    } else if(obj->cur_sprite != NULL) {
+        return 1;
+    }
+
+    if(obj->cur_palette != NULL) {
+        out->pal_source = state_refs_find_palette(refs, obj->cur_palette);
+        if(out->pal_source == STATE_SOURCE_NONE) {
+            return 1;
+        }
+    }
+    if(obj->sound_translation_table != NULL) {
+        out->stl_source = state_refs_find_stl(refs, obj->sound_translation_table);
+        if(out->stl_source == STATE_SOURCE_NONE) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static state_source* state_refs_get_source(state_refs *refs, int source) {
+    if(source < 0 || source >= STATE_SOURCES || refs->sources[source].file == NULL) {
+        return NULL;
+    }
+    return &refs->sources[source];
+}
+
+int state_refs_resolve(state_refs *refs, const object_refs *in, animation **ani, sprite **spr, palette **pal, char **stl) {
+    state_source *src;
+    *ani = NULL;
+    *spr = NULL;
+    *pal = NULL;
+    *stl = NULL;
+
+    if(in->ani_source != STATE_SOURCE_NONE && in->ani_source != STATE_SOURCE_OWN) {
+        if((src = state_refs_get_source(refs, in->ani_source)) == NULL
+            || (*ani = src->animation(src->file, in->ani_id)) == NULL) {
+            return 1;
+        }
+        if(in->sprite >= 0) {
+            if((unsigned int)in->sprite >= vector_size(&(*ani)->sprites)) {
+                return 1;
+            }
+            *spr = vector_get(&(*ani)->sprites, in->sprite);
+        }
+    }
+    if(in->pal_source != STATE_SOURCE_NONE) {
+        if((src = state_refs_get_source(refs, in->pal_source)) == NULL) {
+            return 1;
+        }
+        *pal = src->pal;
+    }
+    if(in->stl_source != STATE_SOURCE_NONE) {
+        if((src = state_refs_get_source(refs, in->stl_source)) == NULL) {
+            return 1;
+        }
+        *stl = src->stl;
+    }
+    return 0;
+}
@@ -9,28 +9,29 @@
 font font_small;
 font font_large;
 
+// Number of glyphs in a font file
+#define FONT_GLYPHS 224
+#define FONT_ATLAS_ROWS ((FONT_GLYPHS + FONT_ATLAS_COLUMNS - 1) / FONT_ATLAS_COLUMNS)
+
 void font_create(font *font) {
     font->size = FONT_UNDEFINED;
-    vector_create(&font->textures, sizeof(texture*));
+    font->glyphs = NULL;
+    texture_create(&font->atlas);
 }
 
 void font_free(font *font) {
     font->size = FONT_UNDEFINED;
-    iterator it;
-    vector_iter_begin(&font->textures, &it);
-    texture **tex = NULL;
-    while((tex = iter_next(&it)) != NULL) {
-        texture_free(*tex);
-        free(*tex);
-    }
-    vector_free(&font->textures);
+    texture_free(&font->atlas);
+    free(font->glyphs);
+    font->glyphs = NULL;
 }
 
-int font_load(font *font, const char* filename, unsigned int size) {
+// Decodes the glyphs of a font file into memory. Does not touch GL, so this
+// can be done outside the main thread.
+int font_decode(font *font, const char* filename, unsigned int size) {
     sd_rgba_image *img;
     sd_font *sdfont;
     int pixsize;
-    texture *tex;
     
     // Find vertical size
     switch(size) {
@@ -47,15 +48,21 @@ int font_load(font *font, const char* filename, unsigned int size) {
         return 2;
     }
     
-    // Load into textures
+    // Decode all glyphs into their places in the atlas. Both images only
+    // wrap the buffers; the atlas buffer is kept for the upload.
+    image atlas, glyph;
+    atlas.w = pixsize * FONT_ATLAS_COLUMNS;
+    atlas.h = pixsize * FONT_ATLAS_ROWS;
+    atlas.data = calloc(atlas.w * atlas.h, 4);
     img = sd_rgba_image_create(pixsize, pixsize);
-    for(int i = 0; i < 224; i++) {
-        tex = malloc(sizeof(texture));
+    glyph.w = pixsize;
+    glyph.h = pixsize;
+    glyph.data = img->data;
+    for(int i = 0; i < FONT_GLYPHS; i++) {
         sd_font_decode(sdfont, img, i, 0xFF, 0xFF, 0xFF);
-        texture_create(tex);
-        texture_init(tex, img->data, img->w, img->h);
-        vector_append(&font->textures, &tex);
+        image_blit(&atlas, &glyph, (i % FONT_ATLAS_COLUMNS) * pixsize, (i / FONT_ATLAS_COLUMNS) * pixsize);
     }
+    font->glyphs = atlas.data;
     
     // Set font info vars
     font->w = pixsize;
@@ -68,14 +75,36 @@ int font_load(font *font, const char* filename, unsigned int size) {
     return 0;
 }
 
-int fonts_init() {
+// Uploads the decoded glyph atlas. Must be called from the main thread.
+int font_upload(font *font) {
+    if(font->glyphs == NULL) {
+        return 1;
+    }
+    if(texture_init(&font->atlas, font->glyphs, font->w * FONT_ATLAS_COLUMNS, font->h * FONT_ATLAS_ROWS)) {
+        return 1;
+    }
+    free(font->glyphs);
+    font->glyphs = NULL;
+    return 0;
+}
+
+int font_load(font *font, const char* filename, unsigned int size) {
+    int ret = font_decode(font, filename, size);
+    if(ret) {
+        return ret;
+    }
+    return font_upload(font);
+}
+
+// Loads font files and decodes the glyphs. Safe to call outside the main thread.
+int fonts_load() {
     font_create(&font_small);
     font_create(&font_large);
     char filename[64];
 
     // Load small font
     get_filename_by_id(DAT_CHARSMAL, filename);
-    if(font_load(&font_small, filename, FONT_SMALL)) {
+    if(font_decode(&font_small, filename, FONT_SMALL)) {
         PERROR("Unable to load font file '%s'!", filename);
         return 1;
     }
@@ -83,7 +112,7 @@ int fonts_init() {
 
     // Load big font
     get_filename_by_id(DAT_GRAPHCHR, filename);
-    if(font_load(&font_large, filename, FONT_BIG)) {
+    if(font_decode(&font_large, filename, FONT_BIG)) {
         PERROR("Unable to load font file '%s'!", filename);
         return 1;
     }
@@ -93,19 +122,35 @@ int fonts_init() {
     return 0;
 }
 
+// Uploads the fonts loaded by fonts_load to textures.
+int fonts_upload() {
+    if(font_upload(&font_small) || font_upload(&font_large)) {
+        PERROR("Unable to upload font textures!");
+        return 1;
+    }
+    return 0;
+}
+
+int fonts_init() {
+    if(fonts_load()) {
+        return 1;
+    }
+    return fonts_upload();
+}
+
 void fonts_close() {
     font_free(&font_small);
     font_free(&font_large);
 }
 
 void font_render_char(font *font, char ch, int x, int y, color c) {
-    int code = ch - 32;
-    texture **tex = NULL;
-    if (code < 0) {
-        return;
+    int code = (unsigned char)ch - 32;
+    if (code <= 0 || code >= FONT_GLYPHS) {
+        return; // Nothing to draw for spaces
     }
-    tex = vector_get(&font->textures, code);
-    video_render_char(*tex, x, y, c);
+    video_render_glyph(&font->atlas, x, y,
+        (code % FONT_ATLAS_COLUMNS) * font->w, (code / FONT_ATLAS_COLUMNS) * font->h,
+        font->w, font->h, c);
 }
 
 void font_render_len(font *font, const char *text, int len, int x, int y, color c) {
@@ -1,6 +1,8 @@
 #include <stdlib.h>
+#include <string.h>
 #include "game/ticktimer.h"
 #include "utils/vector.h"
+#include "utils/log.h"
 
 typedef struct ticktimer_unit_t {
     ticktimer_cb callback;
@@ -8,7 +10,14 @@ typedef struct ticktimer_unit_t {
     void *userdata;
 } ticktimer_unit;
 
+// Saved timer
+typedef struct ticktimer_record_t {
+    int callback;
+    int ticks;
+} ticktimer_record;
+
 static vector _ticktimer_units;
+static ticktimer_cb _ticktimer_callbacks[TICKTIMER_CALLBACKS];
 
 void ticktimer_init() {
     vector_create(&_ticktimer_units, sizeof(ticktimer_unit));
@@ -18,6 +27,10 @@ void ticktimer_close() {
     vector_free(&_ticktimer_units);
 }
 
+void ticktimer_register(int id, ticktimer_cb cb) {
+    _ticktimer_callbacks[id] = cb;
+}
+
 void ticktimer_add(int ticks, ticktimer_cb cb, void *userdata) {
     ticktimer_unit unit;
     unit.callback = cb;
@@ -39,3 +52,53 @@ void ticktimer_run() {
         }
     }
 }
+
+unsigned int ticktimer_save_size() {
+    return vector_size(&_ticktimer_units) * sizeof(ticktimer_record);
+}
+
+// Only timers with a registered callback and no userdata can be saved.
+// Returns 1 if there is one that can't.
+int ticktimer_save(char *buf) {
+    iterator it;
+    ticktimer_unit *unit;
+    ticktimer_record *rec = (ticktimer_record*)buf;
+    vector_iter_begin(&_ticktimer_units, &it);
+    while((unit = iter_next(&it)) != NULL) {
+        rec->callback = -1;
+        for(int i = 0; i < TICKTIMER_CALLBACKS; i++) {
+            if(_ticktimer_callbacks[i] == unit->callback) {
+                rec->callback = i;
+            }
+        }
+        if(rec->callback < 0 || unit->userdata != NULL) {
+            PERROR("Unable to save a timer without a registered callback!");
+            return 1;
+        }
+        rec->ticks = unit->ticks;
+        rec++;
+    }
+    return 0;
+}
+
+int ticktimer_load(const char *buf, unsigned int size) {
+    const ticktimer_record *rec = (const ticktimer_record*)buf;
+    vector_clear(&_ticktimer_units);
+    if(size % sizeof(ticktimer_record) != 0) {
+        PERROR("Saved timers have invalid size!");
+        return 1;
+    }
+    for(unsigned int i = 0; i < size / sizeof(ticktimer_record); i++) {
+        if(rec[i].callback < 0 || rec[i].callback >= TICKTIMER_CALLBACKS
+            || _ticktimer_callbacks[rec[i].callback] == NULL) {
+            PERROR("Saved timer has unknown callback %d!", rec[i].callback);
+            return 1;
+        }
+        ticktimer_unit unit;
+        unit.callback = _ticktimer_callbacks[rec[i].callback];
+        unit.ticks = rec[i].ticks;
+        unit.userdata = NULL;
+        vector_append(&_ticktimer_units, &unit);
+    }
+    return 0;
+}
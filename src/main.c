@@ -32,6 +32,20 @@ int main(int argc, char *argv[]) {
     char logfile_path[strlen(path)+32];
     sprintf(logfile_path, "%s%s", path, "openomf.log");
 
+    // Engine flags
+    engine_init_flags init_flags;
+    init_flags.headless = 0;
+    init_flags.arena = 0;
+    init_flags.ticks = 0;
+    init_flags.record_file = NULL;
+    init_flags.playback_file = NULL;
+    init_flags.loopback = -1;
+    init_flags.golden_dir = NULL;
+    init_flags.golden_write = 0;
+    init_flags.capture_file = NULL;
+    init_flags.spectate_host = NULL;
+    init_flags.result = 0;
+
     // Check arguments
     if(argc >= 2) {
         if(strcmp(argv[1], "-v") == 0) {
@@ -43,6 +57,18 @@ int main(int argc, char *argv[]) {
             printf("Arguments:\n");
             printf("-h      Prints this help\n");
             printf("-w      Writes a config file\n");
+            printf("-H [arena] [ticks]\n");
+            printf("        Runs a headless arena match at max speed\n");
+            printf("-r file Records arena matches to a replay file\n");
+            printf("-p file Plays back a replay file\n");
+            printf("-Hp file\n");
+            printf("        Plays back a replay file headless at max speed\n");
+            printf("-Hl [latency] [ticks]\n");
+            printf("        Runs a headless rollback match against a loopback peer\n");
+            printf("-c file Records gameplay video; Y4M if the name ends with .y4m, raw RGBA otherwise\n");
+            printf("-G dir  Renders scripted scenes offscreen and checks them against golden frames\n");
+            printf("-Gw dir Writes the golden frames for -G\n");
+            printf("-S host Watches the network match of a player\n");
             return 0;
         } else if(strcmp(argv[1], "-w") == 0) {
             if(settings_write_defaults(config_path)) {
@@ -53,6 +79,70 @@ int main(int argc, char *argv[]) {
                 printf("Config file written to '%s'!\n", config_path);
             }
             return 0;
+        } else if(strcmp(argv[1], "-H") == 0) {
+            init_flags.headless = 1;
+            init_flags.ticks = 10000;
+            if(argc >= 3) {
+                init_flags.arena = atoi(argv[2]);
+            }
+            if(argc >= 4) {
+                init_flags.ticks = atoi(argv[3]);
+            }
+            if(init_flags.arena < 0 || init_flags.arena > 4) {
+                fprintf(stderr, "Arena number must be between 0 and 4!\n");
+                fflush(stderr);
+                return 1;
+            }
+        } else if(strcmp(argv[1], "-Hl") == 0) {
+            init_flags.headless = 1;
+            init_flags.ticks = 10000;
+            init_flags.loopback = 5;
+            if(argc >= 3) {
+                init_flags.loopback = atoi(argv[2]);
+            }
+            if(argc >= 4) {
+                init_flags.ticks = atoi(argv[3]);
+            }
+            if(init_flags.loopback < 0) {
+                fprintf(stderr, "Latency can not be negative!\n");
+                fflush(stderr);
+                return 1;
+            }
+        } else if(strcmp(argv[1], "-r") == 0 || strcmp(argv[1], "-p") == 0 || strcmp(argv[1], "-Hp") == 0) {
+            if(argc < 3) {
+                fprintf(stderr, "Option %s requires a replay file name!\n", argv[1]);
+                fflush(stderr);
+                return 1;
+            }
+            if(strcmp(argv[1], "-r") == 0) {
+                init_flags.record_file = argv[2];
+            } else {
+                init_flags.playback_file = argv[2];
+                init_flags.headless = (strcmp(argv[1], "-Hp") == 0);
+            }
+        } else if(strcmp(argv[1], "-c") == 0) {
+            if(argc < 3) {
+                fprintf(stderr, "Option %s requires a file name!\n", argv[1]);
+                fflush(stderr);
+                return 1;
+            }
+            init_flags.capture_file = argv[2];
+        } else if(strcmp(argv[1], "-G") == 0 || strcmp(argv[1], "-Gw") == 0) {
+            if(argc < 3) {
+                fprintf(stderr, "Option %s requires a directory!\n", argv[1]);
+                fflush(stderr);
+                return 1;
+            }
+            init_flags.headless = 1;
+            init_flags.golden_dir = argv[2];
+            init_flags.golden_write = (strcmp(argv[1], "-Gw") == 0);
+        } else if(strcmp(argv[1], "-S") == 0) {
+            if(argc < 3) {
+                fprintf(stderr, "Option %s requires a host name!\n", argv[1]);
+                fflush(stderr);
+                return 1;
+            }
+            init_flags.spectate_host = argv[2];
         }
     }
 
@@ -86,8 +176,8 @@ int main(int argc, char *argv[]) {
     // Init libDumb
     dumb_register_stdfiles();
     
-    // Init SDL2
-    if(SDL_Init(SDL_INIT_VIDEO|SDL_INIT_TIMER)) {
+    // Init SDL2. Headless runs only need the timer.
+    if(SDL_Init(init_flags.headless ? SDL_INIT_TIMER : (SDL_INIT_VIDEO|SDL_INIT_TIMER))) {
         PERROR("SDL2 Initialization failed: %s", SDL_GetError());
         goto exit_1;
     }
@@ -96,29 +186,10 @@ int main(int argc, char *argv[]) {
     INFO("Found SDL v%d.%d.%d", sdl_linked.major, sdl_linked.minor, sdl_linked.patch);
     INFO("Running on platform: %s", SDL_GetPlatform());
 
-    if(SDL_InitSubSystem(SDL_INIT_JOYSTICK|SDL_INIT_GAMECONTROLLER|SDL_INIT_HAPTIC)) {
+    if(!init_flags.headless && SDL_InitSubSystem(SDL_INIT_JOYSTICK|SDL_INIT_GAMECONTROLLER|SDL_INIT_HAPTIC)) {
         PERROR("SDL2 Initialization failed: %s", SDL_GetError());
         goto exit_1;
     }
-    INFO("Found %d joysticks attached", SDL_NumJoysticks());
-    SDL_Joystick *joy;
-    for (int i = 0; i < SDL_NumJoysticks(); i++) {
-        joy = SDL_JoystickOpen(0);
-        if (joy) {
-            INFO("Opened Joystick %d", i);
-            INFO(" * Name:              %s", SDL_JoystickNameForIndex(i));
-            INFO(" * Number of Axes:    %d", SDL_JoystickNumAxes(joy));
-            INFO(" * Number of Buttons: %d", SDL_JoystickNumButtons(joy));
-            INFO(" * Number of Balls:   %d", SDL_JoystickNumBalls(joy));
-            INFO(" * Number of Hats:    %d", SDL_JoystickNumHats(joy));
-        } else {
-            INFO("Joystick %d is unsupported", i);
-        }
-
-        if (SDL_JoystickGetAttached(joy)) {
-            SDL_JoystickClose(joy);
-        }
-    }
 
     // Init enet
     if(enet_initialize() != 0) {
@@ -127,13 +198,13 @@ int main(int argc, char *argv[]) {
     }
     
     // Initialize engine
-    if(engine_init()) {
+    if(engine_init(&init_flags)) {
         PERROR("Failed to initialize game engine.");
         goto exit_3;
     }
     
     // Run
-    engine_run();
+    engine_run(&init_flags);
     
     // Close everything
     engine_close();
@@ -154,5 +225,5 @@ exit_0:
     SDL_free(path);
     */
 #endif
-    return 0;
+    return init_flags.result;
 }
@@ -24,6 +24,16 @@ void af_create(af *a, void *src) {
             hashmap_iput(&a->moves, i, &tmp_move, sizeof(af_move));
         }
     }
+
+    // Pack all frames of all moves
+    a->sprites = atlas_create();
+    iterator it;
+    hashmap_iter_begin(&a->moves, &it);
+    hashmap_pair *pair = NULL;
+    while((pair = iter_next(&it)) != NULL) {
+        atlas_add_animation(a->sprites, &((af_move*)pair->val)->ani);
+    }
+    atlas_pack(a->sprites);
 }
 
 af_move* af_get_move(af *a, int id) {
@@ -43,4 +53,5 @@ void af_free(af *a) {
         af_move_free((af_move*)pair->val);
     }
     hashmap_free(&a->moves);
+    atlas_free(a->sprites);
 }
@@ -0,0 +1,140 @@
+#include "resources/atlas.h"
+#include "video/indexed.h"
+#include "utils/log.h"
+#include <shadowdive/vga_image.h>
+#include <stdlib.h>
+
+// Empty pixels between frames
+#define ATLAS_PADDING 1
+
+atlas* atlas_create() {
+    atlas *a = malloc(sizeof(atlas));
+    a->page_count = 0;
+    a->uploaded = 0;
+    vector_create(&a->pending, sizeof(sprite*));
+    return a;
+}
+
+void atlas_add_animation(atlas *a, animation *ani) {
+    iterator it;
+    sprite *sp;
+    vector_iter_begin(&ani->sprites, &it);
+    while((sp = iter_next(&it)) != NULL) {
+        vector_append(&a->pending, &sp);
+    }
+}
+
+// Tallest first, so that rows waste as little space as possible
+static int atlas_compare(const void *pa, const void *pb) {
+    const sd_vga_image *a = (*(sprite**)pa)->raw_sprite;
+    const sd_vga_image *b = (*(sprite**)pb)->raw_sprite;
+    if(a->h != b->h) {
+        return (int)b->h - (int)a->h;
+    }
+    return (int)b->w - (int)a->w;
+}
+
+static atlas_page* atlas_new_page(atlas *a) {
+    if(a->page_count >= ATLAS_MAX_PAGES) {
+        return NULL;
+    }
+    atlas_page *page = &a->pages[a->page_count++];
+    texture_create(&page->tex);
+    page->data = calloc(ATLAS_SIZE * ATLAS_SIZE, 2);
+    page->x = 0;
+    page->y = 0;
+    page->shelf_h = 0;
+    return page;
+}
+
+static void atlas_copy(atlas_page *page, const sd_vga_image *vga) {
+    for(unsigned int y = 0; y < vga->h; y++) {
+        char *row = page->data + ((page->y + y) * ATLAS_SIZE + page->x) * 2;
+        for(unsigned int x = 0; x < vga->w; x++) {
+            row[x*2] = vga->data[y * vga->w + x];
+            row[x*2+1] = vga->stencil[y * vga->w + x] ? 0xFF : 0;
+        }
+    }
+}
+
+// Packs every pending sprite in rows. Sprites that don't fit are left out,
+// and get drawn from their own textures instead.
+void atlas_pack(atlas *a) {
+    iterator it;
+    sprite **spp;
+    atlas_page *page = (a->page_count > 0) ? &a->pages[a->page_count - 1] : atlas_new_page(a);
+    vector_sort(&a->pending, atlas_compare);
+    vector_iter_begin(&a->pending, &it);
+    while((spp = iter_next(&it)) != NULL && page != NULL) {
+        sprite *sp = *spp;
+        const sd_vga_image *vga = sp->raw_sprite;
+        if(vga->w > ATLAS_SIZE || vga->h > ATLAS_SIZE) {
+            continue;
+        }
+        if(page->x + vga->w > ATLAS_SIZE) {
+            page->x = 0;
+            page->y += page->shelf_h + ATLAS_PADDING;
+            page->shelf_h = 0;
+        }
+        if(page->y + vga->h > ATLAS_SIZE) {
+            if((page = atlas_new_page(a)) == NULL) {
+                PERROR("Atlas is full, drawing the rest of the frames one by one.");
+                break;
+            }
+        }
+        atlas_copy(page, vga);
+        sp->atlas = a;
+        sp->atlas_page = a->page_count - 1;
+        sp->atlas_pos = vec2i_create(page->x, page->y);
+        page->x += vga->w + ATLAS_PADDING;
+        if(vga->h > page->shelf_h) {
+            page->shelf_h = vga->h;
+        }
+    }
+    DEBUG("Packed %u frames to %d atlas pages.", vector_size(&a->pending), a->page_count);
+    vector_clear(&a->pending);
+}
+
+// Uploads the pages, if it hasn't been done yet. Only the rows that are
+// in use are uploaded. Returns 1 if the atlas can't be used for drawing.
+int atlas_upload(atlas *a) {
+    if(a->uploaded) {
+        return (a->uploaded < 0);
+    }
+    a->uploaded = 1;
+    if(!indexed_supported()) {
+        a->uploaded = -1;
+    }
+    for(int i = 0; i < a->page_count; i++) {
+        atlas_page *page = &a->pages[i];
+        int h = page->y + page->shelf_h;
+        if(a->uploaded > 0 && h > 0 && texture_init_indexed(&page->tex, page->data, ATLAS_SIZE, h)) {
+            PERROR("Unable to upload atlas page %d!", i);
+            a->uploaded = -1;
+        }
+        free(page->data);
+        page->data = NULL;
+    }
+    return (a->uploaded < 0);
+}
+
+void atlas_free(atlas *a) {
+    for(int i = 0; i < a->page_count; i++) {
+        texture_free(&a->pages[i].tex);
+        free(a->pages[i].data);
+    }
+    vector_free(&a->pending);
+    free(a);
+}
+
+texture* atlas_get_sprite(sprite *sp, vec2i *pos) {
+    if(sp->atlas == NULL || atlas_upload(sp->atlas)) {
+        return NULL;
+    }
+    texture *tex = &sp->atlas->pages[sp->atlas_page].tex;
+    if(tex->id == 0) {
+        return NULL;
+    }
+    *pos = sp->atlas_pos;
+    return tex;
+}
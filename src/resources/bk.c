@@ -30,6 +30,16 @@ void bk_create(bk *b, void *src) {
             hashmap_iput(&b->infos, i, &tmp_bk_info, sizeof(bk_info));
         }
     }
+
+    // Pack all animation frames. Background is drawn on its own.
+    b->sprites = atlas_create();
+    iterator it;
+    hashmap_iter_begin(&b->infos, &it);
+    hashmap_pair *pair = NULL;
+    while((pair = iter_next(&it)) != NULL) {
+        atlas_add_animation(b->sprites, &((bk_info*)pair->val)->ani);
+    }
+    atlas_pack(b->sprites);
 }
 
 bk_info* bk_get_info(bk *b, int id) {
@@ -61,4 +71,5 @@ void bk_free(bk *b) {
         bk_info_free((bk_info*)pair->val);
     }
     hashmap_free(&b->infos);
+    atlas_free(b->sprites);
 }
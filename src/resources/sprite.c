@@ -1,19 +1,31 @@
 #include "resources/sprite.h"
 #include "utils/log.h"
 #include <shadowdive/shadowdive.h>
+#include <SDL2/SDL.h>
 #include <stdlib.h>
 
+// Sprites are decoded by the scene loader thread too
+static SDL_atomic_t next_uid = {1};
+
+static unsigned int sprite_new_uid() {
+    return SDL_AtomicAdd(&next_uid, 1);
+}
+
 void sprite_create_custom(sprite *sp, vec2i pos, void *raw_sprite) {
     sp->id = -1;
+    sp->uid = sprite_new_uid();
     sp->pos = pos;
     sp->raw_sprite = raw_sprite;
+    sp->atlas = NULL;
 }
 
 void sprite_create(sprite *sp, void *src, int id) {
     sd_sprite *sdsprite = (sd_sprite*)src;
     sp->id = id;
+    sp->uid = sprite_new_uid();
     sp->raw_sprite = (void*)sd_sprite_vga_decode(sdsprite->img);
     sp->pos = vec2i_create(sdsprite->pos_x, sdsprite->pos_y);
+    sp->atlas = NULL;
 }
 
 void sprite_free(sprite *sp) {
@@ -33,7 +45,9 @@ vec2i sprite_get_size(sprite *s) {
 
 sprite* sprite_copy(sprite *src) {
     sprite *new = malloc(sizeof(sprite));
+    new->uid = sprite_new_uid();
     new->pos = src->pos;
     new->raw_sprite = sd_vga_image_clone((sd_vga_image*)src->raw_sprite);
+    new->atlas = NULL;
     return new;
 }
\ No newline at end of file
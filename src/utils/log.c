@@ -25,10 +25,11 @@ void log_close() {
 }
 
 void log_print(char mode, char *fmt, ...) {
-    fprintf(handle, "[%c] ", mode);
+    // Format the whole line first, so that lines from different threads don't get mixed up
+    char buf[1024];
     va_list args;
     va_start(args, fmt);
-    vfprintf(handle, fmt, args);
+    vsnprintf(buf, sizeof(buf), fmt, args);
     va_end(args);
-    fprintf(handle, "\n");
+    fprintf(handle, "[%c] %s\n", mode, buf);
 }
@@ -0,0 +1,122 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <SDL2/SDL.h>
+#include "utils/profiler.h"
+
+typedef struct profiler_phase_t {
+    Uint64 start;
+    unsigned int pos;
+    unsigned int count;
+    float samples[PROFILER_SAMPLES];
+} profiler_phase;
+
+static profiler_phase phases[PROF_PHASE_COUNT];
+static float ms_per_count = 0.0f;
+
+static const char *phase_names[] = {
+    "events",
+    "input",
+    "cleanup",
+    "move",
+    "collide",
+    "tick",
+    "render",
+    "finish",
+    "audio"
+};
+
+void profiler_init() {
+    ms_per_count = 1000.0f / SDL_GetPerformanceFrequency();
+    profiler_reset();
+}
+
+void profiler_close() {
+    // Nothing to free; samples live in static storage
+}
+
+void profiler_reset() {
+    for(int i = 0; i < PROF_PHASE_COUNT; i++) {
+        phases[i].start = 0;
+        phases[i].pos = 0;
+        phases[i].count = 0;
+    }
+}
+
+void profiler_begin(int phase) {
+    phases[phase].start = SDL_GetPerformanceCounter();
+}
+
+void profiler_end(int phase) {
+    profiler_phase *p = &phases[phase];
+    p->samples[p->pos] = (SDL_GetPerformanceCounter() - p->start) * ms_per_count;
+    p->pos = (p->pos + 1) % PROFILER_SAMPLES;
+    if(p->count < PROFILER_SAMPLES) {
+        p->count++;
+    }
+}
+
+const char* profiler_get_name(int phase) {
+    if(phase < 0 || phase >= PROF_PHASE_COUNT) {
+        return NULL;
+    }
+    return phase_names[phase];
+}
+
+static int compare_samples(const void *a, const void *b) {
+    float fa = *(const float*)a;
+    float fb = *(const float*)b;
+    return (fa > fb) - (fa < fb);
+}
+
+void profiler_get_stats(int phase, profiler_stats *stats) {
+    profiler_phase *p = &phases[phase];
+    stats->count = p->count;
+    stats->min = 0.0f;
+    stats->avg = 0.0f;
+    stats->max = 0.0f;
+    stats->p99 = 0.0f;
+    if(p->count == 0) {
+        return;
+    }
+
+    // Sort a copy; the ring itself must keep its order
+    float sorted[PROFILER_SAMPLES];
+    float sum = 0.0f;
+    for(unsigned int i = 0; i < p->count; i++) {
+        sorted[i] = p->samples[i];
+        sum += sorted[i];
+    }
+    qsort(sorted, p->count, sizeof(float), compare_samples);
+    stats->min = sorted[0];
+    stats->max = sorted[p->count - 1];
+    stats->avg = sum / p->count;
+    stats->p99 = sorted[(p->count * 99) / 100];
+}
+
+int profiler_dump(const char *filename) {
+    FILE *fp = fopen(filename, "w");
+    if(fp == NULL) {
+        return 1;
+    }
+
+    // Summary first
+    profiler_stats stats;
+    fprintf(fp, "# phase samples min_ms avg_ms p99_ms max_ms\n");
+    for(int i = 0; i < PROF_PHASE_COUNT; i++) {
+        profiler_get_stats(i, &stats);
+        fprintf(fp, "# %s %u %.4f %.4f %.4f %.4f\n", 
+            phase_names[i], stats.count, stats.min, stats.avg, stats.p99, stats.max);
+    }
+
+    // Then the raw samples, oldest first
+    fprintf(fp, "phase,sample,ms\n");
+    for(int i = 0; i < PROF_PHASE_COUNT; i++) {
+        profiler_phase *p = &phases[i];
+        unsigned int first = (p->count < PROFILER_SAMPLES) ? 0 : p->pos;
+        for(unsigned int k = 0; k < p->count; k++) {
+            fprintf(fp, "%s,%u,%.4f\n", phase_names[i], k, p->samples[(first + k) % PROFILER_SAMPLES]);
+        }
+    }
+    fclose(fp);
+    return 0;
+}
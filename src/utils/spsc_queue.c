@@ -0,0 +1,57 @@
+#include "utils/spsc_queue.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Capacity is rounded up to a power of two. Returns 1 if out of memory.
+int spsc_queue_create(spsc_queue *q, unsigned int capacity, unsigned int item_size) {
+    unsigned int cap = 1;
+    while(cap < capacity) {
+        cap <<= 1;
+    }
+    q->data = malloc(cap * item_size);
+    if(q->data == NULL) {
+        return 1;
+    }
+    q->item_size = item_size;
+    q->capacity = cap;
+    SDL_AtomicSet(&q->head, 0);
+    SDL_AtomicSet(&q->tail, 0);
+    return 0;
+}
+
+void spsc_queue_free(spsc_queue *q) {
+    free(q->data);
+    q->data = NULL;
+}
+
+// Head and tail only ever grow, and wrap around at the integer range. The
+// atomic set publishes the item copy to the other thread.
+
+// Returns 1 if the queue is full
+int spsc_queue_push(spsc_queue *q, const void *item) {
+    unsigned int tail = SDL_AtomicGet(&q->tail);
+    unsigned int head = SDL_AtomicGet(&q->head);
+    if(tail - head >= q->capacity) {
+        return 1;
+    }
+    memcpy(q->data + (tail & (q->capacity - 1)) * q->item_size, item, q->item_size);
+    SDL_AtomicSet(&q->tail, tail + 1);
+    return 0;
+}
+
+// Returns 1 if the queue is empty
+int spsc_queue_pop(spsc_queue *q, void *item) {
+    unsigned int head = SDL_AtomicGet(&q->head);
+    unsigned int tail = SDL_AtomicGet(&q->tail);
+    if(head == tail) {
+        return 1;
+    }
+    memcpy(item, q->data + (head & (q->capacity - 1)) * q->item_size, q->item_size);
+    SDL_AtomicSet(&q->head, head + 1);
+    return 0;
+}
+
+// Amount of items waiting. Only a hint if called from a third thread.
+unsigned int spsc_queue_size(spsc_queue *q) {
+    return (unsigned int)SDL_AtomicGet(&q->tail) - (unsigned int)SDL_AtomicGet(&q->head);
+}
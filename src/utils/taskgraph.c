@@ -0,0 +1,220 @@
+#include <SDL2/SDL.h>
+#include "utils/taskgraph.h"
+#include "utils/log.h"
+
+typedef struct taskgraph_runner_t {
+    taskgraph *graph;
+    SDL_mutex *lock;
+    SDL_cond *cond;
+    Uint64 start;
+    float ms_per_count;
+    int running;
+    int failed;
+} taskgraph_runner;
+
+typedef struct taskgraph_worker_t {
+    taskgraph_runner *runner;
+    int id;
+} taskgraph_worker;
+
+void taskgraph_create(taskgraph *graph) {
+    graph->count = 0;
+    graph->workers = 0;
+    graph->total = 0.0f;
+}
+
+// Returns the index of the new task, or -1 if the graph is full.
+int taskgraph_add(taskgraph *graph, const char *name, task_run_cb run, task_close_cb close, unsigned int deps, int main_thread) {
+    if(graph->count >= TASKGRAPH_MAX_TASKS) {
+        PERROR("Task graph is full, unable to add task '%s'!", name);
+        return -1;
+    }
+    task *t = &graph->tasks[graph->count];
+    t->name = name;
+    t->run = run;
+    t->close = close;
+    t->deps = deps;
+    t->main_thread = main_thread;
+    t->state = TASK_PENDING;
+    t->thread = -1;
+    t->start = 0.0f;
+    t->end = 0.0f;
+    return graph->count++;
+}
+
+static int taskgraph_is_ready(taskgraph *graph, task *t) {
+    if(t->state != TASK_PENDING) {
+        return 0;
+    }
+    for(int i = 0; i < graph->count; i++) {
+        if((t->deps & (1u << i)) && graph->tasks[i].state != TASK_DONE) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int taskgraph_is_finished(taskgraph *graph) {
+    for(int i = 0; i < graph->count; i++) {
+        if(graph->tasks[i].state == TASK_PENDING || graph->tasks[i].state == TASK_RUNNING) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Picks the next runnable task. Main thread prefers its own tasks, but helps out
+// with the others if it has nothing else to do. Must be called with the lock held.
+static task* taskgraph_pick(taskgraph *graph, int main_thread) {
+    task *other = NULL;
+    for(int i = 0; i < graph->count; i++) {
+        task *t = &graph->tasks[i];
+        if(!taskgraph_is_ready(graph, t)) {
+            continue;
+        }
+        if(t->main_thread == main_thread) {
+            return t;
+        }
+        if(main_thread && other == NULL) {
+            other = t;
+        }
+    }
+    return other;
+}
+
+// Runs tasks until there is nothing left to do for this thread.
+// Thread 0 is the main thread.
+static void taskgraph_work(taskgraph_runner *r, int id) {
+    taskgraph *graph = r->graph;
+    SDL_LockMutex(r->lock);
+    while(1) {
+        // On failure, stop starting new tasks. Main thread waits for the running ones.
+        if(r->failed || taskgraph_is_finished(graph)) {
+            if(id != 0 || r->running == 0) {
+                break;
+            }
+            SDL_CondWait(r->cond, r->lock);
+            continue;
+        }
+
+        task *t = taskgraph_pick(graph, id == 0);
+        if(t == NULL) {
+            // Dependencies haven't been finished yet, or this thread can't run the rest.
+            // Workers leave once only main thread tasks are left.
+            int worker_work = 0;
+            for(int i = 0; i < graph->count; i++) {
+                if(graph->tasks[i].state == TASK_PENDING && !graph->tasks[i].main_thread) {
+                    worker_work = 1;
+                    break;
+                }
+            }
+            if(id != 0 && !worker_work) {
+                break;
+            }
+            SDL_CondWait(r->cond, r->lock);
+            continue;
+        }
+
+        // Run the task without holding the lock
+        t->state = TASK_RUNNING;
+        t->thread = id;
+        t->start = (SDL_GetPerformanceCounter() - r->start) * r->ms_per_count;
+        r->running++;
+        SDL_UnlockMutex(r->lock);
+        int ret = t->run();
+        SDL_LockMutex(r->lock);
+        t->end = (SDL_GetPerformanceCounter() - r->start) * r->ms_per_count;
+        r->running--;
+        if(ret) {
+            PERROR("Task '%s' failed!", t->name);
+            t->state = TASK_FAILED;
+            r->failed = 1;
+        } else {
+            t->state = TASK_DONE;
+        }
+        SDL_CondBroadcast(r->cond);
+    }
+    SDL_UnlockMutex(r->lock);
+}
+
+static int taskgraph_worker_run(void *userdata) {
+    taskgraph_worker *w = userdata;
+    taskgraph_work(w->runner, w->id);
+    return 0;
+}
+
+// Runs all tasks in dependency order, using the calling thread and the given amount
+// of worker threads. Returns 1 if any of the tasks failed; successful tasks are left
+// as they are, and can be closed with taskgraph_close.
+int taskgraph_run(taskgraph *graph, int workers) {
+    taskgraph_runner r;
+    taskgraph_worker w[TASKGRAPH_MAX_WORKERS];
+    SDL_Thread *threads[TASKGRAPH_MAX_WORKERS];
+
+    if(workers > TASKGRAPH_MAX_WORKERS) {
+        workers = TASKGRAPH_MAX_WORKERS;
+    }
+    r.graph = graph;
+    r.lock = SDL_CreateMutex();
+    r.cond = SDL_CreateCond();
+    r.ms_per_count = 1000.0f / SDL_GetPerformanceFrequency();
+    r.start = SDL_GetPerformanceCounter();
+    r.running = 0;
+    r.failed = 0;
+
+    // Start up workers. If a thread can't be created, main thread does the work.
+    graph->workers = 0;
+    for(int i = 0; i < workers; i++) {
+        w[graph->workers].runner = &r;
+        w[graph->workers].id = graph->workers + 1;
+        threads[graph->workers] = SDL_CreateThread(taskgraph_worker_run, "startup worker", &w[graph->workers]);
+        if(threads[graph->workers] == NULL) {
+            PERROR("Could not create worker thread: %s", SDL_GetError());
+            break;
+        }
+        graph->workers++;
+    }
+
+    taskgraph_work(&r, 0);
+
+    // Wake up anyone still waiting, and wait for them to leave
+    SDL_LockMutex(r.lock);
+    SDL_CondBroadcast(r.cond);
+    SDL_UnlockMutex(r.lock);
+    for(int i = 0; i < graph->workers; i++) {
+        SDL_WaitThread(threads[i], NULL);
+    }
+    graph->total = (SDL_GetPerformanceCounter() - r.start) * r.ms_per_count;
+
+    SDL_DestroyCond(r.cond);
+    SDL_DestroyMutex(r.lock);
+    return r.failed;
+}
+
+// Closes all successfully run tasks, in reverse order of adding.
+void taskgraph_close(taskgraph *graph) {
+    for(int i = graph->count - 1; i >= 0; i--) {
+        task *t = &graph->tasks[i];
+        if(t->state == TASK_DONE && t->close != NULL) {
+            t->close();
+        }
+        t->state = TASK_PENDING;
+    }
+}
+
+void taskgraph_report(taskgraph *graph) {
+    float serial = 0.0f;
+    INFO("Startup timing (%d worker threads):", graph->workers);
+    for(int i = 0; i < graph->count; i++) {
+        task *t = &graph->tasks[i];
+        if(t->state != TASK_DONE && t->state != TASK_FAILED) {
+            INFO(" * %-12s not run", t->name);
+            continue;
+        }
+        INFO(" * %-12s thread %d, start %8.2fms, took %8.2fms%s",
+            t->name, t->thread, t->start, t->end - t->start,
+            (t->state == TASK_FAILED) ? " (failed)" : "");
+        serial += t->end - t->start;
+    }
+    INFO(" * Total %.2fms (%.2fms if run serially)", graph->total, serial);
+}
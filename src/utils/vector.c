@@ -1,6 +1,7 @@
 #include "utils/vector.h"
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 
 typedef struct vector_iterator_t {
     unsigned int now;
@@ -67,10 +68,25 @@ void vector_prepend(vector *vec, const void *value) {
     vec->blocks++;
 }
 
-void vector_reserve(vector *vec, unsigned int blocks) {
-    if(blocks > vec->reserved) {
-        vec->data = vec->alloc.crealloc(vec->data, blocks * vec->block_size);
+// Returns 1 if the size does not fit in memory; the vector is left as it was.
+int vector_reserve(vector *vec, unsigned int blocks) {
+    if(blocks <= vec->reserved) {
+        return 0;
     }
+    if(vec->block_size > 0 && blocks > UINT_MAX / vec->block_size) {
+        return 1;
+    }
+    char *data = vec->alloc.crealloc(vec->data, blocks * vec->block_size);
+    if(data == NULL) {
+        return 1;
+    }
+    vec->data = data;
+    vec->reserved = blocks;
+    return 0;
+}
+
+void vector_clear(vector *vec) {
+    vec->blocks = 0;
 }
 
 unsigned int vector_size(vector *vec) {
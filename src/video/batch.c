@@ -0,0 +1,102 @@
+#include "video/batch.h"
+#include "video/video.h"
+#include "video/indexed.h"
+#include "video/glstate.h"
+#include "utils/log.h"
+#include <GL/glew.h>
+#include <stddef.h>
+
+static batch_vertex vertices[BATCH_MAX_QUADS * 4];
+static unsigned int count = 0;
+static unsigned int cur_tex = 0;
+static unsigned int cur_palette = 0;
+static int cur_mode = 0;
+static unsigned int vbo = 0;
+static batch_stats stats;
+
+int batch_init() {
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if(glGetError() != GL_NO_ERROR) {
+        PERROR("Unable to create vertex buffer for sprite batching!");
+        return 1;
+    }
+    count = 0;
+    stats.quads = 0;
+    stats.draws = 0;
+    return 0;
+}
+
+void batch_close() {
+    glDeleteBuffers(1, &vbo);
+    vbo = 0;
+}
+
+void batch_flush() {
+    if(count == 0) {
+        return;
+    }
+    video_set_rendering_mode(cur_mode);
+
+    // Orphan the old contents, so that the driver doesn't wait for the previous draw
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(batch_vertex), vertices);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(2, GL_FLOAT, sizeof(batch_vertex), (void*)offsetof(batch_vertex, x));
+    glTexCoordPointer(2, GL_FLOAT, sizeof(batch_vertex), (void*)offsetof(batch_vertex, u));
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(batch_vertex), (void*)offsetof(batch_vertex, r));
+
+    // Texturing is left as it is; the next textured batch turns it back on
+    if(cur_tex == 0) {
+        glstate_enable(GL_TEXTURE_2D, 0);
+        glDrawArrays(GL_QUADS, 0, count);
+    } else if(cur_palette != 0) {
+        glstate_enable(GL_TEXTURE_2D, 1);
+        glstate_bind_texture(cur_tex);
+        indexed_begin(cur_palette);
+        glDrawArrays(GL_QUADS, 0, count);
+        indexed_end();
+    } else {
+        glstate_enable(GL_TEXTURE_2D, 1);
+        glstate_bind_texture(cur_tex);
+        glDrawArrays(GL_QUADS, 0, count);
+    }
+
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // Whoever needs the current color next sets it
+    glstate_forget_color();
+
+    stats.quads += count / 4;
+    stats.draws++;
+    count = 0;
+}
+
+void batch_add(unsigned int tex_id, unsigned int palette_id, int rendering_mode, const batch_vertex *quad) {
+    if(count > 0 && (tex_id != cur_tex || palette_id != cur_palette || rendering_mode != cur_mode)) {
+        batch_flush();
+    }
+    if(count >= BATCH_MAX_QUADS * 4) {
+        batch_flush();
+    }
+    cur_tex = tex_id;
+    cur_palette = palette_id;
+    cur_mode = rendering_mode;
+    for(int i = 0; i < 4; i++) {
+        vertices[count++] = quad[i];
+    }
+}
+
+void batch_get_stats(batch_stats *s) {
+    *s = stats;
+    stats.quads = 0;
+    stats.draws = 0;
+}
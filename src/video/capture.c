@@ -0,0 +1,393 @@
+#include "video/capture.h"
+#include "video/video.h"
+#include "video/soft.h"
+#include "video/image.h"
+#include "utils/spsc_queue.h"
+#include "utils/log.h"
+#include <SDL2/SDL.h>
+#include <GL/glew.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CAPTURE_SIZE (NATIVE_W * NATIVE_H * 4)
+#define CAPTURE_BUFFERS 16 // Frames that can be waiting for the writer
+#define CAPTURE_JOBS 64
+#define CAPTURE_PBOS 3
+#define CAPTURE_LATENCY 2  // Frames to wait before mapping a readback
+#define CAPTURE_NAME 256
+
+enum {
+    JOB_FRAME = 0,
+    JOB_START,
+    JOB_STOP,
+    JOB_QUIT
+};
+
+typedef struct capture_job_t {
+    int type;
+    int repeat;         // Frame: times to write to the recording. Start: ms per tick.
+    int bottom_up;      // Frame: rows are in GL order
+    unsigned char *pixels;
+    FILE *file;         // Start: recording file, opened by the render thread
+    char filename[CAPTURE_NAME]; // Frame: screenshot file, if any. Start: recording file.
+} capture_job;
+
+// Readback in flight
+typedef struct capture_pbo_t {
+    unsigned int id;
+    unsigned int frame;
+    int repeat;
+    char screenshot[CAPTURE_NAME];
+} capture_pbo;
+
+// Render thread state
+static int running = 0;
+static int use_pbo = 0;
+static capture_pbo pbos[CAPTURE_PBOS];
+static int pbo_head = 0;
+static int pbo_count = 0;
+static unsigned int frame = 0;
+static int ticks = 0;
+static int recording = 0;
+static unsigned int dropped = 0;
+static char screenshot[CAPTURE_NAME];
+static unsigned char *buffers[CAPTURE_BUFFERS];
+
+// Jobs go to the writer, and their buffers come back when written
+static SDL_Thread *writer;
+static SDL_sem *ready;
+static spsc_queue jobs;
+static spsc_queue free_buffers;
+
+// Writer thread state
+static FILE *rec_file = NULL;
+static int rec_y4m = 0;
+static unsigned int rec_frames = 0;
+static unsigned char yuv[NATIVE_W * NATIVE_H * 3];
+static unsigned char flip_row[NATIVE_W * 4];
+
+// -------- Writer thread --------
+
+static void capture_flip(unsigned char *pixels) {
+    const int pitch = NATIVE_W * 4;
+    for(int y = 0; y < NATIVE_H / 2; y++) {
+        unsigned char *a = pixels + y * pitch;
+        unsigned char *b = pixels + (NATIVE_H - 1 - y) * pitch;
+        memcpy(flip_row, a, pitch);
+        memcpy(a, b, pitch);
+        memcpy(b, flip_row, pitch);
+    }
+}
+
+// BT.601, studio range
+static void capture_to_yuv(const unsigned char *pixels) {
+    const int n = NATIVE_W * NATIVE_H;
+    for(int i = 0; i < n; i++) {
+        int r = pixels[i*4+0];
+        int g = pixels[i*4+1];
+        int b = pixels[i*4+2];
+        yuv[i]       = 16 + ((66*r + 129*g + 25*b + 128) >> 8);
+        yuv[n + i]   = 128 + ((-38*r - 74*g + 112*b + 128) >> 8);
+        yuv[2*n + i] = 128 + ((112*r - 94*g - 18*b + 128) >> 8);
+    }
+}
+
+static void capture_write_start(const capture_job *job) {
+    const char *ext = strrchr(job->filename, '.');
+    rec_y4m = (ext != NULL && strcmp(ext, ".y4m") == 0);
+    rec_frames = 0;
+    rec_file = job->file;
+    if(rec_y4m) {
+        fprintf(rec_file, "YUV4MPEG2 W%d H%d F1000:%d Ip A1:1 C444\n", NATIVE_W, NATIVE_H, job->repeat);
+    }
+    INFO("Recording video to '%s'.", job->filename);
+}
+
+static void capture_write_stop() {
+    if(rec_file != NULL) {
+        fclose(rec_file);
+        rec_file = NULL;
+        INFO("Recorded %u frames.", rec_frames);
+    }
+}
+
+static void capture_write_frame(capture_job *job) {
+    if(job->bottom_up) {
+        capture_flip(job->pixels);
+    }
+    if(job->filename[0] != 0) {
+        image img;
+        img.w = NATIVE_W;
+        img.h = NATIVE_H;
+        img.data = (char*)job->pixels;
+        image_write_tga(&img, job->filename);
+        INFO("Screenshot saved to '%s'.", job->filename);
+    }
+    if(job->repeat <= 0 || rec_file == NULL) {
+        return;
+    }
+    if(rec_y4m) {
+        capture_to_yuv(job->pixels);
+    }
+    for(int i = 0; i < job->repeat; i++) {
+        if(rec_y4m) {
+            fputs("FRAME\n", rec_file);
+            fwrite(yuv, sizeof(yuv), 1, rec_file);
+        } else {
+            fwrite(job->pixels, CAPTURE_SIZE, 1, rec_file);
+        }
+        rec_frames++;
+    }
+}
+
+static int capture_writer_run(void *userdata) {
+    capture_job job;
+    while(1) {
+        SDL_SemWait(ready);
+        if(spsc_queue_pop(&jobs, &job)) {
+            continue;
+        }
+        switch(job.type) {
+            case JOB_FRAME:
+                capture_write_frame(&job);
+                spsc_queue_push(&free_buffers, &job.pixels);
+                break;
+            case JOB_START:
+                capture_write_stop();
+                capture_write_start(&job);
+                break;
+            case JOB_STOP:
+                capture_write_stop();
+                break;
+            case JOB_QUIT:
+                capture_write_stop();
+                return 0;
+        }
+    }
+    return 0;
+}
+
+// -------- Render thread --------
+
+// Queue only fills up if the writer is stuck, so waiting is fine
+static void capture_send(const capture_job *job) {
+    while(spsc_queue_push(&jobs, job)) {
+        SDL_Delay(1);
+    }
+    SDL_SemPost(ready);
+}
+
+static void capture_deliver(const unsigned char *pixels, int bottom_up, int repeat, const char *filename) {
+    capture_job job;
+    if(spsc_queue_pop(&free_buffers, &job.pixels)) {
+        if(filename[0] != 0) {
+            PERROR("Screenshot '%s' dropped, writer is busy!", filename);
+        }
+        dropped += repeat;
+        return;
+    }
+    memcpy(job.pixels, pixels, CAPTURE_SIZE);
+    job.type = JOB_FRAME;
+    job.repeat = repeat;
+    job.bottom_up = bottom_up;
+    strcpy(job.filename, filename);
+    capture_send(&job);
+}
+
+int capture_init() {
+    if(running) {
+        return 0;
+    }
+    if(spsc_queue_create(&jobs, CAPTURE_JOBS, sizeof(capture_job))
+        || spsc_queue_create(&free_buffers, CAPTURE_BUFFERS, sizeof(unsigned char*))) {
+        PERROR("Unable to allocate capture queues!");
+        return 1;
+    }
+    for(int i = 0; i < CAPTURE_BUFFERS; i++) {
+        buffers[i] = malloc(CAPTURE_SIZE);
+        spsc_queue_push(&free_buffers, &buffers[i]);
+    }
+    ready = SDL_CreateSemaphore(0);
+    writer = SDL_CreateThread(capture_writer_run, "capture writer", NULL);
+    if(writer == NULL) {
+        PERROR("Could not create capture writer thread: %s", SDL_GetError());
+        SDL_DestroySemaphore(ready);
+        for(int i = 0; i < CAPTURE_BUFFERS; i++) {
+            free(buffers[i]);
+        }
+        spsc_queue_free(&jobs);
+        spsc_queue_free(&free_buffers);
+        return 1;
+    }
+
+    // Pixel buffer objects let glReadPixels return before the GPU is done
+    use_pbo = !video_is_software() && (GLEW_VERSION_2_1 || GLEW_ARB_pixel_buffer_object);
+    if(use_pbo) {
+        for(int i = 0; i < CAPTURE_PBOS; i++) {
+            glGenBuffers(1, &pbos[i].id);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i].id);
+            glBufferData(GL_PIXEL_PACK_BUFFER, CAPTURE_SIZE, NULL, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+    pbo_head = 0;
+    pbo_count = 0;
+    frame = 0;
+    ticks = 0;
+    recording = 0;
+    dropped = 0;
+    screenshot[0] = 0;
+    running = 1;
+    return 0;
+}
+
+// Hands over the oldest readbacks, once they have had time to finish.
+// If all is set, everything in flight is handed over.
+static void capture_collect(int all) {
+    if(pbo_count == 0) {
+        return;
+    }
+    while(pbo_count > 0) {
+        capture_pbo *p = &pbos[pbo_head];
+        if(!all && frame - p->frame < CAPTURE_LATENCY) {
+            break;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, p->id);
+        const unsigned char *pixels = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+        if(pixels != NULL) {
+            capture_deliver(pixels, 1, p->repeat, p->screenshot);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        } else {
+            PERROR("Unable to map capture buffer!");
+            dropped += p->repeat;
+        }
+        pbo_head = (pbo_head + 1) % CAPTURE_PBOS;
+        pbo_count--;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void capture_close() {
+    if(!running) {
+        return;
+    }
+    capture_record_stop();
+    if(use_pbo) {
+        capture_collect(1);
+        for(int i = 0; i < CAPTURE_PBOS; i++) {
+            glDeleteBuffers(1, &pbos[i].id);
+        }
+    }
+    capture_job job;
+    job.type = JOB_QUIT;
+    capture_send(&job);
+    SDL_WaitThread(writer, NULL);
+    SDL_DestroySemaphore(ready);
+    for(int i = 0; i < CAPTURE_BUFFERS; i++) {
+        free(buffers[i]);
+    }
+    spsc_queue_free(&jobs);
+    spsc_queue_free(&free_buffers);
+    running = 0;
+}
+
+void capture_screenshot(const char *filename) {
+    strncpy(screenshot, filename, CAPTURE_NAME - 1);
+    screenshot[CAPTURE_NAME - 1] = 0;
+}
+
+int capture_record_start(const char *filename, int ms_per_tick) {
+    if(!running || video_is_headless()) {
+        return 1;
+    }
+    // File is opened here, so that the caller knows if there will be a recording
+    capture_job job;
+    job.file = fopen(filename, "wb");
+    if(job.file == NULL) {
+        PERROR("Unable to open '%s' for recording!", filename);
+        return 1;
+    }
+    capture_record_stop();
+    job.type = JOB_START;
+    job.repeat = ms_per_tick;
+    strncpy(job.filename, filename, CAPTURE_NAME - 1);
+    job.filename[CAPTURE_NAME - 1] = 0;
+    capture_send(&job);
+    recording = 1;
+    dropped = 0;
+    return 0;
+}
+
+void capture_record_stop() {
+    if(!recording) {
+        return;
+    }
+    // Frames still being read back belong to this recording
+    if(use_pbo) {
+        capture_collect(1);
+    }
+    capture_job job;
+    job.type = JOB_STOP;
+    capture_send(&job);
+    recording = 0;
+    if(dropped > 0) {
+        PERROR("Recording dropped %u frames; writer could not keep up.", dropped);
+    }
+}
+
+int capture_is_recording() {
+    return recording;
+}
+
+void capture_set_ticks(int t) {
+    ticks = t;
+}
+
+void capture_read() {
+    if(!running) {
+        return;
+    }
+    int repeat = recording ? ticks : 0;
+    ticks = 0;
+    frame++;
+    if(use_pbo) {
+        capture_collect(0);
+    }
+    if(screenshot[0] == 0 && repeat <= 0) {
+        return;
+    }
+
+    if(video_is_software()) {
+        capture_deliver(soft_get_frame(), 0, repeat, screenshot);
+    } else if(use_pbo) {
+        if(pbo_count == CAPTURE_PBOS) {
+            capture_collect(1);
+        }
+        capture_pbo *p = &pbos[(pbo_head + pbo_count) % CAPTURE_PBOS];
+        p->frame = frame;
+        p->repeat = repeat;
+        strcpy(p->screenshot, screenshot);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, p->id);
+        glReadPixels(0, 0, NATIVE_W, NATIVE_H, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        pbo_count++;
+    } else {
+        // No pixel buffer objects; read straight into a buffer
+        capture_job job;
+        if(spsc_queue_pop(&free_buffers, &job.pixels)) {
+            if(screenshot[0] != 0) {
+                PERROR("Screenshot '%s' dropped, writer is busy!", screenshot);
+            }
+            dropped += repeat;
+        } else {
+            glReadPixels(0, 0, NATIVE_W, NATIVE_H, GL_RGBA, GL_UNSIGNED_BYTE, job.pixels);
+            job.type = JOB_FRAME;
+            job.repeat = repeat;
+            job.bottom_up = 1;
+            strcpy(job.filename, screenshot);
+            capture_send(&job);
+        }
+    }
+    screenshot[0] = 0;
+}
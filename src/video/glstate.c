@@ -0,0 +1,168 @@
+#include "video/glstate.h"
+#include <GL/glew.h>
+
+// No GL enum or name has this value, so anything compared to it differs
+#define UNKNOWN 0xFFFFFFFF
+
+enum {
+    CAP_BLEND = 0,
+    CAP_ALPHA_TEST,
+    CAP_STENCIL_TEST,
+    CAP_TEXTURE_2D,
+    CAP_COUNT
+};
+
+typedef struct glstate_t {
+    int caps[CAP_COUNT];      // 0 or 1, or -1 if unknown
+    unsigned int blend[2];
+    unsigned int alpha_func;
+    float alpha_ref;
+    unsigned int stencil_func;
+    int stencil_ref;
+    unsigned int stencil_mask;
+    unsigned int stencil_op[3];
+    int unit;
+    unsigned int textures[GLSTATE_TEXTURE_UNITS];
+    int color_known;
+    float color[4];
+} glstate;
+
+static glstate state;
+static glstate_stats stats = {0, 0};
+
+void glstate_reset() {
+    for(int i = 0; i < CAP_COUNT; i++) {
+        state.caps[i] = -1;
+    }
+    state.blend[0] = state.blend[1] = UNKNOWN;
+    state.alpha_func = UNKNOWN;
+    state.stencil_func = UNKNOWN;
+    state.stencil_op[0] = state.stencil_op[1] = state.stencil_op[2] = UNKNOWN;
+    state.unit = -1;
+    for(int i = 0; i < GLSTATE_TEXTURE_UNITS; i++) {
+        state.textures[i] = UNKNOWN;
+    }
+    state.color_known = 0;
+}
+
+// Returns 1 if the call has to be made, and counts it either way
+static int glstate_changed(int changed) {
+    if(changed) {
+        stats.calls++;
+    } else {
+        stats.skipped++;
+    }
+    return changed;
+}
+
+void glstate_enable(unsigned int cap, int enabled) {
+    int i;
+    switch(cap) {
+        case GL_BLEND: i = CAP_BLEND; break;
+        case GL_ALPHA_TEST: i = CAP_ALPHA_TEST; break;
+        case GL_STENCIL_TEST: i = CAP_STENCIL_TEST; break;
+        case GL_TEXTURE_2D: i = CAP_TEXTURE_2D; break;
+        default:
+            // Not tracked
+            if(enabled) {
+                glEnable(cap);
+            } else {
+                glDisable(cap);
+            }
+            return;
+    }
+    enabled = (enabled != 0);
+    if(glstate_changed(state.caps[i] != enabled)) {
+        if(enabled) {
+            glEnable(cap);
+        } else {
+            glDisable(cap);
+        }
+        state.caps[i] = enabled;
+    }
+}
+
+void glstate_blend_func(unsigned int src, unsigned int dst) {
+    if(glstate_changed(state.blend[0] != src || state.blend[1] != dst)) {
+        glBlendFunc(src, dst);
+        state.blend[0] = src;
+        state.blend[1] = dst;
+    }
+}
+
+void glstate_alpha_func(unsigned int func, float ref) {
+    if(glstate_changed(state.alpha_func != func || state.alpha_ref != ref)) {
+        glAlphaFunc(func, ref);
+        state.alpha_func = func;
+        state.alpha_ref = ref;
+    }
+}
+
+void glstate_stencil_func(unsigned int func, int ref, unsigned int mask) {
+    if(glstate_changed(state.stencil_func != func || state.stencil_ref != ref || state.stencil_mask != mask)) {
+        glStencilFunc(func, ref, mask);
+        state.stencil_func = func;
+        state.stencil_ref = ref;
+        state.stencil_mask = mask;
+    }
+}
+
+void glstate_stencil_op(unsigned int sfail, unsigned int dpfail, unsigned int dppass) {
+    if(glstate_changed(state.stencil_op[0] != sfail || state.stencil_op[1] != dpfail || state.stencil_op[2] != dppass)) {
+        glStencilOp(sfail, dpfail, dppass);
+        state.stencil_op[0] = sfail;
+        state.stencil_op[1] = dpfail;
+        state.stencil_op[2] = dppass;
+    }
+}
+
+void glstate_active_texture(int unit) {
+    if(glstate_changed(state.unit != unit)) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        state.unit = unit;
+    }
+}
+
+void glstate_bind_texture(unsigned int id) {
+    // Unit is unknown only right after a reset
+    if(state.unit < 0) {
+        glstate_active_texture(0);
+    }
+    if(glstate_changed(state.textures[state.unit] != id)) {
+        glBindTexture(GL_TEXTURE_2D, id);
+        state.textures[state.unit] = id;
+    }
+}
+
+// Deleted textures are unbound from every unit by GL
+void glstate_forget_texture(unsigned int id) {
+    for(int i = 0; i < GLSTATE_TEXTURE_UNITS; i++) {
+        if(state.textures[i] == id) {
+            state.textures[i] = 0;
+        }
+    }
+}
+
+void glstate_color(float r, float g, float b, float a) {
+    if(glstate_changed(!state.color_known
+        || state.color[0] != r || state.color[1] != g
+        || state.color[2] != b || state.color[3] != a)) {
+        glColor4f(r, g, b, a);
+        state.color_known = 1;
+        state.color[0] = r;
+        state.color[1] = g;
+        state.color[2] = b;
+        state.color[3] = a;
+    }
+}
+
+// Current color is undefined after drawing from a color array
+void glstate_forget_color() {
+    state.color_known = 0;
+}
+
+void glstate_get_stats(glstate_stats *s) {
+    *s = stats;
+    stats.calls = 0;
+    stats.skipped = 0;
+}
@@ -0,0 +1,98 @@
+#include "video/golden.h"
+#include "video/soft.h"
+#include "video/video.h"
+#include "utils/log.h"
+#include <stdio.h>
+#include <string.h>
+
+#define GOLDEN_SIZE (NATIVE_W * NATIVE_H * 4)
+
+static const char *golden_dir = ".";
+static int golden_write = 0;
+static golden_stats stats;
+static unsigned char reference[GOLDEN_SIZE];
+
+void golden_init(const char *dir, int write) {
+    golden_dir = dir;
+    golden_write = write;
+    memset(&stats, 0, sizeof(golden_stats));
+}
+
+static int golden_save(const char *filename, const unsigned char *frame) {
+    FILE *f = fopen(filename, "wb");
+    if(f == NULL) {
+        PERROR("Unable to open golden frame '%s' for writing!", filename);
+        return 1;
+    }
+    int ret = (fwrite(frame, GOLDEN_SIZE, 1, f) != 1);
+    fclose(f);
+    if(ret) {
+        PERROR("Error while writing golden frame '%s'!", filename);
+    }
+    return ret;
+}
+
+static int golden_load(const char *filename) {
+    FILE *f = fopen(filename, "rb");
+    if(f == NULL) {
+        return 1;
+    }
+    int ret = (fread(reference, GOLDEN_SIZE, 1, f) != 1);
+    fclose(f);
+    return ret;
+}
+
+// Logs how many pixels differ, and the area they are in
+static void golden_report(const char *name, const unsigned char *frame) {
+    int x0 = NATIVE_W, y0 = NATIVE_H, x1 = -1, y1 = -1;
+    unsigned int diff = 0;
+    for(int y = 0; y < NATIVE_H; y++) {
+        const unsigned char *a = frame + y * NATIVE_W * 4;
+        const unsigned char *b = reference + y * NATIVE_W * 4;
+        if(memcmp(a, b, NATIVE_W * 4) == 0) {
+            continue;
+        }
+        for(int x = 0; x < NATIVE_W; x++) {
+            if(memcmp(a + x*4, b + x*4, 4) != 0) {
+                diff++;
+                if(x < x0) x0 = x;
+                if(x > x1) x1 = x;
+                if(y < y0) y0 = y;
+                if(y > y1) y1 = y;
+            }
+        }
+    }
+    PERROR("Golden frame '%s' differs: %u pixels between %d,%d and %d,%d.",
+        name, diff, x0, y0, x1, y1);
+}
+
+int golden_frame(const char *name) {
+    const unsigned char *frame = soft_get_frame();
+    char filename[512];
+    stats.frames++;
+    snprintf(filename, sizeof(filename), "%s/%s.rgba", golden_dir, name);
+    if(golden_write) {
+        if(golden_save(filename, frame)) {
+            stats.failed++;
+            return 1;
+        }
+        return 0;
+    }
+    if(golden_load(filename)) {
+        PERROR("No golden frame '%s'!", filename);
+        stats.missing++;
+        return 1;
+    }
+    if(memcmp(frame, reference, GOLDEN_SIZE) == 0) {
+        return 0;
+    }
+    stats.failed++;
+    golden_report(name, frame);
+    snprintf(filename, sizeof(filename), "%s/%s.new", golden_dir, name);
+    golden_save(filename, frame);
+    return 1;
+}
+
+void golden_get_stats(golden_stats *s) {
+    *s = stats;
+}
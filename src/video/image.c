@@ -5,8 +5,11 @@
 #include <math.h>
 #include <stdint.h>
 #include <stdio.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-#define CHECK_COORD_BOUNDS(n, x) n = (n >= x ? (x-1) : (n < 0 ? 0 : n))
+#define CHECK_COORD_BOUNDS(n, x) n = (n >= (int)(x) ? ((int)(x)-1) : (n < 0 ? 0 : n))
 
 typedef struct __attribute__ ((__packed__)) tga_header_t {
     uint8_t id;
@@ -45,8 +48,50 @@ void image_clear(image *img, color c) {
     image_filled_rect(img, 0, 0, img->w, img->h, c);
 }
 
-// Bresenham
+// Fills pixels x0..x1 of row y. Coordinates must be inside the image.
+static void image_span(image *img, int x0, int x1, int y, color c) {
+    uint32_t px;
+    unsigned char rgba[4] = {c.r, c.g, c.b, c.a};
+    memcpy(&px, rgba, 4);
+    char *d = img->data + (y * img->w + x0) * 4;
+    int n = x1 - x0 + 1;
+    int i = 0;
+#ifdef __SSE2__
+    __m128i v = _mm_set1_epi32(px);
+    for(; i + 4 <= n; i += 4) {
+        _mm_storeu_si128((__m128i*)(d + i*4), v);
+    }
+#endif
+    for(; i < n; i++) {
+        memcpy(d + i*4, &px, 4);
+    }
+}
+
+// Straight lines are drawn as spans. Like with image_set_pixel, points
+// outside the image are moved to its edges.
 void image_line(image *img, int x0, int y0, int x1, int y1, color c) {
+    if(y0 == y1 || x0 == x1) {
+        int xa = (x0 < x1) ? x0 : x1;
+        int xb = (x0 < x1) ? x1 : x0;
+        int ya = (y0 < y1) ? y0 : y1;
+        int yb = (y0 < y1) ? y1 : y0;
+        CHECK_COORD_BOUNDS(xa, img->w);
+        CHECK_COORD_BOUNDS(xb, img->w);
+        CHECK_COORD_BOUNDS(ya, img->h);
+        CHECK_COORD_BOUNDS(yb, img->h);
+        if(xa == xb) {
+            unsigned char rgba[4] = {c.r, c.g, c.b, c.a};
+            char *d = img->data + (ya * img->w + xa) * 4;
+            for(int y = ya; y <= yb; y++, d += img->w * 4) {
+                memcpy(d, rgba, 4);
+            }
+        } else {
+            image_span(img, xa, xb, ya, c);
+        }
+        return;
+    }
+
+    // Bresenham
     int dx = abs(x1 - x0);
     int sx = (x0 < x1) ? 1 : -1;
     int dy = abs(y1 - y0);
@@ -90,14 +135,47 @@ void image_rect_bevel(image *img,
     image_line(img, x, y, x, y+h, cleft);
 }
 
+// First row is filled, and then copied to the rest
 void image_filled_rect(image *img, int x, int y, int w, int h, color c) {
-    for(int my = y; my < y+h; my++) {
-        for(int mx = x; mx < x+w; mx++) {
-            image_set_pixel(img, mx, my, c);
-        }
+    if(w <= 0 || h <= 0) {
+        return;
+    }
+    int x0 = x, x1 = x + w - 1;
+    int y0 = y, y1 = y + h - 1;
+    CHECK_COORD_BOUNDS(x0, img->w);
+    CHECK_COORD_BOUNDS(x1, img->w);
+    CHECK_COORD_BOUNDS(y0, img->h);
+    CHECK_COORD_BOUNDS(y1, img->h);
+    image_span(img, x0, x1, y0, c);
+    const char *first = img->data + (y0 * img->w + x0) * 4;
+    for(int my = y0 + 1; my <= y1; my++) {
+        memcpy(img->data + (my * img->w + x0) * 4, first, (x1 - x0 + 1) * 4);
+    }
+}
+
+// Copies src to dst at x,y. Unlike drawing, whatever is outside dst is left out.
+void image_blit(image *dst, const image *src, int x, int y) {
+    int sx = (x < 0) ? -x : 0;
+    int sy = (y < 0) ? -y : 0;
+    int w = (int)src->w - sx;
+    int h = (int)src->h - sy;
+    if(x + sx + w > (int)dst->w) {
+        w = (int)dst->w - x - sx;
+    }
+    if(y + sy + h > (int)dst->h) {
+        h = (int)dst->h - y - sy;
+    }
+    if(w <= 0) {
+        return;
+    }
+    for(int j = 0; j < h; j++) {
+        memcpy(dst->data + ((y + sy + j) * dst->w + x + sx) * 4,
+               src->data + ((sy + j) * src->w + sx) * 4,
+               w * 4);
     }
 }
 
+// Image is RGBA, top row first. TGA wants BGRA.
 void image_write_tga(image *img, const char *filename) {
     // Open file
     FILE *fp = fopen(filename, "wb");
@@ -117,12 +195,23 @@ void image_write_tga(image *img, const char *filename) {
     header.origin_y = 0;
     header.width = img->w;
     header.height = img->h;
-    header.depth = 24;
-    header.descriptor = 0;
+    header.depth = 32;
+    header.descriptor = 0x28; // 8 alpha bits, top row first
     fwrite(&header, sizeof(tga_header), 1, fp);
     
     // Write data
-    fwrite(img->data, img->w * img->h * 4, 1, fp);
+    char *row = malloc(img->w * 4);
+    for(unsigned int y = 0; y < img->h; y++) {
+        const char *src = img->data + y * img->w * 4;
+        for(unsigned int x = 0; x < img->w; x++) {
+            row[x*4+0] = src[x*4+2];
+            row[x*4+1] = src[x*4+1];
+            row[x*4+2] = src[x*4+0];
+            row[x*4+3] = src[x*4+3];
+        }
+        fwrite(row, img->w * 4, 1, fp);
+    }
+    free(row);
     
     // Free file
     fclose(fp);
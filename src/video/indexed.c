@@ -0,0 +1,163 @@
+#include "video/indexed.h"
+#include "video/shaderprogram.h"
+#include "video/shader.h"
+#include "video/texture.h"
+#include "video/batch.h"
+#include "video/glstate.h"
+#include "video/video.h"
+#include "utils/log.h"
+#include <GL/glew.h>
+#include <string.h>
+
+static const char *vertex_source =
+    "void main() {\n"
+    "    gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+    "    gl_FrontColor = gl_Color;\n"
+    "    gl_Position = ftransform();\n"
+    "}\n";
+
+// Luminance holds the palette index
+static const char *fragment_source =
+    "uniform sampler2D sprite;\n"
+    "uniform sampler2D palette;\n"
+    "void main() {\n"
+    "    vec4 px = texture2D(sprite, gl_TexCoord[0].st);\n"
+    "    vec4 c = texture2D(palette, vec2((px.r * 255.0 + 0.5) / 256.0, 0.5));\n"
+    "    gl_FragColor = vec4(c.rgb, px.a) * gl_Color;\n"
+    "}\n";
+
+typedef struct palette_entry_t {
+    const unsigned char *colors;
+    const unsigned char *remap;
+    unsigned char copy[256 * 3 + 256]; // What the texture was made from
+    unsigned int last_used;
+    texture tex;
+} palette_entry;
+
+static shaderprogram prog;
+static int supported = 0;
+static unsigned int uses = 0;
+static palette_entry palettes[INDEXED_PALETTES];
+
+int indexed_init() {
+    shader vs, fs;
+    supported = 0;
+    for(int i = 0; i < INDEXED_PALETTES; i++) {
+        palettes[i].colors = NULL;
+        palettes[i].last_used = 0;
+        texture_create(&palettes[i].tex);
+    }
+
+    // Without shaders, sprites are decoded to RGBA instead
+    if(!GLEW_VERSION_2_0) {
+        INFO("No GLSL support, palettes are applied on the CPU.");
+        return 0;
+    }
+    if(shader_create_from_source(&vs, vertex_source, SHADER_VERTEX)) {
+        shader_debug_log(&vs);
+        shader_free(&vs);
+        PERROR("Unable to compile palette vertex shader!");
+        return 0;
+    }
+    if(shader_create_from_source(&fs, fragment_source, SHADER_FRAGMENT)) {
+        shader_debug_log(&fs);
+        shader_free(&fs);
+        shader_free(&vs);
+        PERROR("Unable to compile palette fragment shader!");
+        return 0;
+    }
+    shaderprog_create(&prog);
+    shaderprog_attach(&prog, &vs);
+    shaderprog_attach(&prog, &fs);
+    if(shaderprog_link(&prog)) {
+        shaderprog_debug_log(&prog);
+        shaderprog_free(&prog);
+        PERROR("Unable to link palette shader!");
+        return 0;
+    }
+    shaderprog_use(&prog, 1);
+    shaderprog_set(&prog, "sprite", 0);
+    shaderprog_set(&prog, "palette", 1);
+    shaderprog_use(&prog, 0);
+    supported = 1;
+    return 0;
+}
+
+void indexed_close() {
+    for(int i = 0; i < INDEXED_PALETTES; i++) {
+        texture_free(&palettes[i].tex);
+    }
+    if(supported) {
+        shaderprog_free(&prog);
+        supported = 0;
+    }
+}
+
+// Software renderer looks up palettes on its own
+int indexed_supported() {
+    return supported || video_is_software();
+}
+
+static void indexed_make(palette_entry *p, const unsigned char *colors, const unsigned char *remap) {
+    unsigned char data[256 * 4];
+    for(int i = 0; i < 256; i++) {
+        int c = remap ? remap[i] : i;
+        data[i*4+0] = colors[c*3+0];
+        data[i*4+1] = colors[c*3+1];
+        data[i*4+2] = colors[c*3+2];
+        data[i*4+3] = 255;
+    }
+    p->colors = colors;
+    p->remap = remap;
+    memcpy(p->copy, colors, 256 * 3);
+    if(remap) {
+        memcpy(p->copy + 256 * 3, remap, 256);
+    }
+    if(p->tex.id == 0) {
+        texture_init(&p->tex, (char*)data, 256, 1);
+    } else {
+        texture_upload(&p->tex, (char*)data);
+    }
+}
+
+unsigned int indexed_palette(const unsigned char *colors, const unsigned char *remap) {
+    if(!supported) {
+        return 0;
+    }
+    uses++;
+
+    // Palettes can be changed in place, so check the contents too
+    palette_entry *oldest = &palettes[0];
+    for(int i = 0; i < INDEXED_PALETTES; i++) {
+        palette_entry *p = &palettes[i];
+        if(p->colors == colors && p->remap == remap) {
+            if(memcmp(p->copy, colors, 256 * 3) != 0
+                || (remap && memcmp(p->copy + 256 * 3, remap, 256) != 0)) {
+                indexed_make(p, colors, remap);
+            }
+            p->last_used = uses;
+            return p->tex.id;
+        }
+        if(p->last_used < oldest->last_used) {
+            oldest = p;
+        }
+    }
+
+    // Replace the least recently used one
+    indexed_make(oldest, colors, remap);
+    oldest->last_used = uses;
+    return oldest->tex.id;
+}
+
+void indexed_begin(unsigned int palette_id) {
+    shaderprog_use(&prog, 1);
+    glstate_active_texture(1);
+    glstate_bind_texture(palette_id);
+    glstate_active_texture(0);
+}
+
+// Palette stays bound to unit 1. Fixed function texturing is never
+// enabled there, so it does not affect anything else.
+void indexed_end() {
+    shaderprog_use(&prog, 0);
+}
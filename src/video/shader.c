@@ -30,7 +30,12 @@ int shader_create(shader *shader, const char *filename, int type) {
         return 1;
     }
     fclose(f);
-    
+    int ret = shader_create_from_source(shader, buf, type);
+    free(buf);
+    return ret;
+}
+
+int shader_create_from_source(shader *shader, const char *buf, int type) {
     // Create shader
     switch(type) {
         case SHADER_VERTEX:   shader->id = glCreateShader(GL_VERTEX_SHADER);   break;
@@ -38,13 +43,11 @@ int shader_create(shader *shader, const char *filename, int type) {
         case SHADER_GEOMETRY: shader->id = glCreateShader(GL_GEOMETRY_SHADER); break;
         default:
             PERROR("Invalid shader type!");
-            free(buf);
             return 1;
     }
     glShaderSource(shader->id, 1, (const GLchar**)&buf, 0);
     glCompileShader(shader->id);
     shader->type = type;
-    free(buf);
     int compiled = 0;
     glGetShaderiv(shader->id, GL_COMPILE_STATUS, &compiled);
     return !compiled;
@@ -0,0 +1,265 @@
+#include "video/soft.h"
+#include "video/video.h"
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static unsigned char frame[NATIVE_W * NATIVE_H * 4];
+static unsigned char stencil[NATIVE_W * NATIVE_H];
+static unsigned char row[NATIVE_W * 4]; // Source pixels of the row being drawn
+
+int soft_init() {
+    soft_clear();
+    return 0;
+}
+
+void soft_close() {
+}
+
+void soft_clear() {
+    memset(frame, 0, sizeof(frame));
+    memset(stencil, 0, sizeof(stencil));
+}
+
+const unsigned char* soft_get_frame() {
+    return frame;
+}
+
+void soft_make_palette(uint32_t *palette, const unsigned char *colors, const unsigned char *remap) {
+    unsigned char *p = (unsigned char*)palette;
+    for(int i = 0; i < 256; i++) {
+        int c = remap ? remap[i] : i;
+        p[i*4+0] = colors[c*3+0];
+        p[i*4+1] = colors[c*3+1];
+        p[i*4+2] = colors[c*3+2];
+        p[i*4+3] = 255;
+    }
+}
+
+static inline unsigned char mul8(int a, int b) {
+    return (a * b + 127) / 255;
+}
+
+// -------- Span kernels. All of them work on n pixels of one framebuffer row. --------
+
+// BLEND_ALPHA: alpha tested copy. Drawn pixels are marked in the stencil, if mark is set.
+static void span_alpha(unsigned char *d, unsigned char *m, const unsigned char *s, int n, int mark) {
+    int i = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi8(1);
+    for(; i + 4 <= n; i += 4) {
+        __m128i sv = _mm_loadu_si128((const __m128i*)(s + i*4));
+        __m128i dv = _mm_loadu_si128((const __m128i*)(d + i*4));
+        __m128i mask = _mm_cmpgt_epi32(_mm_srli_epi32(sv, 24), zero);
+        dv = _mm_or_si128(_mm_and_si128(mask, sv), _mm_andnot_si128(mask, dv));
+        _mm_storeu_si128((__m128i*)(d + i*4), dv);
+        if(mark) {
+            int drawn = _mm_cvtsi128_si32(_mm_and_si128(_mm_packs_epi16(_mm_packs_epi32(mask, zero), zero), ones));
+            int old;
+            memcpy(&old, m + i, 4);
+            old |= drawn;
+            memcpy(m + i, &old, 4);
+        }
+    }
+#endif
+    for(; i < n; i++) {
+        if(s[i*4+3] > 0) {
+            memcpy(d + i*4, s + i*4, 4);
+            if(mark) {
+                m[i] = 1;
+            }
+        }
+    }
+}
+
+// BLEND_ADDITIVE: saturating add of premultiplied source, only onto marked pixels
+static void span_additive(unsigned char *d, const unsigned char *m, const unsigned char *s, int n) {
+    int i = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    for(; i + 4 <= n; i += 4) {
+        int marks;
+        memcpy(&marks, m + i, 4);
+        __m128i mv = _mm_cvtsi32_si128(marks);
+        mv = _mm_unpacklo_epi8(mv, mv);
+        mv = _mm_unpacklo_epi16(mv, mv);
+        __m128i unmarked = _mm_cmpeq_epi8(mv, zero);
+        __m128i sv = _mm_loadu_si128((const __m128i*)(s + i*4));
+        __m128i dv = _mm_loadu_si128((const __m128i*)(d + i*4));
+        __m128i sum = _mm_adds_epu8(dv, sv);
+        dv = _mm_or_si128(_mm_and_si128(unmarked, dv), _mm_andnot_si128(unmarked, sum));
+        _mm_storeu_si128((__m128i*)(d + i*4), dv);
+    }
+#endif
+    for(; i < n; i++) {
+        if(m[i]) {
+            for(int k = 0; k < 4; k++) {
+                int v = d[i*4+k] + s[i*4+k];
+                d[i*4+k] = (v > 255) ? 255 : v;
+            }
+        }
+    }
+}
+
+#ifdef __SSE2__
+// mul8 on 16 bit lanes; (x + 1 + (x >> 8)) >> 8 is x / 255 for all products of two bytes
+static inline __m128i mul8_epi16(__m128i a, __m128i b) {
+    __m128i x = _mm_add_epi16(_mm_mullo_epi16(a, b), _mm_set1_epi16(127));
+    x = _mm_add_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), _mm_set1_epi16(1));
+    return _mm_srli_epi16(x, 8);
+}
+
+// Mixes two pixels widened to 16 bit lanes, by the alpha in a
+static inline __m128i mix_epi16(__m128i s, __m128i d, __m128i a) {
+    __m128i inv = _mm_sub_epi16(_mm_set1_epi16(255), a);
+    return _mm_add_epi16(mul8_epi16(s, a), mul8_epi16(d, inv));
+}
+
+// Source alpha of both pixels, in all four lanes of each
+static inline __m128i alpha_epi16(__m128i s) {
+    s = _mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3));
+    return _mm_shufflehi_epi16(s, _MM_SHUFFLE(3, 3, 3, 3));
+}
+#endif
+
+// BLEND_ALPHA_FULL mixes by source alpha (constant < 0). BLEND_ALPHA_CONSTANT
+// mixes by a constant, and skips pixels with no alpha.
+static void span_mix(unsigned char *d, const unsigned char *s, int n, int constant) {
+    int i = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i cv = _mm_set1_epi16(constant);
+    for(; i + 4 <= n; i += 4) {
+        __m128i sv = _mm_loadu_si128((const __m128i*)(s + i*4));
+        __m128i dv = _mm_loadu_si128((const __m128i*)(d + i*4));
+        __m128i slo = _mm_unpacklo_epi8(sv, zero);
+        __m128i shi = _mm_unpackhi_epi8(sv, zero);
+        __m128i alo = (constant < 0) ? alpha_epi16(slo) : cv;
+        __m128i ahi = (constant < 0) ? alpha_epi16(shi) : cv;
+        __m128i lo = mix_epi16(slo, _mm_unpacklo_epi8(dv, zero), alo);
+        __m128i hi = mix_epi16(shi, _mm_unpackhi_epi8(dv, zero), ahi);
+        __m128i mixed = _mm_packus_epi16(lo, hi);
+        if(constant >= 0) {
+            __m128i skip = _mm_cmpeq_epi32(_mm_srli_epi32(sv, 24), zero);
+            mixed = _mm_or_si128(_mm_and_si128(skip, dv), _mm_andnot_si128(skip, mixed));
+        }
+        _mm_storeu_si128((__m128i*)(d + i*4), mixed);
+    }
+#endif
+    for(; i < n; i++) {
+        int a = (constant < 0) ? s[i*4+3] : constant;
+        if(constant >= 0 && s[i*4+3] == 0) {
+            continue;
+        }
+        for(int k = 0; k < 4; k++) {
+            d[i*4+k] = mul8(s[i*4+k], a) + mul8(d[i*4+k], 255 - a);
+        }
+    }
+}
+
+// Reads the source pixels for framebuffer columns x0..x1 of one row into row[]
+static void soft_fetch(const texture *tex, const uint32_t *palette, int sy, int tx, int tw,
+                       int x, int w, int x0, int x1, int hflip, color c, int premultiply) {
+    const unsigned char *src = (const unsigned char*)tex->pixels;
+    const unsigned char *pal = (const unsigned char*)palette;
+    int tinted = (c.r != 255 || c.g != 255 || c.b != 255 || c.a != 255);
+    for(int i = x0; i < x1; i++) {
+        int sx = (i - x) * tw / w;
+        if(hflip) {
+            sx = tw - 1 - sx;
+        }
+        unsigned char *out = row + (i - x0) * 4;
+        if(tex->indexed) {
+            const unsigned char *px = src + (sy * tex->w + tx + sx) * 2;
+            memcpy(out, pal + px[0] * 4, 3);
+            out[3] = px[1];
+        } else {
+            memcpy(out, src + (sy * tex->w + tx + sx) * 4, 4);
+        }
+        if(tinted) {
+            out[0] = mul8(out[0], c.r);
+            out[1] = mul8(out[1], c.g);
+            out[2] = mul8(out[2], c.b);
+            out[3] = mul8(out[3], c.a);
+        }
+        if(premultiply) {
+            out[0] = mul8(out[0], out[3]);
+            out[1] = mul8(out[1], out[3]);
+            out[2] = mul8(out[2], out[3]);
+            out[3] = mul8(out[3], out[3]);
+        }
+    }
+}
+
+// Constant is the alpha for BLEND_ALPHA_CONSTANT. For BLEND_ALPHA, mark tells
+// whether drawn pixels are marked in the stencil.
+static void soft_span(int mode, int j, int x0, int n, int constant, int mark) {
+    unsigned char *d = frame + (j * NATIVE_W + x0) * 4;
+    unsigned char *m = stencil + j * NATIVE_W + x0;
+    switch(mode) {
+        case BLEND_ADDITIVE: span_additive(d, m, row, n); break;
+        case BLEND_ALPHA_FULL: span_mix(d, row, n, -1); break;
+        case BLEND_ALPHA_CONSTANT: span_mix(d, row, n, constant); break;
+        default: span_alpha(d, m, row, n, mark); break;
+    }
+}
+
+// For BLEND_ALPHA, mark tells whether drawn pixels are marked in the stencil
+static void soft_draw_area(const texture *tex, const uint32_t *palette, int tx, int ty, int tw, int th,
+                           int x, int y, int w, int h, int flip_mode, int mode, color c, int mark) {
+    if(tex->pixels == NULL || w <= 0 || h <= 0 || tw <= 0 || th <= 0) {
+        return;
+    }
+    if(tex->indexed && palette == NULL) {
+        return;
+    }
+    int x0 = (x < 0) ? 0 : x;
+    int x1 = (x + w > NATIVE_W) ? NATIVE_W : x + w;
+    int y0 = (y < 0) ? 0 : y;
+    int y1 = (y + h > NATIVE_H) ? NATIVE_H : y + h;
+    if(x0 >= x1 || y0 >= y1) {
+        return;
+    }
+    for(int j = y0; j < y1; j++) {
+        int sy = (j - y) * th / h;
+        if(flip_mode & FLIP_VERTICAL) {
+            sy = th - 1 - sy;
+        }
+        soft_fetch(tex, palette, ty + sy, tx, tw, x, w, x0, x1,
+            flip_mode & FLIP_HORIZONTAL, c, mode == BLEND_ADDITIVE);
+        soft_span(mode, j, x0, x1 - x0, c.a, mark);
+    }
+}
+
+void soft_draw(const texture *tex, const uint32_t *palette, int tx, int ty, int tw, int th,
+               int x, int y, int w, int h, int flip_mode, int rendering_mode, color c) {
+    soft_draw_area(tex, palette, tx, ty, tw, th, x, y, w, h, flip_mode, rendering_mode, c, 1);
+}
+
+// Untextured quads are always drawn with full alpha blending
+void soft_fill(int x, int y, int w, int h, color c) {
+    int x0 = (x < 0) ? 0 : x;
+    int x1 = (x + w > NATIVE_W) ? NATIVE_W : x + w;
+    int y0 = (y < 0) ? 0 : y;
+    int y1 = (y + h > NATIVE_H) ? NATIVE_H : y + h;
+    if(x0 >= x1 || y0 >= y1) {
+        return;
+    }
+    for(int i = 0; i < x1 - x0; i++) {
+        row[i*4+0] = c.r;
+        row[i*4+1] = c.g;
+        row[i*4+2] = c.b;
+        row[i*4+3] = c.a;
+    }
+    for(int j = y0; j < y1; j++) {
+        soft_span(BLEND_ALPHA_FULL, j, x0, x1 - x0, 0, 0);
+    }
+}
+
+// Background covers the whole screen, and leaves the stencil alone
+void soft_background(const texture *tex) {
+    soft_draw_area(tex, NULL, 0, 0, tex->w, tex->h, 0, 0, NATIVE_W, NATIVE_H,
+        FLIP_NONE, BLEND_ALPHA, COLOR_WHITE, 0);
+}
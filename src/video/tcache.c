@@ -0,0 +1,181 @@
+#include "video/tcache.h"
+#include "utils/log.h"
+#include <string.h>
+
+#define TCACHE_BUCKETS 256
+
+static tcache_entry entries[TCACHE_ENTRIES];
+static int buckets[TCACHE_BUCKETS];
+static unsigned int count = 0;
+static unsigned int bytes = 0;
+static unsigned int uses = 0;
+static tcache_stats stats;
+
+static uint32_t fnv_add(uint32_t h, const unsigned char *data, unsigned int len) {
+    for(unsigned int i = 0; i < len; i++) {
+        h = (h ^ data[i]) * 16777619u;
+    }
+    return h;
+}
+
+static unsigned int tcache_bucket(const tcache_key *key) {
+    uint32_t h = 2166136261u;
+    h = fnv_add(h, (const unsigned char*)&key->sprite, sizeof(key->sprite));
+    h = fnv_add(h, (const unsigned char*)&key->palette, sizeof(key->palette));
+    h = fnv_add(h, (const unsigned char*)&key->remap, sizeof(key->remap));
+    h = fnv_add(h, (const unsigned char*)&key->indexed, sizeof(key->indexed));
+    return h % TCACHE_BUCKETS;
+}
+
+static int tcache_key_equal(const tcache_key *a, const tcache_key *b) {
+    return a->sprite == b->sprite
+        && a->palette == b->palette
+        && a->remap == b->remap
+        && a->indexed == b->indexed;
+}
+
+int tcache_init() {
+    for(int i = 0; i < TCACHE_BUCKETS; i++) {
+        buckets[i] = -1;
+    }
+    for(int i = 0; i < TCACHE_ENTRIES; i++) {
+        entries[i].key.sprite = 0;
+        entries[i].refs = 0;
+        entries[i].next = -1;
+        texture_create(&entries[i].tex);
+    }
+    count = 0;
+    bytes = 0;
+    uses = 0;
+    memset(&stats, 0, sizeof(tcache_stats));
+    return 0;
+}
+
+void tcache_close() {
+    for(int i = 0; i < TCACHE_ENTRIES; i++) {
+        if(entries[i].key.sprite != 0) {
+            texture_free(&entries[i].tex);
+            entries[i].key.sprite = 0;
+        }
+    }
+    count = 0;
+    bytes = 0;
+}
+
+uint32_t tcache_palette_hash(const unsigned char *colors, const unsigned char *remap) {
+    uint32_t h = 2166136261u;
+    h = fnv_add(h, colors, 256 * 3);
+    if(remap != NULL) {
+        h = fnv_add(h, remap, 256);
+    }
+    return h;
+}
+
+static void tcache_evict(int slot) {
+    tcache_entry *e = &entries[slot];
+    int *link = &buckets[tcache_bucket(&e->key)];
+    while(*link != slot) {
+        link = &entries[*link].next;
+    }
+    *link = e->next;
+
+    bytes -= texture_size(&e->tex);
+    count--;
+    texture_free(&e->tex);
+    e->key.sprite = 0;
+    e->next = -1;
+}
+
+// Frees the least recently used entry nobody holds. Returns its slot, or -1.
+static int tcache_evict_lru() {
+    int oldest = -1;
+    for(int i = 0; i < TCACHE_ENTRIES; i++) {
+        tcache_entry *e = &entries[i];
+        if(e->key.sprite != 0 && e->refs == 0
+            && (oldest < 0 || e->last_used < entries[oldest].last_used)) {
+            oldest = i;
+        }
+    }
+    if(oldest >= 0) {
+        tcache_evict(oldest);
+        stats.evictions++;
+    }
+    return oldest;
+}
+
+// Finds a free slot, evicting old entries if the cache is full
+static int tcache_alloc() {
+    while(bytes > TCACHE_MAX_BYTES) {
+        if(tcache_evict_lru() < 0) {
+            break;
+        }
+    }
+    if(count < TCACHE_ENTRIES) {
+        for(int i = 0; i < TCACHE_ENTRIES; i++) {
+            if(entries[i].key.sprite == 0) {
+                return i;
+            }
+        }
+    }
+    return tcache_evict_lru();
+}
+
+texture* tcache_acquire(tcache_ref *ref, const tcache_key *key, tcache_fill fill, void *userdata) {
+    // Still holding the right one
+    if(ref->entry != NULL && tcache_key_equal(&ref->entry->key, key)) {
+        ref->entry->last_used = ++uses;
+        stats.hits++;
+        return &ref->entry->tex;
+    }
+    tcache_release(ref);
+
+    unsigned int bucket = tcache_bucket(key);
+    for(int i = buckets[bucket]; i >= 0; i = entries[i].next) {
+        if(tcache_key_equal(&entries[i].key, key)) {
+            entries[i].refs++;
+            entries[i].last_used = ++uses;
+            ref->entry = &entries[i];
+            stats.hits++;
+            return &entries[i].tex;
+        }
+    }
+
+    stats.misses++;
+    int slot = tcache_alloc();
+    if(slot < 0) {
+        PERROR("Texture cache is full of textures in use!");
+        return NULL;
+    }
+    tcache_entry *e = &entries[slot];
+    texture_create(&e->tex);
+    if(fill(&e->tex, userdata)) {
+        texture_free(&e->tex);
+        return NULL;
+    }
+    e->key = *key;
+    e->refs = 1;
+    e->last_used = ++uses;
+    e->next = buckets[bucket];
+    buckets[bucket] = slot;
+    count++;
+    bytes += texture_size(&e->tex);
+    ref->entry = e;
+    return &e->tex;
+}
+
+// Unused entries stay in the cache until they are evicted
+void tcache_release(tcache_ref *ref) {
+    if(ref->entry != NULL) {
+        ref->entry->refs--;
+        ref->entry = NULL;
+    }
+}
+
+void tcache_get_stats(tcache_stats *s) {
+    *s = stats;
+    s->entries = count;
+    s->bytes = bytes;
+    stats.hits = 0;
+    stats.misses = 0;
+    stats.evictions = 0;
+}
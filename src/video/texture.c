@@ -1,11 +1,37 @@
 #include "video/texture.h"
+#include "video/video.h"
+#include "video/batch.h"
+#include "video/glstate.h"
 #include "utils/log.h"
 #include <GL/glew.h>
 #include <stdlib.h>
 #include <memory.h>
 
+// Software renderer has no texture objects, but ids are still handed out,
+// so that nonzero means loaded everywhere.
+static unsigned int soft_ids = 0;
+
+static int texture_keep(texture *tex, const char *data) {
+    unsigned int size = texture_size(tex);
+    char *pixels = realloc(tex->pixels, size);
+    if(pixels == NULL) {
+        PERROR("Unable to allocate %u bytes for texture!", size);
+        return 1;
+    }
+    tex->pixels = pixels;
+    if(data != NULL) {
+        memcpy(pixels, data, size);
+    } else {
+        memset(pixels, 0, size);
+    }
+    return 0;
+}
+
 int texture_upload(texture *tex, const char* data) {
-    glBindTexture(GL_TEXTURE_2D, tex->id);
+    if(video_is_headless()) return 0;
+    if(video_is_software()) return texture_keep(tex, data);
+    batch_flush(); // Queued quads may use the old contents
+    glstate_bind_texture(tex->id);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tex->w, tex->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -18,10 +44,32 @@ int texture_upload(texture *tex, const char* data) {
     return 0;
 }
 
+// Data is two bytes per pixel: the palette index, and alpha
+int texture_upload_indexed(texture *tex, const char *data) {
+    if(video_is_headless()) return 0;
+    if(video_is_software()) return texture_keep(tex, data);
+    batch_flush(); // Queued quads may use the old contents
+    glstate_bind_texture(tex->id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE8_ALPHA8, tex->w, tex->h, 0, GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, data);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+#ifdef DEBUGMODE
+    if(glGetError() != GL_NO_ERROR) {
+        PERROR("Error while creating indexed texture!");
+        return 1;
+    }
+#endif
+    return 0;
+}
+
 void texture_create(texture *tex) {
     tex->w = 0;
     tex->h = 0;
     tex->id = 0;
+    tex->indexed = 0;
+    tex->pixels = NULL;
 }
 
 int texture_init(texture *tex, const char *data, unsigned int w, unsigned int h) {
@@ -31,16 +79,47 @@ int texture_init(texture *tex, const char *data, unsigned int w, unsigned int h)
     }
     tex->w = w;
     tex->h = h;
-    glGenTextures(1, &tex->id);
+    tex->indexed = 0;
+    if(video_is_headless()) return 0;
+    if(video_is_software()) {
+        tex->id = ++soft_ids;
+    } else {
+        glGenTextures(1, &tex->id);
+    }
     return texture_upload(tex, data);
 }
 
+int texture_init_indexed(texture *tex, const char *data, unsigned int w, unsigned int h) {
+    if(tex->id != 0) {
+        PERROR("Texture is already loaded. Free/reupload instead!");
+        return 1;
+    }
+    tex->w = w;
+    tex->h = h;
+    tex->indexed = 1;
+    if(video_is_headless()) return 0;
+    if(video_is_software()) {
+        tex->id = ++soft_ids;
+    } else {
+        glGenTextures(1, &tex->id);
+    }
+    return texture_upload_indexed(tex, data);
+}
+
 int texture_init_from_img(texture *tex, const image *img) {
     return texture_init(tex, img->data, img->w, img->h);
 }
 
 void texture_free(texture *tex) {
-    if(tex->id != 0) {
+    if(tex->id != 0 && video_is_software()) {
+        free(tex->pixels);
+        tex->pixels = NULL;
+        tex->id = 0;
+        tex->w = 0;
+        tex->h = 0;
+    } else if(tex->id != 0) {
+        batch_flush();
+        glstate_forget_texture(tex->id);
         glDeleteTextures(1, &tex->id);
         tex->id = 0;
         tex->w = 0;
@@ -49,17 +128,21 @@ void texture_free(texture *tex) {
 }
 
 unsigned int texture_size(texture *tex) {
-    return tex->w * tex->h * 4;
+    return tex->w * tex->h * (tex->indexed ? 2 : 4);
 }
 
 int texture_is_valid(texture *tex) {
+    if(video_is_headless()) return 0;
+    if(video_is_software()) return (tex->pixels != NULL);
     return glIsTexture(tex->id);
 }
 
 void texture_bind(texture *tex) {
-    glBindTexture(GL_TEXTURE_2D, tex->id);
+    if(video_is_headless() || video_is_software()) return;
+    glstate_bind_texture(tex->id);
 }
 
 void texture_unbind() {
-    glBindTexture(GL_TEXTURE_2D, 0);
+    if(video_is_headless() || video_is_software()) return;
+    glstate_bind_texture(0);
 }
@@ -6,11 +6,18 @@
 #include "video/shaderprogram.h"
 #include "video/shader.h"
 #include "video/image.h"
+#include "video/batch.h"
+#include "video/glstate.h"
+#include "video/tcache.h"
+#include "video/indexed.h"
+#include "video/soft.h"
+#include "video/capture.h"
 #include "utils/log.h"
 #include "utils/list.h"
 #include <SDL2/SDL.h>
 #include <GL/glew.h>
 #include <stdlib.h>
+#include <string.h>
 
 // HACK to notify the engine that vsync has changed
 extern int _vsync; 
@@ -20,6 +27,8 @@ SDL_GLContext glctx;
 fbo target;
 unsigned int fullscreen_quad, fullscreen_quad_flipped;
 int screen_w, screen_h;
+static int headless = 0;
+static int software = 0;
 
 int video_init(int window_w, int window_h, int fullscreen, int vsync) {
     screen_w = window_w;
@@ -81,7 +90,8 @@ int video_init(int window_w, int window_h, int fullscreen, int vsync) {
     }
     
     // Enable textures
-    glEnable(GL_TEXTURE_2D);
+    glstate_reset();
+    glstate_enable(GL_TEXTURE_2D, 1);
     glDisable(GL_DEPTH_TEST);
     glDisable(GL_LIGHTING);
     
@@ -112,6 +122,17 @@ int video_init(int window_w, int window_h, int fullscreen, int vsync) {
         SDL_DestroyWindow(window);
         return 1;
     }
+    texture_bind(&target.tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    texture_unbind();
+
+    // Sprite batching, palette lookups for indexed sprites, and sprite textures
+    if(batch_init() || indexed_init() || tcache_init() || capture_init()) {
+        fbo_free(&target);
+        SDL_DestroyWindow(window);
+        return 1;
+    }
     
     // Show some info
     INFO("Video Init OK");
@@ -123,90 +144,220 @@ int video_init(int window_w, int window_h, int fullscreen, int vsync) {
     return 0;
 }
 
+int video_init_headless() {
+    // No window, no GL context. All rendering calls become no-ops.
+    headless = 1;
+    screen_w = NATIVE_W;
+    screen_h = NATIVE_H;
+    tcache_init();
+    INFO("Video Init OK (headless)");
+    return 0;
+}
+
+int video_is_headless() {
+    return headless;
+}
+
+// Software rendering, with a window if window_w is not 0. Without
+// a window, frames can only be read with video_screenshot().
+int video_init_software(int window_w, int window_h, int fullscreen) {
+    software = 1;
+    screen_w = NATIVE_W;
+    screen_h = NATIVE_H;
+    window = NULL;
+    if(window_w > 0) {
+        window = SDL_CreateWindow(
+            "OpenOMF",
+            SDL_WINDOWPOS_CENTERED,
+            SDL_WINDOWPOS_CENTERED,
+            window_w,
+            window_h,
+            SDL_WINDOW_SHOWN
+        );
+        if(!window) {
+            PERROR("Could not create window: %s", SDL_GetError());
+            software = 0;
+            return 1;
+        }
+        if(fullscreen && SDL_SetWindowFullscreen(window, 1) != 0) {
+            PERROR("Could not set fullscreen mode!");
+        }
+        screen_w = window_w;
+        screen_h = window_h;
+    }
+    // Sprite textures, and the capture writer, as for the GL renderer
+    if(soft_init() || tcache_init() || capture_init()) {
+        PERROR("Could not initialize the software renderer!");
+        soft_close();
+        if(window != NULL) {
+            SDL_DestroyWindow(window);
+            window = NULL;
+        }
+        software = 0;
+        return 1;
+    }
+    INFO("Video Init OK (software%s)", window ? "" : ", no window");
+    return 0;
+}
+
+int video_is_software() {
+    return software;
+}
+
+// Scales the native framebuffer to the window
+static void video_soft_present() {
+    if(window == NULL) {
+        return;
+    }
+    SDL_Surface *screen = SDL_GetWindowSurface(window);
+    SDL_Surface *frame = SDL_CreateRGBSurfaceFrom(
+        (void*)soft_get_frame(), NATIVE_W, NATIVE_H, 32, NATIVE_W * 4,
+        0x000000FF, 0x0000FF00, 0x00FF0000, 0);
+    if(screen == NULL || frame == NULL) {
+        PERROR("Could not present frame: %s", SDL_GetError());
+    } else {
+        SDL_BlitScaled(frame, NULL, screen, NULL);
+        SDL_UpdateWindowSurface(window);
+    }
+    SDL_FreeSurface(frame);
+}
+
+// Window and GL state may only be touched from the render thread, so
+// video_reinit() only stores the request. It is applied on the next
+// call to video_render_prepare().
+static int reinit_pending = 0;
+static int reinit_w, reinit_h, reinit_fullscreen, reinit_vsync;
+
 int video_reinit(int window_w, int window_h, int fullscreen, int vsync) {
-    _vsync = vsync;
-    screen_w = window_w;
-    screen_h = window_h;
+    reinit_w = window_w;
+    reinit_h = window_h;
+    reinit_fullscreen = fullscreen;
+    reinit_vsync = vsync;
+    reinit_pending = 1;
+    return 0;
+}
+
+static void video_apply_reinit() {
+    reinit_pending = 0;
+    _vsync = reinit_vsync;
+    if(headless || (software && window == NULL)) {
+        return;
+    }
+    screen_w = reinit_w;
+    screen_h = reinit_h;
     
-    SDL_SetWindowSize(window, window_w, window_h);
+    SDL_SetWindowSize(window, reinit_w, reinit_h);
 
-    if(SDL_SetWindowFullscreen(window, fullscreen ? SDL_TRUE : SDL_FALSE) != 0) {
+    if(SDL_SetWindowFullscreen(window, reinit_fullscreen ? SDL_TRUE : SDL_FALSE) != 0) {
         PERROR("Could not set fullscreen mode!");
     } else {
         DEBUG("Fullscreen changed!");
     }
     
     // sometime the window doesn't change size after setting fullscreen
-    SDL_SetWindowSize(window, window_w, window_h);
+    SDL_SetWindowSize(window, reinit_w, reinit_h);
 
-    if(SDL_GL_SetSwapInterval(vsync ? 1 : 0) != 0) {
+    if(software) {
+        return;
+    }
+    if(SDL_GL_SetSwapInterval(reinit_vsync ? 1 : 0) != 0) {
         PERROR("Could not enable VSync!");
     } else {
         DEBUG("VSync changed!");
     }
-    
-    return 0;
 }
 
+// Reads the screen synchronously. Use capture_screenshot() during gameplay.
 void video_screenshot(image *img) {
+    if(software) {
+        image_create(img, NATIVE_W, NATIVE_H);
+        memcpy(img->data, soft_get_frame(), NATIVE_W * NATIVE_H * 4);
+        return;
+    }
     image_create(img, screen_w, screen_h);
+    if(headless) {
+        image_clear(img, COLOR_BLACK);
+        return;
+    }
     glReadBuffer(GL_FRONT);
-    glReadPixels(0, 0, img->w, img->h, GL_BGR, GL_UNSIGNED_BYTE, img->data);
+    glReadPixels(0, 0, img->w, img->h, GL_RGBA, GL_UNSIGNED_BYTE, img->data);
+
+    // GL gives the bottom row first
+    int pitch = img->w * 4;
+    char *tmp = malloc(pitch);
+    for(int y = 0; y < img->h / 2; y++) {
+        char *a = img->data + y * pitch;
+        char *b = img->data + (img->h - 1 - y) * pitch;
+        memcpy(tmp, a, pitch);
+        memcpy(a, b, pitch);
+        memcpy(b, tmp, pitch);
+    }
+    free(tmp);
 }
 
 void video_set_rendering_mode(int mode) {
+    if(headless || software) return;
+
     // Set mode
     switch(mode) {
         case BLEND_ADDITIVE:
             // Additive blending, so enable blending and disable alpha testing
             // This shouldn't touch the stencil buffer at all
-            glEnable(GL_BLEND);
-            glDisable(GL_ALPHA_TEST);
-            glEnable(GL_STENCIL_TEST);
-            glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-            glStencilFunc(GL_EQUAL, 1, 1);
-            glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+            glstate_enable(GL_BLEND, 1);
+            glstate_enable(GL_ALPHA_TEST, 0);
+            glstate_enable(GL_STENCIL_TEST, 1);
+            glstate_blend_func(GL_SRC_ALPHA, GL_ONE);
+            glstate_stencil_func(GL_EQUAL, 1, 1);
+            glstate_stencil_op(GL_KEEP, GL_KEEP, GL_KEEP);
             break;
         case BLEND_ALPHA_FULL:
             // Full alpha blending. Disable stencil.
-            glEnable(GL_BLEND);
-            glDisable(GL_ALPHA_TEST);
-            glDisable(GL_STENCIL_TEST);
-            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            glstate_enable(GL_BLEND, 1);
+            glstate_enable(GL_ALPHA_TEST, 0);
+            glstate_enable(GL_STENCIL_TEST, 0);
+            glstate_blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
             break;
         case BLEND_ALPHA_CONSTANT:
             // Constant alpha
-            glEnable(GL_BLEND);
-            glEnable(GL_ALPHA_TEST);
-            glDisable(GL_STENCIL_TEST);
-            glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
-            glAlphaFunc(GL_GREATER, 0);
+            glstate_enable(GL_BLEND, 1);
+            glstate_enable(GL_ALPHA_TEST, 1);
+            glstate_enable(GL_STENCIL_TEST, 0);
+            glstate_blend_func(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+            glstate_alpha_func(GL_GREATER, 0);
             break;
         default:
             // Alpha blending. Well, not really blending; we just skip all data where alpha = 0.
             // Set all visible data as 1 on stencil buffer, so that all additive blending effects
-            // works on these surfaces.
-            glDisable(GL_BLEND);
-            glEnable(GL_ALPHA_TEST);
-            glEnable(GL_STENCIL_TEST);
-            glAlphaFunc(GL_GREATER, 0);
-            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-            glStencilFunc(GL_ALWAYS, 1, 1);
-            glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+            // works on these surfaces. Blend function doesn't matter while blending is off.
+            glstate_enable(GL_BLEND, 0);
+            glstate_enable(GL_ALPHA_TEST, 1);
+            glstate_enable(GL_STENCIL_TEST, 1);
+            glstate_alpha_func(GL_GREATER, 0);
+            glstate_stencil_func(GL_ALWAYS, 1, 1);
+            glstate_stencil_op(GL_KEEP, GL_KEEP, GL_REPLACE);
             break;
     }
 }
 
 void video_render_prepare() {
+    if(reinit_pending) {
+        video_apply_reinit();
+    }
+    if(headless) return;
+    if(software) {
+        soft_clear();
+        return;
+    }
+
     // Switch to FBO rendering
     texture_unbind();
     fbo_bind(&target);
 
     // Set state
-    glEnable(GL_STENCIL_TEST);
-    glDisable(GL_BLEND);
-    glEnable(GL_ALPHA_TEST);
-    glAlphaFunc(GL_GREATER, 0);
+    glstate_enable(GL_STENCIL_TEST, 1);
+    glstate_enable(GL_BLEND, 0);
+    glstate_enable(GL_ALPHA_TEST, 1);
+    glstate_alpha_func(GL_GREATER, 0);
 
     // Clear stuff
     glClear(GL_COLOR_BUFFER_BIT|GL_STENCIL_BUFFER_BIT);
@@ -220,142 +371,210 @@ void video_render_prepare() {
 }
 
 void video_render_background(texture *tex) {
+    if(headless) return;
+    if(software) {
+        soft_background(tex);
+        return;
+    }
+
     // Handle background separately
-    glStencilFunc(GL_ALWAYS, 0, 0);
-    glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+    batch_flush();
+    glstate_stencil_func(GL_ALWAYS, 0, 0);
+    glstate_stencil_op(GL_KEEP, GL_KEEP, GL_KEEP);
+    glstate_enable(GL_TEXTURE_2D, 1);
+    glstate_color(1.0f, 1.0f, 1.0f, 1.0f);
     texture_bind(tex);
     glCallList(fullscreen_quad_flipped);
-    texture_unbind();
 }
 
-void video_render_char(texture *tex, int sx, int sy, color c) {
-    // Alpha testing
-    video_set_rendering_mode(BLEND_ALPHA);
+// Texture coordinates for the top right, top left, bottom left and bottom right corners
+static const float flip_uv[4][8] = {
+    {1.0f, 0.0f,  0.0f, 0.0f,  0.0f, 1.0f,  1.0f, 1.0f}, // FLIP_NONE
+    {0.0f, 0.0f,  1.0f, 0.0f,  1.0f, 1.0f,  0.0f, 1.0f}, // FLIP_HORIZONTAL
+    {0.0f, 1.0f,  1.0f, 1.0f,  1.0f, 0.0f,  0.0f, 0.0f}, // FLIP_VERTICAL
+    {1.0f, 1.0f,  0.0f, 1.0f,  0.0f, 0.0f,  1.0f, 0.0f}, // FLIP_VERTICAL|FLIP_HORIZONTAL
+};
 
-    // Just draw the texture on screen to the right spot.
-    float w = tex->w / 160.0f;
-    float h = tex->h / 100.0f;
+// Queues a quad in screen coordinates (-1..1) for drawing
+static void video_quad_uv(unsigned int tex_id, unsigned int pal_id, int rendering_mode, const float *uv, float x, float y, float w, float h, color c) {
+    batch_vertex quad[4];
+    float xs[4] = {x+w, x,   x, x+w};
+    float ys[4] = {y+h, y+h, y, y};
+    for(int i = 0; i < 4; i++) {
+        quad[i].x = xs[i];
+        quad[i].y = ys[i];
+        quad[i].u = uv[i*2];
+        quad[i].v = uv[i*2+1];
+        quad[i].r = c.r;
+        quad[i].g = c.g;
+        quad[i].b = c.b;
+        quad[i].a = c.a;
+    }
+    batch_add(tex_id, pal_id, rendering_mode, quad);
+}
+
+static void video_quad(unsigned int tex_id, int rendering_mode, int flip_mode, float x, float y, float w, float h, color c) {
+    video_quad_uv(tex_id, 0, rendering_mode, flip_uv[flip_mode & (FLIP_VERTICAL|FLIP_HORIZONTAL)], x, y, w, h, c);
+}
+
+static void video_render_area(texture *tex, int sx, int sy, int tx, int ty, int tw, int th,
+                              unsigned int rendering_mode, color c) {
+    if(software) {
+        soft_draw(tex, NULL, tx, ty, tw, th, sx, sy, tw, th, FLIP_NONE, rendering_mode, c);
+        return;
+    }
+
+    float w = tw / 160.0f;
+    float h = th / 100.0f;
     float x = -1.0 + 2.0f * sx / 320.0f;
     float y = 1.0 - sy / 100.0f - h;
-    texture_bind(tex);
-    glColor3f(c.r/255.0f, c.g/255.0f, c.b/255.0f);
-    glBegin(GL_QUADS);
-        glTexCoord2f(1.0f, 0.0f); glVertex3f(x+w, y+h, 0); // Top Right
-        glTexCoord2f(0.0f, 0.0f); glVertex3f(x,   y+h, 0); // Top Left
-        glTexCoord2f(0.0f, 1.0f); glVertex3f(x,   y,   0); // Bottom Left
-        glTexCoord2f(1.0f, 1.0f); glVertex3f(x+w, y,   0); // Bottom Right
-    glEnd();
-    glColor3f(1.0f,1.0f,1.0f);
+    float u0 = (float)tx / tex->w;
+    float v0 = (float)ty / tex->h;
+    float u1 = (float)(tx + tw) / tex->w;
+    float v1 = (float)(ty + th) / tex->h;
+    float uv[8] = {u1, v0,  u0, v0,  u0, v1,  u1, v1};
+    video_quad_uv(tex->id, 0, rendering_mode, uv, x, y, w, h, c);
+}
+
+// Draws a tw*th area of the texture, starting from tx,ty, with alpha testing.
+// Glyphs of a font come from the same texture, so a string is one batch.
+void video_render_glyph(texture *tex, int sx, int sy, int tx, int ty, int tw, int th, color c) {
+    if(headless) return;
+    c.a = 255;
+    video_render_area(tex, sx, sy, tx, ty, tw, th, BLEND_ALPHA, c);
+}
+
+// Draws a tw*th area of the texture, starting from tx,ty
+void video_render_sprite_area(texture *tex, int sx, int sy, int tx, int ty, int tw, int th, unsigned int rendering_mode) {
+    if(headless) return;
+    video_render_area(tex, sx, sy, tx, ty, tw, th, rendering_mode, COLOR_WHITE);
+}
+
+void video_render_char(texture *tex, int sx, int sy, color c) {
+    video_render_glyph(tex, sx, sy, 0, 0, tex->w, tex->h, c);
 }
 
 void video_render_sprite(texture *tex, int sx, int sy, unsigned int rendering_mode) {
     video_render_sprite_flip(tex, sx, sy, rendering_mode, FLIP_NONE);
 }
 
-void video_quads(int flip_mode, float x, float y, float w, float h) {
-    switch(flip_mode) {
-        case FLIP_NONE:
-            // regular draw
-            glTexCoord2f(1.0f, 0.0f); glVertex3f(x+w, y+h, 0); // Top Right
-            glTexCoord2f(0.0f, 0.0f); glVertex3f(x,   y+h, 0); // Top Left
-            glTexCoord2f(0.0f, 1.0f); glVertex3f(x,   y,   0); // Bottom Left
-            glTexCoord2f(1.0f, 1.0f); glVertex3f(x+w, y,   0); // Bottom Right
-            break;
-        case FLIP_HORIZONTAL:
-            // horizontal flip
-            glTexCoord2f(0.0f, 0.0f); glVertex3f(x+w, y+h, 0); // Top Right
-            glTexCoord2f(1.0f, 0.0f); glVertex3f(x,   y+h, 0); // Top Left
-            glTexCoord2f(1.0f, 1.0f); glVertex3f(x,   y,   0); // Bottom Left
-            glTexCoord2f(0.0f, 1.0f); glVertex3f(x+w, y,   0); // Bottom Right
-            break;
-        case FLIP_VERTICAL:
-            // vert flip
-            glTexCoord2f(0.0f, 1.0f); glVertex3f(x+w, y+h, 0); // Top Right
-            glTexCoord2f(1.0f, 1.0f); glVertex3f(x,   y+h, 0); // Top Left
-            glTexCoord2f(1.0f, 0.0f); glVertex3f(x,   y,   0); // Bottom Left
-            glTexCoord2f(0.0f, 0.0f); glVertex3f(x+w, y,   0); // Bottom Right
-            break;
-        case FLIP_VERTICAL|FLIP_HORIZONTAL:
-            // both flip
-            glTexCoord2f(1.0f, 1.0f); glVertex3f(x+w, y+h, 0); // Top Right
-            glTexCoord2f(0.0f, 1.0f); glVertex3f(x,   y+h, 0); // Top Left
-            glTexCoord2f(0.0f, 0.0f); glVertex3f(x,   y,   0); // Bottom Left
-            glTexCoord2f(1.0f, 0.0f); glVertex3f(x+w, y,   0); // Bottom Right
-            break;
-    }
+// Height is scaled around the middle of the sprite
+static void video_soft_sprite(texture *tex, const uint32_t *palette, int sx, int sy, int tx, int ty, int tw, int th,
+                              unsigned int rendering_mode, unsigned int flip_mode, float y_percent, color c) {
+    int h = th * y_percent;
+    soft_draw(tex, palette, tx, ty, tw, th, sx, sy + (th - h) / 2, tw, h, flip_mode, rendering_mode, c);
 }
 
 void video_render_sprite_flip_scale(texture *tex, int sx, int sy, unsigned int rendering_mode, unsigned int flip_mode, float y_percent) {
-    // Set rendering mode
-    video_set_rendering_mode(rendering_mode);
-    
+    if(headless) return;
+    if(software) {
+        video_soft_sprite(tex, NULL, sx, sy, 0, 0, tex->w, tex->h, rendering_mode, flip_mode, y_percent, COLOR_WHITE);
+        return;
+    }
+
     // Just draw the texture on screen to the right spot.
     float w = tex->w / 160.0f;
     float h = tex->h / 100.0f;
     float x = -1.0 + 2.0f * sx / 320.0f;
     float y = 1.0 - sy / 100.0f - h;
     float diff =( h - (h * y_percent))/ 2.0f;
-    texture_bind(tex);
-    glBegin(GL_QUADS);
-    video_quads(flip_mode, x, y+diff, w, h * y_percent);
-    glEnd();
+    video_quad(tex->id, rendering_mode, flip_mode, x, y+diff, w, h * y_percent, COLOR_WHITE);
+}
+
+// Draws a tw*th area of an indexed texture, starting from tx,ty, with the given
+// palette. Colors are 256 RGB triplets, and remap is a table of 256 palette
+// indexes, or NULL. Sprites packed in the same atlas are drawn in one batch.
+void video_render_sprite_palette(texture *tex, int sx, int sy, int tx, int ty, int tw, int th,
+                                 unsigned int rendering_mode, unsigned int flip_mode, float y_percent,
+                                 const unsigned char *colors, const unsigned char *remap) {
+    if(headless) return;
+    if(software) {
+        uint32_t palette[256];
+        soft_make_palette(palette, colors, remap);
+        video_soft_sprite(tex, palette, sx, sy, tx, ty, tw, th, rendering_mode, flip_mode, y_percent, COLOR_WHITE);
+        return;
+    }
+
+    float w = tw / 160.0f;
+    float h = th / 100.0f;
+    float x = -1.0 + 2.0f * sx / 320.0f;
+    float y = 1.0 - sy / 100.0f - h;
+    float diff =( h - (h * y_percent))/ 2.0f;
+
+    // Pick the flipped corners from the area
+    const float *flip = flip_uv[flip_mode & (FLIP_VERTICAL|FLIP_HORIZONTAL)];
+    float u0 = (float)tx / tex->w;
+    float v0 = (float)ty / tex->h;
+    float u1 = (float)(tx + tw) / tex->w;
+    float v1 = (float)(ty + th) / tex->h;
+    float uv[8];
+    for(int i = 0; i < 4; i++) {
+        uv[i*2] = u0 + (u1 - u0) * flip[i*2];
+        uv[i*2+1] = v0 + (v1 - v0) * flip[i*2+1];
+    }
+    unsigned int pal_id = indexed_palette(colors, remap);
+    video_quad_uv(tex->id, pal_id, rendering_mode, uv, x, y+diff, w, h * y_percent, COLOR_WHITE);
 }
 
 void video_render_sprite_flip_alpha(texture *tex, int sx, int sy, unsigned int flip_mode, int alpha) {
-    video_set_rendering_mode(BLEND_ALPHA_CONSTANT);
+    if(headless) return;
+    if(software) {
+        soft_draw(tex, NULL, 0, 0, tex->w, tex->h, sx, sy, tex->w, tex->h, flip_mode,
+            BLEND_ALPHA_CONSTANT, color_create(255, 255, 255, alpha));
+        return;
+    }
+
     float w = tex->w / 160.0f;
     float h = tex->h / 100.0f;
     float x = -1.0 + 2.0f * sx / 320.0f;
     float y = 1.0 - sy / 100.0f - h;
-    texture_bind(tex);
-    glBegin(GL_QUADS);
-    glColor4f(1.0f, 1.0f, 1.0f, alpha/255.0f);
-    video_quads(flip_mode, x, y, w, h);
-    glEnd();
-    glColor4f(1.0f,1.0f,1.0f,1.0f);
+    video_quad(tex->id, BLEND_ALPHA_CONSTANT, flip_mode, x, y, w, h, color_create(255, 255, 255, alpha));
 }
 
 void video_render_colored_quad(int _x, int _y, int _w, int _h, color c) {
-    // Alpha testing
-    video_set_rendering_mode(BLEND_ALPHA_FULL);
+    if(headless) return;
+    if(software) {
+        soft_fill(_x, _y, _w, _h, c);
+        return;
+    }
 
-    // Just draw the quad on screen to the right spot.
+    // Just draw the quad on screen to the right spot, with no texture.
     float w = _w / 160.0f;
     float h = _h / 100.0f;
     float x = -1.0 + 2.0f * _x / 320.0f;
     float y = 1.0 - _y / 100.0f - h;
-    glDisable(GL_TEXTURE_2D);
-    glColor4f(c.r/255.0f, c.g/255.0f, c.b/255.0f, c.a/255.0f);
-    glBegin(GL_QUADS);
-        glVertex3f(x+w, y+h, 0); // Top Right
-        glVertex3f(x,   y+h, 0); // Top Left
-        glVertex3f(x,   y,   0); // Bottom Left
-        glVertex3f(x+w, y,   0); // Bottom Right
-    glEnd();
-    glEnable(GL_TEXTURE_2D);
-    glColor3f(1.0f,1.0f,1.0f);
+    video_quad(0, BLEND_ALPHA_FULL, FLIP_NONE, x, y, w, h, c);
 }
 
 void video_render_finish() {
+    if(headless) return;
+    if(software) {
+        capture_read();
+        video_soft_present();
+        return;
+    }
+
+    // Draw whatever is still queued, and read back the frame for capturing
+    batch_flush();
+    capture_read();
+
     // Render to screen instead of FBO
     fbo_unbind();
 
     // Clear stuff
-    glDisable(GL_STENCIL_TEST);
+    glstate_enable(GL_STENCIL_TEST, 0);
     glClear(GL_COLOR_BUFFER_BIT);
     glViewport(0, 0, screen_w, screen_h);
     glLoadIdentity();
 
     // Disable blending & alpha testing
-    glDisable(GL_BLEND);
-    glDisable(GL_ALPHA_TEST);
+    glstate_enable(GL_BLEND, 0);
+    glstate_enable(GL_ALPHA_TEST, 0);
 
-    // Pick texture, select state
+    // Pick texture. Its parameters were set when it was created.
+    glstate_enable(GL_TEXTURE_2D, 1);
+    glstate_color(1.0f, 1.0f, 1.0f, 1.0f);
     texture_bind(&target.tex);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     
     // Draw textured quad
     glCallList(fullscreen_quad);
@@ -368,6 +587,23 @@ void video_render_finish() {
 }
 
 void video_close() {
+    capture_close();
+    tcache_close();
+    if(headless) {
+        INFO("Video deinit.");
+        return;
+    }
+    if(software) {
+        soft_close();
+        if(window != NULL) {
+            SDL_DestroyWindow(window);
+        }
+        software = 0;
+        INFO("Video deinit.");
+        return;
+    }
+    indexed_close();
+    batch_close();
     fbo_free(&target);
     glDeleteLists(fullscreen_quad, 1);
     SDL_GL_DeleteContext(glctx);  
@@ -0,0 +1,176 @@
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <video/soft.h>
+#include <video/video.h>
+#include <video/golden.h>
+
+// Golden frames of the software renderer, drawn from made up textures so that
+// no game resources are needed. Reference frames are in the directory given on
+// the command line; run with -w to write them again after an intended change.
+
+#define SPRITE_W 32
+#define SPRITE_H 24
+
+static texture background;
+static texture sprite;
+static texture indexed;
+static uint32_t palette[256];
+static unsigned char colors[256 * 3];
+static unsigned char remap[256];
+
+// RGBA gradient, with a hole and a soft edge in the alpha
+static void make_sprite(texture *tex) {
+    memset(tex, 0, sizeof(texture));
+    tex->w = SPRITE_W;
+    tex->h = SPRITE_H;
+    tex->pixels = malloc(SPRITE_W * SPRITE_H * 4);
+    for(int y = 0; y < SPRITE_H; y++) {
+        for(int x = 0; x < SPRITE_W; x++) {
+            unsigned char *p = (unsigned char*)tex->pixels + (y * SPRITE_W + x) * 4;
+            p[0] = x * 8;
+            p[1] = y * 10;
+            p[2] = 255 - x * 4;
+            p[3] = (x > 10 && x < 16 && y > 8 && y < 14) ? 0 : 255 - x * 7;
+        }
+    }
+}
+
+static void make_background(texture *tex) {
+    memset(tex, 0, sizeof(texture));
+    tex->w = 64;
+    tex->h = 40;
+    tex->pixels = malloc(64 * 40 * 4);
+    for(int y = 0; y < 40; y++) {
+        for(int x = 0; x < 64; x++) {
+            unsigned char *p = (unsigned char*)tex->pixels + (y * 64 + x) * 4;
+            p[0] = x * 3;
+            p[1] = 40 + y * 2;
+            p[2] = ((x / 8 + y / 8) & 1) ? 120 : 60;
+            p[3] = 255;
+        }
+    }
+}
+
+// Palette index and alpha per pixel, as for sprites drawn with a palette
+static void make_indexed(texture *tex) {
+    memset(tex, 0, sizeof(texture));
+    tex->w = SPRITE_W;
+    tex->h = SPRITE_H;
+    tex->indexed = 1;
+    tex->pixels = malloc(SPRITE_W * SPRITE_H * 2);
+    for(int y = 0; y < SPRITE_H; y++) {
+        for(int x = 0; x < SPRITE_W; x++) {
+            unsigned char *p = (unsigned char*)tex->pixels + (y * SPRITE_W + x) * 2;
+            p[0] = (x + y * SPRITE_W) & 0xFF;
+            p[1] = ((x - 16) * (x - 16) + (y - 12) * (y - 12) < 120) ? 255 : 0;
+        }
+    }
+    for(int i = 0; i < 256; i++) {
+        colors[i*3+0] = i;
+        colors[i*3+1] = (i * 3) & 0xFF;
+        colors[i*3+2] = 255 - i;
+        remap[i] = 255 - i;
+    }
+}
+
+static int golden_suite_init(void) {
+    make_background(&background);
+    make_sprite(&sprite);
+    make_indexed(&indexed);
+    return soft_init();
+}
+
+static int golden_suite_free(void) {
+    free(background.pixels);
+    free(sprite.pixels);
+    free(indexed.pixels);
+    soft_close();
+    return 0;
+}
+
+static void draw_sprite(int x, int y, int w, int h, int flip, int mode, color c) {
+    soft_draw(&sprite, NULL, 0, 0, SPRITE_W, SPRITE_H, x, y, w, h, flip, mode, c);
+}
+
+void test_golden_blend(void) {
+    soft_clear();
+    soft_background(&background);
+
+    // Additive light only lands on pixels that were drawn with BLEND_ALPHA
+    draw_sprite(20, 20, SPRITE_W, SPRITE_H, FLIP_NONE, BLEND_ALPHA, COLOR_WHITE);
+    draw_sprite(30, 26, SPRITE_W, SPRITE_H, FLIP_NONE, BLEND_ADDITIVE, color_create(255, 128, 64, 200));
+    draw_sprite(80, 20, SPRITE_W, SPRITE_H, FLIP_NONE, BLEND_ALPHA_FULL, COLOR_WHITE);
+    draw_sprite(140, 20, SPRITE_W, SPRITE_H, FLIP_NONE, BLEND_ALPHA_CONSTANT, color_create(255, 255, 255, 128));
+    draw_sprite(200, 20, SPRITE_W, SPRITE_H, FLIP_NONE, BLEND_ALPHA, color_create(200, 100, 255, 255));
+
+    // Odd widths leave tails for the scalar loops
+    draw_sprite(20, 80, 37, 30, FLIP_NONE, BLEND_ALPHA_FULL, color_create(255, 255, 255, 180));
+    draw_sprite(80, 80, 41, 30, FLIP_NONE, BLEND_ALPHA_CONSTANT, color_create(255, 255, 255, 77));
+    soft_fill(150, 90, 123, 50, color_create(0, 0, 255, 100));
+    soft_fill(10, 150, 300, 20, color_create(255, 255, 0, 255));
+    CU_ASSERT(golden_frame("blend") == 0);
+}
+
+void test_golden_flip_scale(void) {
+    soft_clear();
+    draw_sprite(10, 10, SPRITE_W, SPRITE_H, FLIP_HORIZONTAL, BLEND_ALPHA, COLOR_WHITE);
+    draw_sprite(60, 10, SPRITE_W, SPRITE_H, FLIP_VERTICAL, BLEND_ALPHA, COLOR_WHITE);
+    draw_sprite(110, 10, SPRITE_W, SPRITE_H, FLIP_HORIZONTAL | FLIP_VERTICAL, BLEND_ALPHA, COLOR_WHITE);
+    draw_sprite(10, 60, SPRITE_W * 3, SPRITE_H * 2, FLIP_NONE, BLEND_ALPHA, COLOR_WHITE);
+    draw_sprite(120, 60, SPRITE_W / 2, SPRITE_H / 2, FLIP_NONE, BLEND_ALPHA, COLOR_WHITE);
+
+    // Clipped at every edge of the screen
+    draw_sprite(-12, 120, SPRITE_W, SPRITE_H, FLIP_NONE, BLEND_ALPHA, COLOR_WHITE);
+    draw_sprite(NATIVE_W - 20, 120, SPRITE_W, SPRITE_H, FLIP_NONE, BLEND_ALPHA, COLOR_WHITE);
+    draw_sprite(200, -10, SPRITE_W, SPRITE_H, FLIP_NONE, BLEND_ALPHA, COLOR_WHITE);
+    draw_sprite(200, NATIVE_H - 10, SPRITE_W, SPRITE_H, FLIP_NONE, BLEND_ALPHA, COLOR_WHITE);
+    CU_ASSERT(golden_frame("flip-scale") == 0);
+}
+
+void test_golden_indexed(void) {
+    soft_clear();
+    soft_background(&background);
+    soft_make_palette(palette, colors, NULL);
+    soft_draw(&indexed, palette, 0, 0, SPRITE_W, SPRITE_H, 20, 20, SPRITE_W * 2, SPRITE_H * 2,
+        FLIP_NONE, BLEND_ALPHA, COLOR_WHITE);
+    soft_make_palette(palette, colors, remap);
+    soft_draw(&indexed, palette, 0, 0, SPRITE_W, SPRITE_H, 100, 20, SPRITE_W * 2, SPRITE_H * 2,
+        FLIP_HORIZONTAL, BLEND_ALPHA, COLOR_WHITE);
+
+    // Part of the texture only, as sprites are drawn from an atlas
+    soft_draw(&indexed, palette, 8, 4, 16, 16, 180, 20, 32, 32,
+        FLIP_NONE, BLEND_ALPHA_CONSTANT, color_create(255, 255, 255, 150));
+    CU_ASSERT(golden_frame("indexed") == 0);
+}
+
+int main(int argc, char **argv) {
+    CU_pSuite suite = NULL;
+    unsigned int failed;
+    if(CU_initialize_registry() != CUE_SUCCESS) {
+        return CU_get_error();
+    }
+    golden_init((argc > 1) ? argv[1] : "golden", argc > 2 && strcmp(argv[2], "-w") == 0);
+
+    // Init suite
+    suite = CU_add_suite("Golden frames", golden_suite_init, golden_suite_free);
+    if(suite == NULL) {
+        goto end;
+    }
+
+    // Add tests
+    if(CU_add_test(suite, "Test for blending modes", test_golden_blend) == NULL) { goto end; }
+    if(CU_add_test(suite, "Test for flipping, scaling and clipping", test_golden_flip_scale) == NULL) { goto end; }
+    if(CU_add_test(suite, "Test for sprites drawn with a palette", test_golden_indexed) == NULL) { goto end; }
+
+    // Run tests
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+
+end:
+    // Frames that differ fail the test run, not just the assertion
+    failed = CU_get_number_of_failures();
+    CU_cleanup_registry();
+    return failed ? 1 : CU_get_error();
+}
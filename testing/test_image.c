@@ -0,0 +1,225 @@
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <video/image.h>
+
+#define W 320
+#define H 200
+
+// What the drawing functions used to do: every pixel through image_set_pixel
+static void ref_filled_rect(image *img, int x, int y, int w, int h, color c) {
+    for(int my = y; my < y+h; my++) {
+        for(int mx = x; mx < x+w; mx++) {
+            image_set_pixel(img, mx, my, c);
+        }
+    }
+}
+
+static void ref_line(image *img, int x0, int y0, int x1, int y1, color c) {
+    int dx = abs(x1 - x0);
+    int sx = (x0 < x1) ? 1 : -1;
+    int dy = abs(y1 - y0);
+    int sy = (y0 < y1) ? 1 : -1;
+    int err = (dx > dy ? dx : -dy) / 2;
+    int e2;
+    while(1) {
+        image_set_pixel(img, x0, y0, c);
+        if(x0 == x1 && y0 == y1) break;
+        e2 = err;
+        if(e2 > -dx) { err -= dy; x0 += sx; }
+        if(e2 <  dy) { err += dx; y0 += sy; }
+    }
+}
+
+static void ref_rect_bevel(image *img, int x, int y, int w, int h,
+                           color ctop, color cright, color cbottom, color cleft) {
+    ref_line(img, x, y, x+w, y, ctop);
+    ref_line(img, x, y+h, x+w, y+h, cbottom);
+    ref_line(img, x+w, y, x+w, y+h, cright);
+    ref_line(img, x, y, x, y+h, cleft);
+}
+
+static int same(image *a, image *b) {
+    return memcmp(a->data, b->data, a->w * a->h * 4) == 0;
+}
+
+static void pair_create(image *a, image *b) {
+    image_create(a, W, H);
+    image_create(b, W, H);
+    memset(a->data, 0, W * H * 4);
+    memset(b->data, 0, W * H * 4);
+}
+
+static void pair_free(image *a, image *b) {
+    image_free(a);
+    image_free(b);
+}
+
+void test_image_filled_rect(void) {
+    image a, b;
+    const int rects[][4] = {
+        {0, 0, W, H}, {10, 20, 30, 40}, {-5, -5, 20, 20}, {300, 190, 50, 50},
+        {-10, 50, 10, 10}, {400, 50, 10, 10}, {5, 5, 0, 10}, {5, 5, 10, -3},
+        {0, 0, 1, 1}, {W-1, H-1, 1, 1}, {3, 7, 1, 150}, {3, 7, 250, 1},
+    };
+    pair_create(&a, &b);
+    for(int i = 0; i < sizeof(rects) / sizeof(rects[0]); i++) {
+        color c = color_create(i * 20, 255 - i, i, 128 + i);
+        image_filled_rect(&a, rects[i][0], rects[i][1], rects[i][2], rects[i][3], c);
+        ref_filled_rect(&b, rects[i][0], rects[i][1], rects[i][2], rects[i][3], c);
+        CU_ASSERT(same(&a, &b));
+    }
+    pair_free(&a, &b);
+}
+
+void test_image_line(void) {
+    image a, b;
+    const int lines[][4] = {
+        {0, 0, W-1, 0}, {W-1, 5, 0, 5}, {7, 0, 7, H-1}, {9, H-1, 9, 0},
+        {-20, 10, 400, 10}, {30, -20, 30, 300}, {0, 0, W-1, H-1}, {50, 10, 20, 180},
+        {-10, -10, 40, 30}, {5, 5, 5, 5}, {-3, 250, 500, 250},
+    };
+    pair_create(&a, &b);
+    for(int i = 0; i < sizeof(lines) / sizeof(lines[0]); i++) {
+        color c = color_create(255, i * 10, 0, 255);
+        image_line(&a, lines[i][0], lines[i][1], lines[i][2], lines[i][3], c);
+        ref_line(&b, lines[i][0], lines[i][1], lines[i][2], lines[i][3], c);
+        CU_ASSERT(same(&a, &b));
+    }
+    image_rect_bevel(&a, 2, 3, 100, 12, COLOR_WHITE, COLOR_GREEN, COLOR_BLACK, COLOR_YELLOW);
+    ref_rect_bevel(&b, 2, 3, 100, 12, COLOR_WHITE, COLOR_GREEN, COLOR_BLACK, COLOR_YELLOW);
+    CU_ASSERT(same(&a, &b));
+    pair_free(&a, &b);
+}
+
+void test_image_blit(void) {
+    image dst, src;
+    image_create(&dst, 8, 8);
+    image_create(&src, 4, 4);
+    image_clear(&dst, COLOR_BLACK);
+    for(int i = 0; i < 16; i++) {
+        image_set_pixel(&src, i % 4, i / 4, color_create(i, i, i, 255));
+    }
+
+    // Clipped from top left; src pixel (2,3) lands on (0,0)
+    image_blit(&dst, &src, -2, -3);
+    CU_ASSERT(dst.data[0] == 14);
+    CU_ASSERT(dst.data[4] == 15);
+    CU_ASSERT(dst.data[8] == 0);
+    CU_ASSERT(dst.data[8 * 4] == 0);
+
+    // Clipped from bottom right; src pixel (0,0) lands on (7,7)
+    image_blit(&dst, &src, 7, 7);
+    CU_ASSERT(dst.data[(7 * 8 + 7) * 4] == 0 && dst.data[(7 * 8 + 7) * 4 + 3] == (char)255);
+    image_blit(&dst, &src, 6, 6);
+    CU_ASSERT(dst.data[(7 * 8 + 7) * 4] == 5);
+
+    // Entirely outside; nothing is drawn
+    char before[8 * 8 * 4];
+    memcpy(before, dst.data, sizeof(before));
+    image_blit(&dst, &src, 20, 0);
+    image_blit(&dst, &src, 0, -10);
+    CU_ASSERT(memcmp(before, dst.data, sizeof(before)) == 0);
+    image_free(&dst);
+    image_free(&src);
+}
+
+static double seconds(clock_t start) {
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void clear_rounds(image *a, image *b, int rounds, double *ref, double *fast) {
+    clock_t start = clock();
+    for(int i = 0; i < rounds; i++) {
+        ref_filled_rect(b, 0, 0, W, H, color_create(i, 0, 0, 255));
+    }
+    *ref = seconds(start);
+    start = clock();
+    for(int i = 0; i < rounds; i++) {
+        image_clear(a, color_create(i, 0, 0, 255));
+    }
+    *fast = seconds(start);
+}
+
+// Menu background: grid of lines and a border
+static void grid_rounds(image *a, image *b, int rounds, double *ref, double *fast) {
+    clock_t start = clock();
+    for(int i = 0; i < rounds; i++) {
+        for(int x = 7; x < W; x += 8) ref_line(b, x, 0, x, H-1, COLOR_GREEN);
+        for(int y = 7; y < H; y += 8) ref_line(b, 0, y, W-1, y, COLOR_GREEN);
+        ref_rect_bevel(b, 0, 0, W-1, H-1, COLOR_WHITE, COLOR_WHITE, COLOR_WHITE, COLOR_WHITE);
+    }
+    *ref = seconds(start);
+    start = clock();
+    for(int i = 0; i < rounds; i++) {
+        for(int x = 7; x < W; x += 8) image_line(a, x, 0, x, H-1, COLOR_GREEN);
+        for(int y = 7; y < H; y += 8) image_line(a, 0, y, W-1, y, COLOR_GREEN);
+        image_rect(a, 0, 0, W-1, H-1, COLOR_WHITE);
+    }
+    *fast = seconds(start);
+}
+
+void test_image_full_screen(void) {
+    image a, b;
+    double ref, fast;
+    pair_create(&a, &b);
+    clear_rounds(&a, &b, 1, &ref, &fast);
+    CU_ASSERT(same(&a, &b));
+    grid_rounds(&a, &b, 1, &ref, &fast);
+    CU_ASSERT(same(&a, &b));
+    pair_free(&a, &b);
+}
+
+// Only run when asked for with -b, since timings depend on the machine and its
+// load. Whole row fills have to beat the per-pixel path by at least 10x.
+void test_image_benchmark(void) {
+    image a, b;
+    double ref, fast;
+    const int rounds = 500;
+    pair_create(&a, &b);
+
+    clear_rounds(&a, &b, rounds, &ref, &fast);
+    CU_ASSERT(same(&a, &b));
+    printf("\n  clear: per-pixel %.3f ms, spans %.3f ms (%.1fx)",
+        ref * 1000 / rounds, fast * 1000 / rounds, ref / fast);
+    CU_ASSERT(ref >= fast * 10);
+
+    grid_rounds(&a, &b, rounds, &ref, &fast);
+    CU_ASSERT(same(&a, &b));
+    printf("\n  grid:  per-pixel %.3f ms, spans %.3f ms (%.1fx)\n",
+        ref * 1000 / rounds, fast * 1000 / rounds, ref / fast);
+    pair_free(&a, &b);
+}
+
+int main(int argc, char **argv) {
+    CU_pSuite suite = NULL;
+    if(CU_initialize_registry() != CUE_SUCCESS) {
+        return CU_get_error();
+    }
+
+    // Init suite
+    suite = CU_add_suite("Image", NULL, NULL);
+    if(suite == NULL) {
+        goto end;
+    }
+
+    // Add tests
+    if(CU_add_test(suite, "Test for filled rectangles", test_image_filled_rect) == NULL) { goto end; }
+    if(CU_add_test(suite, "Test for lines and bevels", test_image_line) == NULL) { goto end; }
+    if(CU_add_test(suite, "Test for blitting", test_image_blit) == NULL) { goto end; }
+    if(CU_add_test(suite, "Test for full screen drawing against per-pixel drawing", test_image_full_screen) == NULL) { goto end; }
+    if(argc > 1 && strcmp(argv[1], "-b") == 0) {
+        if(CU_add_test(suite, "Benchmark against per-pixel drawing", test_image_benchmark) == NULL) { goto end; }
+    }
+
+    // Run tests
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+
+end:
+    CU_cleanup_registry();
+    return CU_get_error();
+}
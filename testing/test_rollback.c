@@ -0,0 +1,337 @@
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <stdint.h>
+#include <string.h>
+#include <game/rollback.h>
+#include <game/spectate.h>
+#include <utils/log.h>
+
+// A tiny deterministic game: a hash of every input both players have made.
+// Inputs are generated from a per-peer sequence, so that the remote input
+// changes often enough to be mispredicted.
+typedef struct toy_t {
+    rollback *rb;
+    spectate_viewer *sv;    // Set if this toy is watching instead of playing
+    uint32_t hash;
+    uint32_t ticks;
+    uint32_t seq;
+    uint32_t polls;
+    uint32_t diverge;       // Tick from which this peer's game goes wrong, or 0
+    rollback_input last;
+    uint32_t history[2048]; // Hash after every simulated tick
+} toy;
+
+static unsigned int toy_save_size(void *userdata) {
+    return sizeof(uint32_t) * 2;
+}
+
+static int toy_save(void *userdata, char *buf, unsigned int size) {
+    toy *t = userdata;
+    memcpy(buf, &t->hash, sizeof(uint32_t));
+    memcpy(buf + sizeof(uint32_t), &t->ticks, sizeof(uint32_t));
+    return 0;
+}
+
+static int toy_load(void *userdata, const char *buf, unsigned int size) {
+    toy *t = userdata;
+    memcpy(&t->hash, buf, sizeof(uint32_t));
+    memcpy(&t->ticks, buf + sizeof(uint32_t), sizeof(uint32_t));
+    return 0;
+}
+
+static void toy_advance(void *userdata, int resimulating) {
+    toy *t = userdata;
+    for(int i = 0; i < 2; i++) {
+        rollback_input in = t->sv ? spectate_get_input(t->sv, i) : rollback_get_input(t->rb, i);
+        t->hash = (t->hash ^ in) * 16777619u;
+    }
+    if(t->diverge && t->ticks == t->diverge) {
+        t->hash++;
+    }
+    t->history[t->ticks++] = t->hash;
+}
+
+static uint32_t toy_checksum(void *userdata) {
+    toy *t = userdata;
+    return t->hash;
+}
+
+static rollback_input toy_poll(void *userdata) {
+    toy *t = userdata;
+    // Change input every few ticks, like a player would
+    if(t->polls++ % 4 == 0) {
+        t->seq = t->seq * 1103515245u + 12345u;
+        t->last = (t->seq >> 16) & 0x3F;
+    }
+    return t->last;
+}
+
+static void toy_create(toy *t, rollback *rb, uint32_t seed, rollback_sim *sim) {
+    memset(t, 0, sizeof(toy));
+    t->rb = rb;
+    t->seq = seed;
+    sim->userdata = t;
+    sim->save_size = toy_save_size;
+    sim->save = toy_save;
+    sim->load = toy_load;
+    sim->advance = toy_advance;
+    sim->poll = toy_poll;
+    sim->checksum = toy_checksum;
+}
+
+static toy toys[2];
+static rollback sessions[2];
+
+// Runs two peers against each other, and checks that both end up with the same game.
+// If diverge is set, the second peer's game goes wrong at that tick.
+static void run_match_diverging(int latency, int loss, int delay, int window, unsigned int ticks, uint32_t diverge) {
+    rollback_loopback lb;
+    rollback_sim sim;
+    rollback_transport net;
+
+    rollback_loopback_create(&lb, latency, loss);
+    for(int i = 0; i < 2; i++) {
+        toy_create(&toys[i], &sessions[i], 1234 + i * 4321, &sim);
+        rollback_loopback_transport(&lb, i, &net);
+        CU_ASSERT(rollback_create(&sessions[i], &sim, &net, i, delay, window) == 0);
+    }
+    toys[1].diverge = diverge;
+
+    // Let both run the match, and then let the last inputs arrive
+    for(unsigned int i = 0; i < ticks; i++) {
+        rollback_loopback_tick(&lb);
+        CU_ASSERT(rollback_tick(&sessions[0]) >= 0);
+        CU_ASSERT(rollback_tick(&sessions[1]) >= 0);
+    }
+
+    // Every tick both peers have confirmed input for must be the same
+    uint32_t confirmed = sessions[0].confirmed;
+    if(sessions[1].confirmed < confirmed) {
+        confirmed = sessions[1].confirmed;
+    }
+    if(toys[0].ticks < confirmed) confirmed = toys[0].ticks;
+    if(toys[1].ticks < confirmed) confirmed = toys[1].ticks;
+    CU_ASSERT(confirmed > ticks / 4);
+    if(diverge == 0) {
+        CU_ASSERT(memcmp(toys[0].history, toys[1].history, confirmed * sizeof(uint32_t)) == 0);
+        CU_ASSERT(sessions[0].desync == ROLLBACK_NO_TICK);
+        CU_ASSERT(sessions[1].desync == ROLLBACK_NO_TICK);
+        CU_ASSERT(sessions[0].stats.checks > 0);
+    }
+
+    for(int i = 0; i < 2; i++) {
+        rollback_free(&sessions[i]);
+    }
+}
+
+static void run_match(int latency, int loss, int delay, int window, unsigned int ticks) {
+    run_match_diverging(latency, loss, delay, window, ticks, 0);
+}
+
+void test_rollback_packet(void) {
+    rollback_input in[3] = {ROLLBACK_UP|ROLLBACK_LEFT, 0, ROLLBACK_KICK};
+    rollback_input out[ROLLBACK_MAX_INPUTS];
+    char buf[ROLLBACK_PACKET_MAX];
+    rollback_packet_info info = {70000, 123456, 123400, 0xDEADBEEF};
+    rollback_packet_info got;
+    int len = rollback_packet_write(buf, &info, in, 3);
+    CU_ASSERT(len == ROLLBACK_PACKET_HEADER + 3);
+    CU_ASSERT(rollback_packet_read(buf, len, &got, out) == 3);
+    CU_ASSERT(memcmp(&info, &got, sizeof(info)) == 0);
+    CU_ASSERT(memcmp(in, out, 3) == 0);
+    CU_ASSERT(rollback_packet_read(buf, len - 1, &got, out) == -1);
+}
+
+void test_rollback_no_latency(void) {
+    // Peers take turns, so one tick of delay is needed even without latency
+    run_match(0, 0, 1, 8, 1000);
+    CU_ASSERT(sessions[0].stats.rollbacks == 0);
+    CU_ASSERT(sessions[1].stats.rollbacks == 0);
+}
+
+void test_rollback_delay_covers_latency(void) {
+    run_match(3, 0, 3, 8, 1000);
+    CU_ASSERT(sessions[0].stats.rollbacks == 0);
+    CU_ASSERT(sessions[0].stats.stalls == 0);
+}
+
+void test_rollback_mispredictions(void) {
+    run_match(6, 0, 1, 8, 1000);
+    CU_ASSERT(sessions[0].stats.rollbacks > 0);
+    CU_ASSERT(sessions[1].stats.rollbacks > 0);
+    CU_ASSERT(sessions[0].stats.max_depth <= 8);
+}
+
+void test_rollback_window_stalls(void) {
+    run_match(12, 0, 0, 4, 1000);
+    CU_ASSERT(sessions[0].stats.stalls > 0);
+    CU_ASSERT(sessions[0].stats.max_depth <= 4);
+}
+
+void test_rollback_packet_loss(void) {
+    run_match(4, 30, 2, 8, 1000);
+    CU_ASSERT(sessions[0].stats.rollbacks > 0);
+    CU_ASSERT(sessions[0].stats.packets < 1100);
+}
+
+void test_rollback_desync(void) {
+    // Tick 301 goes wrong, so states differ from the start of tick 302. Not every
+    // tick gets a checksum sent, but one soon after it must be caught.
+    run_match_diverging(4, 10, 2, 8, 1000, 301);
+    for(int i = 0; i < 2; i++) {
+        CU_ASSERT(sessions[i].desync >= 302 && sessions[i].desync < 302 + 8);
+    }
+}
+
+// Reliable in-order pipe for spectators
+typedef struct test_pipe_t {
+    char packets[512][SPECTATE_PACKET_MAX];
+    int lens[512];
+    int head;
+    int count;
+} test_pipe;
+
+static int pipe_send(void *userdata, const char *buf, unsigned int len) {
+    test_pipe *p = userdata;
+    if(p->count >= 512) {
+        return 1;
+    }
+    int i = (p->head + p->count++) % 512;
+    memcpy(p->packets[i], buf, len);
+    p->lens[i] = len;
+    return 0;
+}
+
+static int pipe_recv(void *userdata, char *buf, unsigned int size) {
+    test_pipe *p = userdata;
+    if(p->count == 0) {
+        return 0;
+    }
+    int len = p->lens[p->head];
+    memcpy(buf, p->packets[p->head], len);
+    p->head = (p->head + 1) % 512;
+    p->count--;
+    return len;
+}
+
+static toy watcher;
+static spectate_viewer viewer;
+static spectate_host host;
+static test_pipe spectate_pipe;
+
+void test_rollback_spectate(void) {
+    rollback_loopback lb;
+    rollback_sim sim;
+    rollback_transport net;
+
+    rollback_loopback_create(&lb, 4, 0);
+    for(int i = 0; i < 2; i++) {
+        toy_create(&toys[i], &sessions[i], 1234 + i * 4321, &sim);
+        rollback_loopback_transport(&lb, i, &net);
+        CU_ASSERT(rollback_create(&sessions[i], &sim, &net, i, 2, 8) == 0);
+    }
+    spectate_host_create(&host, &sessions[0], "setup", 5);
+
+    // Watcher joins in the middle of the match
+    memset(&spectate_pipe, 0, sizeof(test_pipe));
+    net.userdata = &spectate_pipe;
+    net.send = pipe_send;
+    net.recv = pipe_recv;
+    toy_create(&watcher, NULL, 0, &sim);
+    watcher.sv = &viewer;
+    CU_ASSERT(spectate_viewer_create(&viewer, &sim, &net, NULL) == 0);
+
+    unsigned int join_bytes = 0;
+    for(unsigned int i = 0; i < 1000; i++) {
+        if(i == 300) {
+            CU_ASSERT(spectate_host_add(&host, &net) == 0);
+        }
+        if(i == 301) {
+            join_bytes = host.stats.bytes;
+        }
+        rollback_loopback_tick(&lb);
+        CU_ASSERT(rollback_tick(&sessions[0]) >= 0);
+        CU_ASSERT(rollback_tick(&sessions[1]) >= 0);
+        spectate_host_tick(&host);
+        CU_ASSERT(spectate_viewer_tick(&viewer) >= 0);
+    }
+
+    // Watcher saw the same match as the players, from where it joined
+    CU_ASSERT(viewer.joined);
+    CU_ASSERT(memcmp(viewer.setup, "setup", 5) == 0);
+    CU_ASSERT(viewer.snapshot_tick > 280 && viewer.snapshot_tick < 300);
+    CU_ASSERT(watcher.ticks > 950);
+    CU_ASSERT(watcher.ticks <= sessions[0].confirmed);
+    CU_ASSERT(memcmp(watcher.history + viewer.snapshot_tick, toys[0].history + viewer.snapshot_tick,
+        (watcher.ticks - viewer.snapshot_tick) * sizeof(uint32_t)) == 0);
+
+    // Two inputs per tick, plus a header for every batch
+    unsigned int per_tick = (host.stats.bytes - join_bytes) / 700;
+    CU_ASSERT(per_tick <= 3);
+
+    spectate_viewer_free(&viewer);
+    for(int i = 0; i < 2; i++) {
+        rollback_free(&sessions[i]);
+    }
+}
+
+void test_rollback_spectate_oversized(void) {
+    rollback_sim sim;
+    rollback_transport net;
+    char buf[SPECTATE_PACKET_MAX];
+    uint32_t header[3] = {100, SPECTATE_STATE_MAX + 1, 0};
+
+    memset(&spectate_pipe, 0, sizeof(test_pipe));
+    net.userdata = &spectate_pipe;
+    net.send = pipe_send;
+    net.recv = pipe_recv;
+    toy_create(&watcher, NULL, 0, &sim);
+    watcher.sv = &viewer;
+    CU_ASSERT(spectate_viewer_create(&viewer, &sim, &net, NULL) == 0);
+
+    // Snapshot claims to be bigger than any state; viewer gives up before allocating
+    buf[0] = SPECTATE_SNAPSHOT;
+    for(int i = 0; i < 12; i++) {
+        buf[1 + i] = (header[i / 4] >> ((i % 4) * 8)) & 0xFF;
+    }
+    memset(buf + 13, 0, SPECTATE_CHUNK);
+    CU_ASSERT(pipe_send(&spectate_pipe, buf, SPECTATE_PACKET_MAX) == 0);
+    CU_ASSERT(spectate_viewer_tick(&viewer) < 0);
+    CU_ASSERT(viewer.state == NULL);
+    CU_ASSERT(!viewer.joined);
+    spectate_viewer_free(&viewer);
+}
+
+int main(int argc, char **argv) {
+    CU_pSuite suite = NULL;
+    if(CU_initialize_registry() != CUE_SUCCESS) {
+        return CU_get_error();
+    }
+    log_init(0);
+
+    // Init suite
+    suite = CU_add_suite("Rollback", NULL, NULL);
+    if(suite == NULL) {
+        goto end;
+    }
+
+    // Add tests
+    if(CU_add_test(suite, "Test for input packets", test_rollback_packet) == NULL) { goto end; }
+    if(CU_add_test(suite, "Test for loopback without latency", test_rollback_no_latency) == NULL) { goto end; }
+    if(CU_add_test(suite, "Test for input delay covering latency", test_rollback_delay_covers_latency) == NULL) { goto end; }
+    if(CU_add_test(suite, "Test for rolling back mispredictions", test_rollback_mispredictions) == NULL) { goto end; }
+    if(CU_add_test(suite, "Test for stalling at the window", test_rollback_window_stalls) == NULL) { goto end; }
+    if(CU_add_test(suite, "Test for packet loss", test_rollback_packet_loss) == NULL) { goto end; }
+    if(CU_add_test(suite, "Test for desync detection", test_rollback_desync) == NULL) { goto end; }
+    if(CU_add_test(suite, "Test for spectating", test_rollback_spectate) == NULL) { goto end; }
+    if(CU_add_test(suite, "Test for oversized snapshots", test_rollback_spectate_oversized) == NULL) { goto end; }
+
+    // Run tests
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+
+end:
+    log_close();
+    CU_cleanup_registry();
+    return CU_get_error();
+}
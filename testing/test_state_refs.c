@@ -0,0 +1,207 @@
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <game/state_refs.h>
+
+#define TOY_ANIMATIONS 3
+#define TOY_SPRITES 2
+
+// A toy resource file: a few animations with a few sprites each, and the palette
+// and sound table that go with it. Like a BK or AF file, looked up by animation id.
+typedef struct toy_file_t {
+    animation anis[TOY_ANIMATIONS];
+    palette pal;
+    char stl[30];
+} toy_file;
+
+// A toy scene, made of a scene file and the file of one player
+typedef struct toy_scene_t {
+    toy_file *files[2];
+    state_refs refs;
+} toy_scene;
+
+static animation* toy_animation(void *file, int id) {
+    toy_file *f = file;
+    if(id < 1 || id > TOY_ANIMATIONS) {
+        return NULL;
+    }
+    return &f->anis[id - 1];
+}
+
+static toy_file* toy_file_create() {
+    toy_file *f = malloc(sizeof(toy_file));
+    memset(f, 0, sizeof(toy_file));
+    for(int i = 0; i < TOY_ANIMATIONS; i++) {
+        f->anis[i].id = i + 1;
+        vector_create(&f->anis[i].sprites, sizeof(sprite));
+        for(int k = 0; k < TOY_SPRITES; k++) {
+            sprite s;
+            memset(&s, 0, sizeof(sprite));
+            s.id = k;
+            vector_append(&f->anis[i].sprites, &s);
+        }
+    }
+    return f;
+}
+
+static void toy_file_free(toy_file *f) {
+    for(int i = 0; i < TOY_ANIMATIONS; i++) {
+        vector_free(&f->anis[i].sprites);
+    }
+    free(f);
+}
+
+static void toy_scene_create(toy_scene *sc) {
+    state_refs_create(&sc->refs);
+    for(int i = 0; i < 2; i++) {
+        sc->files[i] = toy_file_create();
+    }
+    state_refs_set_source(&sc->refs, STATE_SOURCE_SCENE, sc->files[0], toy_animation,
+        &sc->files[0]->pal, sc->files[0]->stl);
+    state_refs_set_source(&sc->refs, STATE_SOURCE_PLAYER1, sc->files[1], toy_animation,
+        &sc->files[1]->pal, sc->files[1]->stl);
+}
+
+static void toy_scene_free(toy_scene *sc) {
+    for(int i = 0; i < 2; i++) {
+        toy_file_free(sc->files[i]);
+    }
+}
+
+static void toy_object(object *obj, toy_file *ani_file, int ani_id, int sprite_id, toy_file *pal_file) {
+    memset(obj, 0, sizeof(object));
+    obj->cur_animation_own = OWNER_EXTERNAL;
+    obj->cur_animation = &ani_file->anis[ani_id - 1];
+    obj->cur_sprite = vector_get(&obj->cur_animation->sprites, sprite_id);
+    obj->cur_palette = &pal_file->pal;
+    obj->sound_translation_table = ani_file->stl;
+}
+
+void test_state_refs_fresh_scene(void) {
+    toy_scene a, b;
+    object obj;
+    char buf[sizeof(object_refs)];
+
+    // Save the references of an object that mixes sources
+    toy_scene_create(&a);
+    toy_object(&obj, a.files[1], 2, 1, a.files[0]);
+    object_refs saved;
+    CU_ASSERT(state_refs_find(&a.refs, &obj, &saved) == 0);
+    memcpy(buf, &saved, sizeof(object_refs));
+
+    // Build the scene again, as another machine would, after the first one is gone.
+    // Allocate the new files before freeing the old ones, so that none is reused.
+    toy_scene_create(&b);
+    toy_scene_free(&a);
+
+    object_refs loaded;
+    memcpy(&loaded, buf, sizeof(object_refs));
+    animation *ani;
+    sprite *spr;
+    palette *pal;
+    char *stl;
+    CU_ASSERT(state_refs_resolve(&b.refs, &loaded, &ani, &spr, &pal, &stl) == 0);
+    CU_ASSERT(ani == &b.files[1]->anis[1]);
+    CU_ASSERT(spr == vector_get(&b.files[1]->anis[1].sprites, 1));
+    CU_ASSERT(pal == &b.files[0]->pal);
+    CU_ASSERT(stl == b.files[1]->stl);
+    toy_scene_free(&b);
+}
+
+void test_state_refs_unknown(void) {
+    toy_scene a;
+    object obj;
+    object_refs refs;
+    toy_file *stray = toy_file_create();
+    toy_scene_create(&a);
+
+    // Animations, palettes and sound tables from outside the scene can't be saved
+    toy_object(&obj, stray, 1, 0, a.files[0]);
+    CU_ASSERT(state_refs_find(&a.refs, &obj, &refs) == 1);
+    toy_object(&obj, a.files[0], 1, 0, stray);
+    CU_ASSERT(state_refs_find(&a.refs, &obj, &refs) == 1);
+    toy_object(&obj, a.files[0], 1, 0, a.files[0]);
+    obj.sound_translation_table = stray->stl;
+    CU_ASSERT(state_refs_find(&a.refs, &obj, &refs) == 1);
+
+    // Neither can a sprite that is not in the animation
+    toy_object(&obj, a.files[0], 1, 0, a.files[0]);
+    obj.cur_sprite = vector_get(&a.files[0]->anis[2].sprites, 0);
+    CU_ASSERT(state_refs_find(&a.refs, &obj, &refs) == 1);
+
+    // Objects with nothing are fine
+    memset(&obj, 0, sizeof(object));
+    CU_ASSERT(state_refs_find(&a.refs, &obj, &refs) == 0);
+    CU_ASSERT(refs.ani_source == STATE_SOURCE_NONE);
+    CU_ASSERT(refs.pal_source == STATE_SOURCE_NONE);
+    CU_ASSERT(refs.stl_source == STATE_SOURCE_NONE);
+
+    toy_scene_free(&a);
+    toy_file_free(stray);
+}
+
+void test_state_refs_invalid(void) {
+    toy_scene a;
+    object obj;
+    object_refs refs, bad;
+    animation *ani;
+    sprite *spr;
+    palette *pal;
+    char *stl;
+    toy_scene_create(&a);
+    toy_object(&obj, a.files[1], 3, 1, a.files[1]);
+    CU_ASSERT(state_refs_find(&a.refs, &obj, &refs) == 0);
+
+    // References that do not point anywhere in the scene are refused
+    bad = refs;
+    bad.ani_source = STATE_SOURCE_PLAYER2;
+    CU_ASSERT(state_refs_resolve(&a.refs, &bad, &ani, &spr, &pal, &stl) == 1);
+    bad = refs;
+    bad.ani_source = 42;
+    CU_ASSERT(state_refs_resolve(&a.refs, &bad, &ani, &spr, &pal, &stl) == 1);
+    bad = refs;
+    bad.ani_id = TOY_ANIMATIONS + 1;
+    CU_ASSERT(state_refs_resolve(&a.refs, &bad, &ani, &spr, &pal, &stl) == 1);
+    bad = refs;
+    bad.sprite = TOY_SPRITES;
+    CU_ASSERT(state_refs_resolve(&a.refs, &bad, &ani, &spr, &pal, &stl) == 1);
+    bad = refs;
+    bad.pal_source = -5;
+    CU_ASSERT(state_refs_resolve(&a.refs, &bad, &ani, &spr, &pal, &stl) == 1);
+
+    // Owned animations are left to the caller
+    bad = refs;
+    bad.ani_source = STATE_SOURCE_OWN;
+    CU_ASSERT(state_refs_resolve(&a.refs, &bad, &ani, &spr, &pal, &stl) == 0);
+    CU_ASSERT(ani == NULL);
+    CU_ASSERT(spr == NULL);
+
+    toy_scene_free(&a);
+}
+
+int main(int argc, char **argv) {
+    CU_pSuite suite = NULL;
+    if(CU_initialize_registry() != CUE_SUCCESS) {
+        return CU_get_error();
+    }
+
+    // Init suite
+    suite = CU_add_suite("State references", NULL, NULL);
+    if(suite == NULL) {
+        goto end;
+    }
+
+    // Add tests
+    if(CU_add_test(suite, "Test for loading into a freshly built scene", test_state_refs_fresh_scene) == NULL) { goto end; }
+    if(CU_add_test(suite, "Test for things outside of the scene", test_state_refs_unknown) == NULL) { goto end; }
+    if(CU_add_test(suite, "Test for invalid references", test_state_refs_invalid) == NULL) { goto end; }
+
+    // Run tests
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+
+end:
+    CU_cleanup_registry();
+    return CU_get_error();
+}